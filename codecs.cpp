@@ -22,6 +22,22 @@ void Trinity::Codecs::IndexSession::persist_terms(std::vector<std::pair<str8_t,
         if (Utilities::to_file(data.data(), data.size(), Buffer{}.append(basePath, "/terms.data"_s32).c_str()) == -1)
                 throw Switch::system_error("Failed to persist terms.data");
 
+        // pack_terms() sorted the terms; this doesn't matter for the filter
+        IOBuffer filter;
+
+        pack_terms_bloom_filter(v, &filter);
+        if (Utilities::to_file(filter.data(), filter.size(), Buffer{}.append(basePath, "/terms.bf"_s32).c_str()) == -1)
+                throw Switch::system_error("Failed to persist terms.bf");
+
+#ifdef TRINITY_TERMS_TRIE
+        // pack_terms() sorted the terms
+        index.clear();
+        pack_terms_trie(v, &index);
+
+        if (Utilities::to_file(index.data(), index.size(), Buffer{}.append(basePath, "/terms.trie"_s32).c_str()) == -1)
+                throw Switch::system_error("Failed to persist terms.trie");
+#else
         if (Utilities::to_file(index.data(), index.size(), Buffer{}.append(basePath, "/terms.idx"_s32).c_str()) == -1)
                 throw Switch::system_error("Failed to persist terms.idx");
+#endif
 }
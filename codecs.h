@@ -6,6 +6,7 @@
 #include "runtime.h"
 
 // Use of Codecs::Google results in a somewhat large index, while the access time is similar(maybe somewhat slower) to Lucene's codec
+// Codecs::EliasFano is compact and its advance() is cheap, which makes it a good fit for conjunctions heavy workloads; see eliasfano_codec.h
 namespace Trinity {
         struct candidate_document;
         struct queryexec_ctx;
@@ -58,6 +59,67 @@ namespace Trinity {
                 struct Encoder;
                 struct AccessProxy;
 
+                // Document length norms are encoded in a single byte; exact for short documents, coarser for longer documents.
+                // The encoding is monotonic, so that a lower bound of encoded norms is also a lower bound of document lengths.
+                constexpr uint8_t encode_norm(const uint32_t documentLength) noexcept {
+                        return documentLength < 128 ? documentLength : std::min<uint32_t>(UINT8_MAX, 128 + ((documentLength - 128) >> 4));
+                }
+
+                // Per-block impact metadata, which is all that's needed by a scorer to compute
+                // an upper bound of the score of any document in a postings block, without decoding the block.
+                struct block_impact final {
+                        // upper bound of freq of any document in the block
+                        uint32_t maxFreq;
+                        // lower bound of the encoded norm(see encode_norm()) of any document in the block
+                        uint8_t minNorm;
+                };
+
+                // Postings lists of very high document frequency terms may be stored by codecs as bitmaps(see e.g Lucene::DENSE_CHUNK).
+                // Their iterators expose them via PostingsListIterator::dense_view(), so that e.g conjunctions can probe and intersect them
+                // 64 documents at a time, instead of advancing the iterators.
+                struct dense_postings final {
+                        // document ID of the first bit; always a multiple of 64
+                        isrc_docid_t base;
+                        // in 64bit words
+                        uint32_t size;
+                        // not necessarily aligned
+                        const uint8_t *words;
+
+                        inline uint64_t word(const uint32_t i) const noexcept {
+                                uint64_t w;
+
+                                memcpy(&w, words + i * sizeof(uint64_t), sizeof(uint64_t));
+                                return w;
+                        }
+
+                        // The word that covers documents [id & ~63, (id & ~63) + 64), or 0 if that's outside the bitmap
+                        inline uint64_t word_for(const isrc_docid_t id) const noexcept {
+                                return id >= base && (id - base) / 64 < size ? word((id - base) / 64) : 0;
+                        }
+
+                        inline bool test(const isrc_docid_t id) const noexcept {
+                                return word_for(id) & (uint64_t(1) << (id & 63));
+                        }
+
+                        // The first document >= id, or DocIDsEND
+                        isrc_docid_t next_geq(isrc_docid_t id) const noexcept {
+                                if (id < base)
+                                        id = base;
+
+                                auto i = (id - base) / 64;
+
+                                if (i >= size)
+                                        return DocIDsEND;
+
+                                for (auto w = word(i) & (~uint64_t(0) << (id & 63));; w = word(i)) {
+                                        if (w)
+                                                return base + i * 64 + __builtin_ctzll(w);
+                                        else if (++i == size)
+                                                return DocIDsEND;
+                                }
+                        }
+                };
+
                 // Represents a new indexer session
                 // All indexer sessions have an `indexOut` that holds the inverted index(posting lists for each distinct term)
                 // but other codecs may e.g open/track more files or buffers depending on their needs.
@@ -119,6 +181,13 @@ namespace Trinity {
                         // which codec to use to access it
                         virtual strwlen8_t codec_identifier() = 0;
 
+                        // Codec specific on-disk format revision; persisted in the segment id file alongside codec_identifier()
+                        // so that segments created with older revisions of a codec can still be accessed.
+                        // see persist_segment() and SegmentIndexSource
+                        virtual uint8_t format_version() {
+                                return 0;
+                        }
+
                         // Constructs a new encoder
                         // Handy utility function
                         virtual Encoder *new_encoder() = 0;
@@ -194,6 +263,12 @@ namespace Trinity {
                         // Payload can be upto 8 byte sin size(sizeof(uint64_t)). You should try to keep that as low as possible.
                         virtual void new_hit(const uint32_t position, const range_base<const uint8_t *, const uint8_t> payload) = 0;
 
+                        // Optional; the encoded length norm(see encode_norm()) of the current document, which can be
+                        // provided anytime between begin_document() and end_document().
+                        // Codecs that track per-block impacts make use of it, others ignore it. If not provided, 0(the most favorable norm) is assumed.
+                        virtual void document_norm(const uint8_t) {
+                        }
+
                         virtual void end_document() = 0;
 
                         virtual void end_term(term_index_ctx *) = 0;
@@ -230,6 +305,40 @@ namespace Trinity {
                         // so you should not materialize if have already done so.
                         virtual void materialize_hits(DocWordsSpace *dwspace, term_hit *out) = 0;
 
+                        // Dynamic pruning support (see DocsSetSpanForDisjunctionsWithBlockMax)
+                        //
+                        // Returns the last document ID of the postings block that contains target (or would contain it), and sets
+                        // *impact to the impact metadata of that block. This must not decode the block or
+                        // otherwise change the iterator's state; it's only about whatever metadata(e.g skiplists) the codec has access to.
+                        //
+                        // Codecs that don't know about blocks should just return DocIDsEND, with impact->maxFreq set to max_freq_bound()
+                        // and impact->minNorm set to 0, which is what the default impl. does.
+                        virtual isrc_docid_t block_bound(const isrc_docid_t target, block_impact *const impact) {
+                                impact->maxFreq = max_freq_bound();
+                                impact->minNorm = 0;
+                                return DocIDsEND;
+                        }
+
+                        // An upper bound of freq across all documents in the postings list
+                        virtual uint32_t max_freq_bound() {
+                                return std::numeric_limits<tokenpos_t>::max();
+                        }
+
+                        // Block-at-a-time intersections support(see ConjuctionAllPLI)
+                        //
+                        // If the codec decodes documents in blocks, copies the IDs of the documents of the current block, starting from the
+                        // current document(i.e out[0] == current()), up to max, and returns how many were copied.
+                        // This must not change the iterator's state. Returns 0 if that's not supported, or if there is no current document.
+                        virtual uint32_t buffered_documents(isrc_docid_t *const out, const uint32_t max) {
+                                return 0;
+                        }
+
+                        // If the postings list is stored as a bitmap, returns it; see dense_postings
+                        // It must remain valid for as long as the iterator is.
+                        virtual const dense_postings *dense_view() noexcept {
+                                return nullptr;
+                        }
+
                         inline auto decoder() noexcept {
                                 return dec;
                         }
@@ -260,6 +369,14 @@ namespace Trinity {
                         exec_term_id_t execCtxTermID{0};
                         queryexec_ctx *rctx{nullptr};
 
+                        // Number of postings(documents) decoded by this decoder's iterators so far
+                        // Codecs should update it whenever they decode a block of documents. See exec_budget
+                        uint64_t decodedPostings{0};
+
+                        // If false, materialize_hits() needn't provide payloads(term_hit::payload and payloadLen may be set to 0), so
+                        // codecs that store them apart from the positions can avoid accessing them. See ExecFlags::DisregardPayloads
+                        bool payloads{true};
+
                         constexpr auto exec_ctx_termid() const noexcept {
                                 return execCtxTermID;
                         }
@@ -273,6 +390,13 @@ namespace Trinity {
                         // This is how you are going to access the postings list
                         virtual PostingsListIterator *new_iterator() = 0;
 
+                        // A hint that the postings list is about to be accessed(see queryexec_ctx::prepare_decoder())
+                        // Codecs that access postings via file mappings that may not be resident can initiate asynchronous reads of
+                        // the first blocks here, so that the I/O for all query terms overlaps, instead of page faults stalling
+                        // the query while decoding, one term at a time.
+                        virtual void prefetch() {
+                        }
+
                         Decoder() {
                         }
 
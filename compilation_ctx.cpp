@@ -12,6 +12,7 @@ compilation_ctx::phrase *compilation_ctx::register_phrase(const Trinity::phrase
         auto ptr = static_cast<phrase *>(allocator.Alloc(sizeof(phrase) + sizeof(exec_term_id_t) * p->size));
 
         ptr->size = p->size;
+        ptr->slop = p->slop;
         for (size_t i{0}; i != p->size; ++i) {
                 if (const auto id = resolve_query_term(p->terms[i].token))
                         ptr->termIDs[i] = id;
@@ -55,7 +56,7 @@ bool compilation_ctx::phrase::intersected_by(const termsrun *const tr) const noe
 }
 
 bool compilation_ctx::phrase::operator==(const phrase &o) const noexcept {
-        if (size == o.size) {
+        if (size == o.size && slop == o.slop) {
                 for (size_t i{0}; i != size; ++i) {
                         if (termIDs[i] != o.termIDs[i])
                                 return false;
@@ -1262,7 +1263,7 @@ static exec_node optimize_node(exec_node n, compilation_ctx &cctx, simple_alloca
                                 for (size_t i{0}; i != run->size;) {
                                         const auto p = run->phrases[i];
 
-                                        if (p->is_set(rhsPhrase->termIDs, rhsPhrase->size))
+                                        if (p->implies(*rhsPhrase))
                                                 run->phrases[i] = run->phrases[--(run->size)];
                                         else
                                                 ++i;
@@ -1288,7 +1289,7 @@ static exec_node optimize_node(exec_node n, compilation_ctx &cctx, simple_alloca
                                 for (size_t i{0}; i != run->size; ++i) {
                                         const auto p = run->phrases[i];
 
-                                        if (p->is_set(rhsPhrase->termIDs, rhsPhrase->size)) {
+                                        if (p->implies(*rhsPhrase)) {
                                                 n.fp = ENT::constfalse;
                                                 set_dirty();
                                                 return n;
@@ -1517,37 +1518,16 @@ void PrintImpl(Buffer &b, const exec_node &n) {
         }
 }
 
-static exec_node compile(const ast_node *const n, compilation_ctx &cctx, simple_allocator &a) {
+// Second pass
+// Optimize and expand
+static exec_node optimize(exec_node root, compilation_ctx &cctx, simple_allocator &a) {
         static constexpr bool                        traceMetrics{false};
-        uint64_t                                     before;
+        const auto                                   before = Timings::Microseconds::Tick();
         std::vector<exec_term_id_t>                  terms;
         std::vector<const compilation_ctx::phrase *> phrases;
         std::vector<exec_node>                       stack;
+        bool                                         updates;
 
-        // First pass
-        // Compile from AST tree to exec_nodes tree
-        before = Timings::Microseconds::Tick();
-
-        [[maybe_unused]] const auto compile_begin{before};
-        auto                        root = compile_node(n, cctx, a);
-        bool                        updates;
-
-        if (traceMetrics || traceCompile)
-                SLog(duration_repr(Timings::Microseconds::Since(before)), " to compile to:", root, "\n");
-
-        if (root.fp == ENT::constfalse) {
-                if constexpr (traceCompile)
-                        SLog("Nothing to do, compile_node() compiled away the expr.\n");
-
-                return {ENT::constfalse, {}};
-        }
-
-        if constexpr (traceCompile)
-                SLog("Before second pass:", root, "\n");
-
-        // Second pass
-        // Optimize and expand
-        before = Timings::Microseconds::Tick();
         do {
                 // collapse and expand nodes
                 // this was pulled out of optimize_node() in order to safeguard us from some edge conditions
@@ -1583,6 +1563,30 @@ static exec_node compile(const ast_node *const n, compilation_ctx &cctx, simple_
         return root;
 }
 
+static exec_node compile(const ast_node *const n, compilation_ctx &cctx, simple_allocator &a) {
+        static constexpr bool traceMetrics{false};
+
+        // First pass
+        // Compile from AST tree to exec_nodes tree
+        const auto before = Timings::Microseconds::Tick();
+        const auto root   = compile_node(n, cctx, a);
+
+        if (traceMetrics || traceCompile)
+                SLog(duration_repr(Timings::Microseconds::Since(before)), " to compile to:", root, "\n");
+
+        if (root.fp == ENT::constfalse) {
+                if constexpr (traceCompile)
+                        SLog("Nothing to do, compile_node() compiled away the expr.\n");
+
+                return {ENT::constfalse, {}};
+        }
+
+        if constexpr (traceCompile)
+                SLog("Before second pass:", root, "\n");
+
+        return optimize(root, cctx, a);
+}
+
 // Considers all binary ops, and potentiall swaps (lhs, rhs) of binary ops,
 // but not based on actual cost but on heuristics
 struct reorder_ctx final {
@@ -1757,6 +1761,13 @@ exec_node Trinity::compile_query(ast_node *root, compilation_ctx &cctx) {
         return compile(reorder_root(root), cctx, a);
 }
 
+exec_node Trinity::optimize_compiled_query(const exec_node root, compilation_ctx &cctx) {
+        if (root.fp == ENT::constfalse || root.fp == ENT::dummyop)
+                return {ENT::constfalse, {}};
+
+        return optimize(root, cctx, cctx.allocator);
+}
+
 void Trinity::group_execnodes(exec_node &n, simple_allocator &a) {
         if (n.fp == ENT::logicaland) {
                 auto ctx = static_cast<compilation_ctx::binop_ctx *>(n.ptr);
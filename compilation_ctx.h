@@ -103,6 +103,7 @@ namespace Trinity {
 
                 struct phrase final {
                         uint8_t        size;
+                        uint8_t        slop; // see Trinity::phrase::slop
                         exec_term_id_t termIDs[0];
 
                         static_assert(std::numeric_limits<decltype(size)>::max() >= Trinity::Limits::MaxPhraseSize);
@@ -119,6 +120,11 @@ namespace Trinity {
                         bool is_set(const exec_term_id_t id) const noexcept;
 
                         bool is_set(const exec_term_id_t *const l, const uint8_t n) const noexcept;
+
+                        // true if a match of this phrase is also a match of o(i.e o is a sub-phrase of this phrase, and is at least as sloppy)
+                        bool implies(const phrase &o) const noexcept {
+                                return slop <= o.slop && is_set(o.termIDs, o.size);
+                        }
                 };
 
                 struct phrasesrun final {
@@ -161,5 +167,9 @@ namespace Trinity {
 
         exec_node compile_query(ast_node *root, compilation_ctx &cctx);
 
+        // Runs the optimization passes of compile_query() on an already compiled exec_nodes tree
+        // You should use it if you have modified a compiled tree, e.g replaced nodes with ENT::constfalse(see compiled_query_plan::instantiate())
+        exec_node optimize_compiled_query(const exec_node root, compilation_ctx &cctx);
+
         void group_execnodes(exec_node &, simple_allocator &);
 } // namespace Trinity
@@ -1,6 +1,11 @@
 #include "docset_iterators.h"
 #include "codecs.h"
 #include "queryexec_ctx.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
 
 // see reorder_execnode_impl()
 uint64_t Trinity::DocsSetIterators::Iterator::cost() {
@@ -63,20 +68,128 @@ uint64_t Trinity::DocsSetIterators::cost(const Iterator *it) {
         }
 }
 
+// Intersects two ascending sequences into out, which may alias a
+// For each value in a, we skip past the values in b that are lower than it a SIMD register at a time, and compare against the register
+// where it may be found(see "SIMD Compression and the Intersection of Sorted Integers", Lemire et al.)
+static uint32_t intersect_sorted(const uint32_t *a, const uint32_t n, const uint32_t *const b, const uint32_t m, uint32_t *const out) {
+        uint32_t j{0}, cnt{0};
+
+        for (const auto *const end = a + n; a != end; ++a) {
+                const auto id = *a;
+
+#ifdef __AVX2__
+                const auto v = _mm256_set1_epi32(id);
+
+                while (j + 8 <= m && b[j + 7] < id)
+                        j += 8;
+
+                if (j + 8 <= m) {
+                        const auto eq = _mm256_cmpeq_epi32(v, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j)));
+
+                        out[cnt] = id;
+                        cnt += _mm256_movemask_epi8(eq) != 0;
+                        continue;
+                }
+#else
+                const auto v = _mm_set1_epi32(id);
+
+                while (j + 4 <= m && b[j + 3] < id)
+                        j += 4;
+
+                if (j + 4 <= m) {
+                        const auto eq = _mm_cmpeq_epi32(v, _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j)));
+
+                        out[cnt] = id;
+                        cnt += _mm_movemask_epi8(eq) != 0;
+                        continue;
+                }
+#endif
+
+                while (j != m && b[j] < id)
+                        ++j;
+
+                if (j == m)
+                        break;
+
+                out[cnt] = id;
+                cnt += b[j] == id;
+        }
+
+        return cnt;
+}
+
+// Collects the positions of the hits that may be the k-th term of a phrase, as the position the phrase would begin at
+static uint32_t phrase_positions(const Trinity::term_hits *const th, const uint32_t k, uint32_t *const out) {
+        const auto *const hits = th->all;
+        uint32_t          cnt{0};
+
+        for (uint32_t i{0}, freq = th->freq; i != freq; ++i) {
+                // hits with no position(0) are first, and phrases begin at position 1
+                const uint32_t pos = hits[i].pos;
+
+                out[cnt] = pos - k;
+                cnt += pos > k;
+        }
+
+        return cnt;
+}
+
+// Counts the positions of the first term of a sloppy phrase(see phrase::slop) the phrase can begin at, up to maxCnt
+// For each such position, we pick the closest following position of every other term in order, which minimizes the window.
+// Because those can only move forward as we consider the next positions of the first term, we scan the hits of every term once.
+static uint32_t sloppy_phrase_matches(Trinity::term_hits *const *const ths, const uint16_t n, const uint8_t slop, const uint32_t maxCnt) {
+        const uint32_t maxSpan = n - 1 + slop;
+        uint32_t       cursors[Trinity::Limits::MaxPhraseSize]{0};
+        uint32_t       cnt{0};
+        const auto     firstFreq = ths[0]->freq;
+        const auto *   firstHits = ths[0]->all;
+
+        for (uint32_t i{0}; i != firstFreq; ++i) {
+                const uint32_t first = firstHits[i].pos;
+                uint32_t       prev  = first;
+                uint16_t       k;
+
+                if (!first)
+                        continue;
+
+                for (k = 1; k != n; ++k) {
+                        const auto *const hits = ths[k]->all;
+                        const auto        freq = ths[k]->freq;
+                        auto              j    = cursors[k];
+
+                        while (j != freq && hits[j].pos <= prev)
+                                ++j;
+
+                        cursors[k] = j;
+                        if (j == freq) {
+                                // no more matches
+                                return cnt;
+                        }
+
+                        prev = hits[j].pos;
+                        if (prev - first > maxSpan)
+                                break;
+                }
+
+                if (k == n && ++cnt == maxCnt)
+                        break;
+        }
+
+        return cnt;
+}
+
 bool Trinity::DocsSetIterators::Phrase::consider_phrase_match() {
         [[maybe_unused]] static constexpr bool trace{false};
-        const auto                             did         = curDocument.id;
-        auto &                                 rctx        = *rctxRef;
-        auto *const                            doc         = rctx.document_by_id(did);
-        const auto                             n           = size;
-        auto                                   it          = its[0];
-        const auto                             firstTermID = it->decoder()->exec_ctx_termid();
-        auto *const __restrict__ th                        = doc->materialize_term_hits(&rctx, it, firstTermID); // will create and initialize dws if not created
-        auto *const __restrict__ dws                       = doc->matchedDocument.dws;
-        const auto firstTermFreq                           = th->freq;
-        const auto firstTermHits                           = th->all;
+        const auto                             did  = curDocument.id;
+        auto &                                 rctx = *rctxRef;
+        auto *const                            doc  = rctx.document_by_id(did);
+        const auto                             n    = size;
+        Trinity::term_hits *                   ths[Trinity::Limits::MaxPhraseSize];
+        uint16_t                               order[Trinity::Limits::MaxPhraseSize];
+        uint32_t                               maxFreq{0};
 
         require(curDocument.id == doc->id);
+        EXPECT(n <= Trinity::Limits::MaxPhraseSize);
 
         // On one hand, we care for documents where we have CAPTURED terms, and so we only need to bind
         // this phrase to a document if all terms match.
@@ -88,65 +201,53 @@ bool Trinity::DocsSetIterators::Phrase::consider_phrase_match() {
         // materialized hits for those terms? Because this phrase is no longer bound to document 10 (assuming no other iterators are bound to it either), and
         // another iterator advances to document 10 and needs to access the same terms, it means we 'll need to dematerialize them again.
         // Maybe this is not a big deal though?
-        matchCnt = 0;
-        for (uint16_t i{1}; i != n; ++i) {
+        for (uint16_t i{0}; i != n; ++i) {
                 auto it = its[i];
 
-                doc->materialize_term_hits(&rctx, it, it->decoder()->exec_ctx_termid());
+                ths[i]   = doc->materialize_term_hits(&rctx, it, it->decoder()->exec_ctx_termid()); // will create and initialize dws if not created
+                order[i] = i;
+                maxFreq  = std::max<uint32_t>(maxFreq, ths[i]->freq);
         }
 
-        if (trace)
-                SLog("firstTermFreq = ", firstTermFreq, "\n");
-
-        for (size_t i{0}; i != firstTermFreq; ++i) {
-                if (const auto pos = firstTermHits[i].pos) {
-                        if (trace)
-                                SLog("For POS ", pos, "\n");
-
-                        for (uint8_t k{1};; ++k) {
-                                if (k == n) {
-                                        // matched seq
-                                        if (trace)
-                                                SLog("MATCHED\n");
-
-                                        if (++matchCnt == maxMatchCnt) {
-                                                if (release_docrefs) {
-                                                        rctx.cds_release(doc);
-                                                } else {
-                                                        // If this matches a PHRASE, and we will need this
-                                                        // for prepare_match()
-                                                        // then this may be an issue -- we need to otherwise
-                                                        // retain this document and GC it later
-                                                        //
-                                                        // UPDATE: if we have multiple phrases for this logical evaluation
-                                                        // we don't want to retain a document again; once would do
-                                                        if (doc->rc == 1) {
-                                                                rctx.track_docref(doc);
-                                                        } else {
-                                                                rctx.cds_release(doc);
-                                                        }
-                                                }
-
-                                                return true;
-                                        } else
-                                                break;
-                                }
+        if (slop) {
+                matchCnt = sloppy_phrase_matches(ths, n, slop, maxMatchCnt);
+        } else {
+                // Instead of testing the DocWordsSpace for every position of the first term, we intersect the (sorted) positions of the terms, each
+                // offset by the term's index in the phrase, so that the common values are the positions the phrase begins at. The rarest term
+                // drives the intersection, and we consider the terms in ascending frequency order, so that we can give up as early as possible.
+                std::sort(order, order + n, [ths](const auto a, const auto b) noexcept { return ths[a]->freq < ths[b]->freq; });
+
+                if (const auto required = maxFreq * 2; required > positionsCapacity) {
+                        positionsCapacity = required + 64;
+                        positions         = static_cast<uint32_t *>(std::realloc(positions, sizeof(uint32_t) * positionsCapacity));
+                }
 
-                                const auto termID = static_cast<const Codecs::PostingsListIterator *>(its[k])->decoder()->exec_ctx_termid();
+                auto *const cand  = positions;
+                auto *const other = positions + maxFreq;
+                auto        cnt   = phrase_positions(ths[order[0]], order[0], cand);
 
-                                if (trace)
-                                        SLog("Check for ", termID, " at ", pos + k, ": ", dws->test(termID, pos + k), "\n");
+                for (uint16_t i{1}; cnt && i != n; ++i) {
+                        const auto k = order[i];
 
-                                if (!dws->test(termID, pos + k))
-                                        break;
-                        }
+                        cnt = intersect_sorted(cand, cnt, other, phrase_positions(ths[k], k, other), cand);
                 }
+
+                matchCnt = std::min<uint32_t>(cnt, maxMatchCnt);
         }
 
+        if (trace)
+                SLog("Phrase matches ", matchCnt, " for ", did, "\n");
+
         if (release_docrefs) {
                 rctx.cds_release(doc);
         } else {
-                // See earlier comments
+                // If this matches a PHRASE, and we will need this
+                // for prepare_match()
+                // then this may be an issue -- we need to otherwise
+                // retain this document and GC it later
+                //
+                // UPDATE: if we have multiple phrases for this logical evaluation
+                // we don't want to retain a document again; once would do
                 if (doc->rc == 1) {
                         rctx.track_docref(doc);
                 } else {
@@ -223,6 +324,24 @@ Trinity::isrc_docid_t Trinity::DocsSetIterators::Phrase::next() {
                 return DocIDsEND; // already reset curDocument.id to DocIDsEND
 }
 
+Trinity::DocsSetIterators::ConjuctionAllPLI::ConjuctionAllPLI(Iterator **iterators, const uint16_t cnt)
+    : Iterator{Type::ConjuctionAllPLI}, its((Codecs::PostingsListIterator **)malloc(sizeof(Codecs::PostingsListIterator *) * cnt)), size{cnt}, dense((const Codecs::dense_postings **)malloc(sizeof(Codecs::dense_postings *) * cnt)), denseCnt{0} {
+        require(cnt);
+        memcpy(its, iterators, cnt * sizeof(Codecs::PostingsListIterator *));
+
+        for (uint16_t i{0}; i != cnt; ++i) {
+                if ((dense[i] = its[i]->dense_view()))
+                        ++denseCnt;
+        }
+
+        // we probe bitmaps instead
+        blocks      = !denseCnt;
+        matches     = nullptr;
+        matchesIdx  = 0;
+        matchesCnt  = 0;
+        matchesUpto = 0;
+}
+
 Trinity::isrc_docid_t Trinity::DocsSetIterators::ConjuctionAllPLI::advance(const isrc_docid_t target) {
         if (size) {
                 const auto id = its[0]->advance(target);
@@ -249,13 +368,129 @@ Trinity::isrc_docid_t Trinity::DocsSetIterators::ConjuctionAllPLI::next() {
                 return DocIDsEND; // already reset curDocument.id to DocIDsEND
 }
 
+// All postings lists are bitmaps; we don't need to advance any iterator until we find a document in all of them
+Trinity::isrc_docid_t Trinity::DocsSetIterators::ConjuctionAllPLI::dense_next_impl(isrc_docid_t id) {
+        const auto   n{size};
+        isrc_docid_t from{id};
+        uint64_t     end{UINT64_MAX};
+
+        // only the range all bitmaps span may contain common documents
+        for (uint16_t i{0}; i != n; ++i) {
+                const auto d = dense[i];
+
+                from = std::max(from, d->base);
+                end  = std::min(end, uint64_t(d->base) + uint64_t(d->size) * 64);
+        }
+
+        auto mask = ~uint64_t(0) << (from & 63);
+
+        for (uint64_t w = from & ~isrc_docid_t(63); w < end; w += 64, mask = ~uint64_t(0)) {
+                auto v{mask};
+
+                for (uint16_t i{0}; v && i != n; ++i)
+                        v &= dense[i]->word_for(w);
+
+                if (v)
+                        return match(isrc_docid_t(w) + __builtin_ctzll(v));
+        }
+
+        size                  = 0;
+        return curDocument.id = DocIDsEND;
+}
+
+// All iterators are on common document id
+Trinity::isrc_docid_t Trinity::DocsSetIterators::ConjuctionAllPLI::match(const isrc_docid_t id) {
+        for (uint16_t i{0}; i != size; ++i) {
+                auto it = its[i];
+
+                if (it->current() != id)
+                        it->advance(id);
+        }
+
+        return curDocument.id = id;
+}
+
+// Instead of advancing the iterators in turn until they agree on a document, we intersect the documents of their current blocks(windows), and
+// then we only need to advance the iterators to the common documents, if any, which are all in those windows.
+Trinity::isrc_docid_t Trinity::DocsSetIterators::ConjuctionAllPLI::blocks_next_impl(isrc_docid_t id) {
+        while (matchesIdx != matchesCnt && matches[matchesIdx] < id)
+                ++matchesIdx;
+
+        if (matchesIdx != matchesCnt)
+                return match(matches[matchesIdx++]);
+
+        if (id <= matchesUpto) {
+                // no common documents in [id, matchesUpto]
+                if (unlikely((id = its[0]->advance(matchesUpto + 1)) == DocIDsEND)) {
+                        size                  = 0;
+                        return curDocument.id = DocIDsEND;
+                }
+        }
+
+        for (;;) {
+                auto cand = windows[0];
+                auto cnt  = its[0]->buffered_documents(cand, WINDOW_SIZE);
+
+                if (unlikely(!cnt)) {
+                        blocks     = false;
+                        matchesCnt = 0;
+                        return next_impl(id);
+                }
+
+                auto upto = cand[cnt - 1];
+
+                for (uint16_t i{1}; cnt && i != size; ++i) {
+                        auto it = its[i];
+
+                        // documents of it before its current document can't be in [cand[0], current)
+                        if (it->current() < cand[0] && unlikely(it->advance(cand[0]) == DocIDsEND)) {
+                                size                  = 0;
+                                return curDocument.id = DocIDsEND;
+                        }
+
+                        const auto n = it->buffered_documents(windows[2], WINDOW_SIZE);
+
+                        if (unlikely(!n)) {
+                                blocks     = false;
+                                matchesCnt = 0;
+                                return next_impl(id);
+                        }
+
+                        const auto out = cand == windows[0] ? windows[1] : windows[0];
+
+                        upto = std::min(upto, windows[2][n - 1]);
+                        cnt  = intersect_sorted(cand, cnt, windows[2], n, out);
+                        cand = out;
+                }
+
+                matchesUpto = upto;
+                if (cnt) {
+                        matches    = cand;
+                        matchesCnt = cnt;
+                        matchesIdx = 1;
+                        return match(cand[0]);
+                }
+
+                if (unlikely((id = its[0]->advance(upto + 1)) == DocIDsEND)) {
+                        size                  = 0;
+                        return curDocument.id = DocIDsEND;
+                }
+        }
+}
+
 Trinity::isrc_docid_t Trinity::DocsSetIterators::ConjuctionAllPLI::next_impl(isrc_docid_t id) {
+        if (denseCnt == size)
+                return dense_next_impl(id);
+        else if (blocks)
+                return blocks_next_impl(id);
+
 restart:
         for (size_t i{1}; i != size; ++i) {
                 auto it = its[i];
 
                 if (it->current() != id) {
-                        const auto next = it->advance(id);
+                        // probing a bitmap is cheaper than advancing its iterator, especially if id is not there
+                        const auto next = dense[i] && !dense[i]->test(id) ? dense[i]->next_geq(id) : it->advance(id);
 
                         if (next > id) {
                                 if (unlikely(next == DocIDsEND)) {
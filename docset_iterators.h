@@ -16,6 +16,7 @@ namespace Trinity {
 
         namespace Codecs {
                 struct PostingsListIterator;
+                struct dense_postings;
         }
 
         namespace DocsSetIterators {
@@ -309,17 +310,36 @@ namespace Trinity {
                         Codecs::PostingsListIterator **const its;
                         uint16_t                             size;
 
+                      private:
+                        // dense[i] is its[i]->dense_view(); we can probe those bitmaps instead of advancing the iterators, and
+                        // if all postings lists are bitmaps, we can intersect them 64 documents at a time
+                        const Codecs::dense_postings **const dense;
+                        uint16_t                             denseCnt;
+
+                        // Block-at-a-time intersection(see blocks_next_impl()); disabled as soon as we find an iterator
+                        // that doesn't support PostingsListIterator::buffered_documents()
+                        static constexpr size_t WINDOW_SIZE{128};
+                        bool                    blocks;
+                        // common documents in the last intersected windows, and the last document ID those windows spanned
+                        const isrc_docid_t *matches;
+                        uint16_t            matchesIdx, matchesCnt;
+                        isrc_docid_t        matchesUpto;
+                        isrc_docid_t        windows[3][WINDOW_SIZE];
+
                       private:
                         isrc_docid_t next_impl(isrc_docid_t id);
 
+                        isrc_docid_t dense_next_impl(isrc_docid_t id);
+
+                        isrc_docid_t blocks_next_impl(isrc_docid_t id);
+
+                        isrc_docid_t match(const isrc_docid_t id);
+
                       public:
-                        ConjuctionAllPLI(Iterator **iterators, const uint16_t cnt)
-                            : Iterator{Type::ConjuctionAllPLI}, size{cnt}, its((Codecs::PostingsListIterator **)malloc(sizeof(Codecs::PostingsListIterator *) * cnt)) {
-                                require(cnt);
-                                memcpy(its, iterators, cnt * sizeof(Codecs::PostingsListIterator *));
-                        }
+                        ConjuctionAllPLI(Iterator **iterators, const uint16_t cnt);
 
                         ~ConjuctionAllPLI() noexcept {
+                                std::free(dense);
                                 std::free(its);
                         }
 
@@ -381,24 +401,30 @@ namespace Trinity {
                         uint16_t                             size;
                         const uint16_t                       maxMatchCnt;
                         uint16_t                             matchCnt{0};
-                        const bool                           release_docrefs;
+                        // see phrase::slop
+                        const uint8_t slop;
+                        const bool    release_docrefs;
 
                       private:
                         queryexec_ctx *const rctxRef;
-                        isrc_docid_t         next_impl(isrc_docid_t id);
+                        // scratch space for consider_phrase_match()
+                        uint32_t *   positions{nullptr};
+                        uint32_t     positionsCapacity{0};
+                        isrc_docid_t next_impl(isrc_docid_t id);
 
                       public:
                         isrc_docid_t lastUncofirmedDID{DocIDsEND};
 
                       public:
-                        Phrase(queryexec_ctx *r, Codecs::PostingsListIterator **iterators, const uint16_t cnt, const bool trackCnt, const bool docsOnly_)
-                            : Iterator{Type::Phrase}, its((Codecs::PostingsListIterator **)malloc(sizeof(Codecs::PostingsListIterator *) * cnt)), size{cnt}, maxMatchCnt{uint16_t(trackCnt ? std::numeric_limits<uint16_t>::max() : 1)}, rctxRef{r}, release_docrefs{docsOnly_} {
+                        Phrase(queryexec_ctx *r, Codecs::PostingsListIterator **iterators, const uint16_t cnt, const uint8_t slop_, const bool trackCnt, const bool docsOnly_)
+                            : Iterator{Type::Phrase}, its((Codecs::PostingsListIterator **)malloc(sizeof(Codecs::PostingsListIterator *) * cnt)), size{cnt}, maxMatchCnt{uint16_t(trackCnt ? std::numeric_limits<uint16_t>::max() : 1)}, slop{slop_}, release_docrefs{docsOnly_}, rctxRef{r} {
                                 require(cnt);
                                 memcpy(its, iterators, sizeof(iterators[0]) * cnt);
                         }
 
                         ~Phrase() noexcept {
                                 std::free(its);
+                                std::free(positions);
                         }
 
                         isrc_docid_t advance(const isrc_docid_t target) override final;
@@ -431,17 +457,18 @@ namespace Trinity {
                                 std::sort(ids.begin(), ids.end());	 // TODO: use boost::spreadsort
                         }
 
+                        // v must be sorted, and not contain duplicates
+                        VectorIDs(std::vector<isrc_docid_t> &&v)
+                            : Iterator{Type::VectorIDs}, ids(std::move(v)) {
+                        }
+
                         inline isrc_docid_t next() override {
                                 return idx == ids.size() ? curDocument.id = DocIDsEND : curDocument.id = ids[idx++];
                         }
 
                         isrc_docid_t advance(isrc_docid_t target) override {
-                                isrc_docid_t id;
-
-                                while ((id = next()) < target)
-                                        continue;
-
-                                return id;
+                                idx = std::lower_bound(ids.begin() + idx, ids.end(), target) - ids.begin();
+                                return next();
                         }
 
 #ifdef RDP_NEED_TOTAL_MATCHES
@@ -30,6 +30,11 @@ static IteratorScorer *default_wrapper(queryexec_ctx *const rctx, DocsSetIterato
 
                                         return scorer->score(i->current(), i->freq, weight);
                                 }
+
+                                double iterator_max_score(const uint32_t maxFreq, const uint8_t minNorm) override final {
+                                        // freq is a tokenpos_t, so it can't exceed that anyway
+                                        return scorer->max_score(std::min<uint32_t>(maxFreq, std::numeric_limits<tokenpos_t>::max()), minNorm, weight);
+                                }
                         };
 
                         return new Wrapper(it, rctx);
@@ -5,11 +5,29 @@
 using namespace Trinity;
 extern thread_local Trinity::queryexec_ctx *curRCTX;
 
+// Spans that track their iterators in a PQ ordered by current() don't need to advance() them to min
+// in process(), because they next() them in their constructors and are usually asked to process(.., 1, ..).
+// When executing a documents IDs range(see exec_query() docIDsRange) they may be asked to process from
+// a higher min though, so we advance all iterators that haven't reached it and restore the heap.
+template <typename PQ>
+static void advance_pq_to(PQ &pq, const isrc_docid_t min) {
+        if (unlikely(pq.top()->current() < min)) {
+                for (auto it : pq) {
+                        if (it->current() < min)
+                                it->advance(min);
+                }
+
+                pq.make_heap();
+        }
+}
+
 #pragma mark          DocsSetSpanForPartialMatch
 Trinity::isrc_docid_t Trinity::DocsSetSpanForPartialMatch::process(MatchesProxy *const mp, const isrc_docid_t min, const isrc_docid_t max) {
         isrc_docid_t      id{DocIDsEND};
         relevant_document relDoc;
 
+        advance_pq_to(pq, min);
+
         for (;;) {
                 auto it = pq.top();
 
@@ -99,6 +117,8 @@ Trinity::isrc_docid_t Trinity::DocsSetSpanForDisjunctions::process(MatchesProxy
         isrc_docid_t      id{DocIDsEND};
         relevant_document relDoc;
 
+        advance_pq_to(pq, min);
+
         for (;;) {
                 auto it = pq.top();
 
@@ -682,6 +702,8 @@ Trinity::isrc_docid_t Trinity::DocsSetSpanForDisjunctionsWithThreshold::process(
         isrc_docid_t      id{DocIDsEND};
         relevant_document relDoc;
 
+        advance_pq_to(pq, min);
+
         for (;;) {
                 auto it = pq.top();
 
@@ -788,3 +810,281 @@ Trinity::isrc_docid_t Trinity::DocsSetSpanForDisjunctionsWithThreshold::process(
         // XXX: Shouldn't we return (id + 1) if (id == max && id != DocIDsEND) ?
         return id;
 }
+
+#pragma mark DocsSetSpanForDisjunctionsWithMaxScore
+Trinity::DocsSetSpanForDisjunctionsWithMaxScore::DocsSetSpanForDisjunctionsWithMaxScore(const uint16_t min, std::vector<DocsSetIterators::Iterator *> &its)
+    : storage((it_ctx *)malloc(sizeof(it_ctx) * (its.size() + 1))), maxScoresSums((double *)malloc(sizeof(double) * (its.size() + 1))), essential(its.size()), itsCnt(its.size()), matchThreshold{min}, nonEssentialCnt{0}, cost_{0} {
+        EXPECT(min && min <= its.size());
+        EXPECT(its.size() < UINT16_MAX);
+
+        for (uint32_t i{0}; i != its.size(); ++i) {
+                auto *const it = its[i];
+                auto        c  = storage + i;
+
+                // See comments in DocsSetSpanForDisjunctionsWithThreshold::process() collection loop
+                require(it->current() == 0);
+                // we need the IteratorScorer set by wrap_iterator()
+                require(it->rdp != it);
+                it->next();
+
+                c->it       = it;
+                c->scorer   = static_cast<IteratorScorer *>(it->rdp);
+                c->maxScore = c->scorer->iterator_max_score(it->type == DocsSetIterators::Type::PostingsListIterator
+                                                                ? static_cast<Codecs::PostingsListIterator *>(it)->max_freq_bound()
+                                                                : std::numeric_limits<uint32_t>::max(),
+                                                            0);
+                cost_ += it->cost();
+        }
+
+        std::sort(storage, storage + itsCnt, [](const auto &a, const auto &b) noexcept {
+                return a.maxScore < b.maxScore;
+        });
+
+        for (uint32_t i{0}; i != itsCnt; ++i)
+                maxScoresSums[i] = (i ? maxScoresSums[i - 1] : 0) + storage[i].maxScore;
+
+        for (uint32_t i{0}; i != itsCnt; ++i) {
+                if (storage[i].it->current() != DocIDsEND)
+                        essential.push(storage + i);
+        }
+}
+
+void Trinity::DocsSetSpanForDisjunctionsWithMaxScore::update_partition(const double threshold) {
+        // threshold never decreases, so iterators only ever move from the essential to the non-essential set
+        while (nonEssentialCnt < itsCnt && maxScoresSums[nonEssentialCnt] <= threshold)
+                essential.erase(storage + nonEssentialCnt++);
+}
+
+Trinity::isrc_docid_t Trinity::DocsSetSpanForDisjunctionsWithMaxScore::process(MatchesProxy *const mp, const isrc_docid_t min, const isrc_docid_t max) {
+        relevant_document relDoc;
+        double            threshold = mp->min_competitive_score();
+
+        if (essential.size() && essential.top()->it->current() < min) {
+                essential.clear();
+                for (uint32_t i{nonEssentialCnt}; i != itsCnt; ++i) {
+                        if (auto *const it = storage[i].it; it->current() < min)
+                                it->advance(min);
+
+                        if (storage[i].it->current() != DocIDsEND)
+                                essential.push(storage + i);
+                }
+        }
+
+        update_partition(threshold);
+
+        while (essential.size()) {
+                auto *     top = essential.top();
+                const auto id  = top->it->current();
+                double     score{0};
+                uint16_t   matchedCnt{0};
+
+                if (id >= max)
+                        return id;
+
+                // score and advance all essential iterators on this document
+                do {
+                        score += top->scorer->iterator_score();
+                        ++matchedCnt;
+
+                        if (top->it->next() == DocIDsEND)
+                                essential.pop();
+                        else
+                                essential.update_top();
+                } while (essential.size() && (top = essential.top())->it->current() == id);
+
+                // non-essential iterators, by max score DESC, for as long as the document can still be competitive
+                for (int32_t i = nonEssentialCnt - 1; i >= 0; --i) {
+                        if (score + maxScoresSums[i] <= threshold || matchedCnt + i + 1 < matchThreshold)
+                                break;
+
+                        auto *const c = storage + i;
+                        auto        cur{c->it->current()};
+
+                        if (cur < id)
+                                cur = c->it->advance(id);
+
+                        if (cur == id) {
+                                score += c->scorer->iterator_score();
+                                ++matchedCnt;
+                        }
+                }
+
+                if (matchedCnt >= matchThreshold && score > threshold) {
+                        relDoc.set_document(id);
+                        relDoc.score_ = score;
+                        mp->process(&relDoc);
+
+                        if (const auto t = mp->min_competitive_score(); t > threshold) {
+                                threshold = t;
+                                update_partition(threshold);
+                        }
+                }
+        }
+
+        return DocIDsEND;
+}
+
+#pragma mark DocsSetSpanForDisjunctionsWithBlockMax
+Trinity::DocsSetSpanForDisjunctionsWithBlockMax::DocsSetSpanForDisjunctionsWithBlockMax(std::vector<Codecs::PostingsListIterator *> &v)
+    : storage((it_ctx *)malloc(sizeof(it_ctx) * (v.size() + 1))), its((it_ctx **)malloc(sizeof(it_ctx *) * (v.size() + 1))), size{0} {
+        EXPECT(v.size() && v.size() < UINT16_MAX);
+
+        for (auto it : v) {
+                auto c = storage + size;
+
+                // See comments in DocsSetSpanForDisjunctionsWithThreshold::process() collection loop
+                require(it->current() == 0);
+                // we need the IteratorScorer set by wrap_iterator()
+                require(it->rdp != it);
+                it->next();
+
+                c->it             = it;
+                c->scorer         = static_cast<IteratorScorer *>(it->rdp);
+                c->maxScore       = c->scorer->iterator_max_score(it->max_freq_bound(), 0);
+                c->blockTarget    = DocIDsEND;
+                c->blockLastDocID = 0;
+                c->blockMaxScore  = c->maxScore;
+                its[size++]       = c;
+        }
+
+        restore_order();
+}
+
+uint64_t Trinity::DocsSetSpanForDisjunctionsWithBlockMax::cost() {
+        uint64_t res{0};
+
+        for (uint32_t i{0}; i != size; ++i)
+                res += its[i]->it->cost();
+
+        return res;
+}
+
+void Trinity::DocsSetSpanForDisjunctionsWithBlockMax::restore_order() {
+        // insertion sort; only a few iterators are out of place whenever this is invoked
+        for (uint32_t i{1}; i < size; ++i) {
+                auto *const c  = its[i];
+                const auto  id = c->it->current();
+                auto        j{i};
+
+                for (; j && its[j - 1]->it->current() > id; --j)
+                        its[j] = its[j - 1];
+
+                its[j] = c;
+        }
+
+        // drained iterators are at the end
+        while (size && its[size - 1]->it->current() == DocIDsEND)
+                --size;
+}
+
+void Trinity::DocsSetSpanForDisjunctionsWithBlockMax::update_block_bound(it_ctx *const c, const isrc_docid_t target) {
+        if (target < c->blockTarget || target > c->blockLastDocID) {
+                Codecs::block_impact impact;
+
+                c->blockLastDocID = c->it->block_bound(target, &impact);
+                c->blockTarget    = target;
+                // the block bound can't be higher than the global bound
+                c->blockMaxScore = std::min(c->maxScore, c->scorer->iterator_max_score(impact.maxFreq, impact.minNorm));
+        }
+}
+
+Trinity::isrc_docid_t Trinity::DocsSetSpanForDisjunctionsWithBlockMax::process(MatchesProxy *const mp, const isrc_docid_t min, const isrc_docid_t max) {
+        EXPECT(mp);
+
+        relevant_document relDoc;
+        double            threshold = mp->min_competitive_score();
+
+        {
+                bool advanced{false};
+
+                for (uint32_t i{0}; i != size; ++i) {
+                        if (auto it = its[i]->it; it->current() < min) {
+                                it->advance(min);
+                                advanced = true;
+                        }
+                }
+
+                if (advanced)
+                        restore_order();
+        }
+
+        for (;;) {
+                uint32_t pivot{0};
+                double   sum{0};
+
+                // identify the pivot
+                for (; pivot < size; ++pivot) {
+                        sum += its[pivot]->maxScore;
+
+                        if (sum > threshold)
+                                break;
+                }
+
+                if (pivot == size) {
+                        // no remaining document can be competitive
+                        return DocIDsEND;
+                }
+
+                const auto pivotID = its[pivot]->it->current();
+
+                if (pivotID >= max)
+                        return pivotID;
+
+                // all iterators on the pivot document contribute to its score
+                while (pivot + 1 < size && its[pivot + 1]->it->current() == pivotID)
+                        ++pivot;
+
+                isrc_docid_t upto{DocIDsEND};
+                double       blockSum{0};
+
+                for (uint32_t i{0}; i <= pivot; ++i) {
+                        auto *const c = its[i];
+
+                        update_block_bound(c, pivotID);
+                        blockSum += c->blockMaxScore;
+                        upto = std::min(upto, c->blockLastDocID);
+                }
+
+                if (blockSum > threshold) {
+                        if (its[0]->it->current() == pivotID) {
+                                // all iterators upto the pivot are on pivotID
+                                double score{0};
+
+                                for (uint32_t i{0}; i <= pivot; ++i)
+                                        score += its[i]->scorer->iterator_score();
+
+                                if (score > threshold) {
+                                        relDoc.set_document(pivotID);
+                                        relDoc.score_ = score;
+                                        mp->process(&relDoc);
+                                        threshold = mp->min_competitive_score();
+                                }
+
+                                for (uint32_t i{0}; i <= pivot; ++i)
+                                        its[i]->it->next();
+                        } else {
+                                // documents before the pivot can't be competitive
+                                for (uint32_t i{0}; i < pivot && its[i]->it->current() < pivotID; ++i)
+                                        its[i]->it->advance(pivotID);
+                        }
+                } else {
+                        // No document in [pivotID, upto] can be competitive
+                        // so we can skip ahead to either past the end of the shallowest block or to
+                        // the next iterator's document, whichever comes first
+                        auto target = upto == DocIDsEND ? DocIDsEND : upto + 1;
+
+                        if (pivot + 1 < size)
+                                target = std::min(target, its[pivot + 1]->it->current());
+
+                        if (target == DocIDsEND) {
+                                // we considered all iterators, and they are all in their last blocks
+                                return DocIDsEND;
+                        }
+
+                        for (uint32_t i{0}; i <= pivot; ++i)
+                                its[i]->it->advance(target);
+                }
+
+                restore_order();
+        }
+}
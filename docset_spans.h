@@ -16,6 +16,12 @@ namespace Trinity {
                 virtual void process(relevant_document_provider *) {
                 }
 
+                // Spans that support dynamic pruning (e.g DocsSetSpanForDisjunctionsWithBlockMax) will not
+                // process() documents with a score lower or equal to this.
+                virtual double min_competitive_score() {
+                        return std::numeric_limits<double>::lowest();
+                }
+
                 ~MatchesProxy() {
                 }
         };
@@ -501,4 +507,107 @@ namespace Trinity {
                         return cost_;
                 }
         };
+
+        // MaxScore (Turtle & Flood, "Query Evaluation: Strategies and Optimizations") variant of DocsSetSpanForDisjunctionsWithThresholdAndCost
+        // This is only used if ExecFlags::AccumulatedScoreTopK is set.
+        //
+        // Iterators are ordered by their max score (see IteratorScorer::iterator_max_score()) and are partitioned into non-essential iterators, which is
+        // the longest prefix where the sum of their max scores doesn't exceed the MatchesProxy::min_competitive_score() threshold, and essential iterators.
+        // A document only matched by non-essential iterators can't be competitive, so we only consider documents matched by essential iterators, and
+        // we only advance non-essential iterators to such a document for as long as it can still beat the threshold and match enough iterators.
+        //
+        // As the threshold increases, more iterators become non-essential and fewer documents are considered. This works great
+        // for long disjunctions (e.g synonyms expanded by rewrite_query()) where most terms contribute little to the score.
+        // Iterators that can't provide a bound (e.g phrases) are always essential.
+        class DocsSetSpanForDisjunctionsWithMaxScore final
+            : public DocsSetSpan {
+              private:
+                struct it_ctx final {
+                        DocsSetIterators::Iterator *it;
+                        IteratorScorer *            scorer;
+                        double                      maxScore;
+
+                        struct CompareByCurrent {
+                                [[gnu::always_inline]] inline bool operator()(const it_ctx *const a, const it_ctx *const b) const noexcept {
+                                        return a->it->current() < b->it->current();
+                                }
+                        };
+                };
+
+              private:
+                // ordered by maxScore ASC
+                it_ctx *const storage;
+                // maxScoresSums[i] is the sum of maxScore of storage[0, i]
+                double *const                                              maxScoresSums;
+                Switch::priority_queue<it_ctx *, it_ctx::CompareByCurrent> essential;
+                const uint16_t                                             itsCnt;
+                const uint16_t                                             matchThreshold;
+                // storage[0, nonEssentialCnt) are non-essential
+                uint16_t nonEssentialCnt;
+                uint64_t cost_;
+
+              private:
+                void update_partition(const double threshold);
+
+              public:
+                DocsSetSpanForDisjunctionsWithMaxScore(const uint16_t min, std::vector<DocsSetIterators::Iterator *> &its);
+
+                ~DocsSetSpanForDisjunctionsWithMaxScore() noexcept {
+                        std::free(storage);
+                        std::free(maxScoresSums);
+                }
+
+                isrc_docid_t process(MatchesProxy *const mp, const isrc_docid_t min, const isrc_docid_t max) override final;
+
+                uint64_t cost() override final {
+                        return cost_;
+                }
+        };
+
+        // Block-Max WAND (Ding & Suel, "Faster Top-k Document Retrieval Using Block-Max Indexes")
+        // for disjunctions of PostingsListIterators. This is only used if ExecFlags::AccumulatedScoreTopK is set.
+        //
+        // Each iterator's score is bounded for the whole postings list (max_freq_bound()) and for each postings
+        // block (block_bound()), and we track the iterators ordered by their current document.
+        // We identify the pivot; the first document where the sum of bounds of the iterators up to it exceeds
+        // the MatchesProxy::min_competitive_score() threshold. We only score the pivot if the sum of the block bounds
+        // for it also exceeds the threshold. Otherwise, no document in the blocks of those iterators can be competitive, and we skip past the
+        // first of those blocks to end, which for codecs with skiplists(e.g Lucene's) means the skipped blocks are never decoded.
+        //
+        // As the threshold increases, fewer documents are scored and more blocks are skipped.
+        class DocsSetSpanForDisjunctionsWithBlockMax final
+            : public DocsSetSpan {
+              private:
+                struct it_ctx final {
+                        Codecs::PostingsListIterator *it;
+                        IteratorScorer *              scorer;
+                        double                        maxScore;
+                        // blockMaxScore applies to documents in [blockTarget, blockLastDocID]
+                        isrc_docid_t blockTarget;
+                        isrc_docid_t blockLastDocID;
+                        double       blockMaxScore;
+                };
+
+              private:
+                it_ctx *const  storage;
+                it_ctx **const its; // ordered by current document ASC
+                uint16_t       size;
+
+              private:
+                void update_block_bound(it_ctx *, const isrc_docid_t);
+
+                void restore_order();
+
+              public:
+                DocsSetSpanForDisjunctionsWithBlockMax(std::vector<Codecs::PostingsListIterator *> &its);
+
+                ~DocsSetSpanForDisjunctionsWithBlockMax() noexcept {
+                        std::free(storage);
+                        std::free(its);
+                }
+
+                isrc_docid_t process(MatchesProxy *const mp, const isrc_docid_t min, const isrc_docid_t max) override final;
+
+                uint64_t cost() override final;
+        };
 } // namespace Trinity
@@ -1,5 +1,19 @@
 #include "docwordspace.h"
 
+void Trinity::DocWordsSpace::spill() {
+        if (!positions) {
+                positions = static_cast<position *>(calloc(sizeof(position), maxPos + 1 + Trinity::Limits::MaxPhraseSize));
+        }
+
+        for (const auto &it : sparse) {
+                if (it.docSeq == curSeq) {
+                        positions[it.pos] = {it.termID, curSeq};
+                }
+        }
+
+        denseDoc = true;
+}
+
 bool Trinity::DocWordsSpace::test_phrase(const std::vector<exec_term_id_t> &phraseTerms, const tokenpos_t *phraseFirstTokenPositions, const tokenpos_t phraseFirstTokenPositionsCnt) const {
         for (uint32_t i{0}; i != phraseFirstTokenPositionsCnt; ++i) {
                 const auto pos = phraseFirstTokenPositions[i];
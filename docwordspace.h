@@ -18,18 +18,84 @@ namespace Trinity {
                         seq_t          docSeq;
                 };
 
-                position *const positions;
+                struct sparse_position final {
+                        tokenpos_t     pos;
+                        exec_term_id_t termID;
+                        seq_t          docSeq;
+                };
+
+              public:
+                // If max is higher than that, positions[] spans too many cache lines for documents with few hits(e.g titles), where
+                // almost every set() and test() would touch a cold cache line. Instead, we track the positions of every document in
+                // a small open-addressing hashtable(sparse[]), and only switch to positions[] for the current document if it turns
+                // out it has more than SparseMaxPositions positions set.
+                static constexpr uint32_t SparseMinPosition{1024};
+                static constexpr uint32_t SparseCapacity{64};
+                static constexpr uint32_t SparseMaxPositions{SparseCapacity / 2};
+
+              private:
+                // allocated on demand if sparseMode is set
+                position *      positions;
                 const uint32_t  maxPos;
                 seq_t           curSeq;
+                const bool      sparseMode;
+                // true if the positions of the current document are tracked in positions[]
+                bool            denseDoc;
+                uint8_t         sparseSize;
+                sparse_position sparse[SparseCapacity];
+
+                static_assert((SparseCapacity & (SparseCapacity - 1)) == 0);
+                static_assert(SparseMaxPositions < SparseCapacity && SparseMaxPositions <= std::numeric_limits<uint8_t>::max());
+
+              private:
+                // switches to positions[] for the current document
+                void spill();
+
+                void sparse_set(const exec_term_id_t termID, const tokenpos_t pos) noexcept {
+                        for (uint32_t i = pos & (SparseCapacity - 1);; i = (i + 1) & (SparseCapacity - 1)) {
+                                auto &s = sparse[i];
+
+                                if (s.docSeq != curSeq) {
+                                        if (unlikely(sparseSize == SparseMaxPositions)) {
+                                                spill();
+                                                positions[pos] = {termID, curSeq};
+                                        } else {
+                                                s = {pos, termID, curSeq};
+                                                ++sparseSize;
+                                        }
+                                        return;
+                                } else if (s.pos == pos) {
+                                        s.termID = termID;
+                                        return;
+                                }
+                        }
+                }
+
+                // the hashtable is never more than half full, so we will always get to an empty slot
+                bool sparse_test(const exec_term_id_t termID, const tokenpos_t pos) const noexcept {
+                        for (uint32_t i = pos & (SparseCapacity - 1);; i = (i + 1) & (SparseCapacity - 1)) {
+                                const auto &s = sparse[i];
+
+                                if (s.docSeq != curSeq)
+                                        return false;
+                                else if (s.pos == pos)
+                                        return s.termID == termID;
+                        }
+                }
 
               public:
                 // Allocating max + Trinity::Limits::MaxPhraseSize, because that is the theoritical maximum phrase size
                 // and if we are going to test starting from maxPos extending to 10 positions ahead, we want to
                 // make sure we won't read outside positions.
                 // The extra positions will be always initialized to 0 and we won't need to reset those in reset()
+                //
+                // If max > SparseMinPosition, positions[] is only allocated once a document needs it; see SparseMinPosition
                 DocWordsSpace(const uint32_t max = Trinity::Limits::MaxPosition)
-                    : positions((position *)calloc(sizeof(position), max + 1 + Trinity::Limits::MaxPhraseSize)), maxPos{max} {
-                        curSeq = 1; // IMPORTANT, start from (1)
+                    : positions(max > SparseMinPosition ? nullptr : (position *)calloc(sizeof(position), max + 1 + Trinity::Limits::MaxPhraseSize)), maxPos{max}, sparseMode{max > SparseMinPosition} {
+                        curSeq     = 1; // IMPORTANT, start from (1)
+                        denseDoc   = !sparseMode;
+                        sparseSize = 0;
+                        memset(sparse, 0, sizeof(sparse));
                         EXPECT(max && max <= Trinity::Limits::MaxPosition);
                 }
 
@@ -48,22 +114,36 @@ namespace Trinity {
                                 // we reset every 65k(for u16 seq_t) documents
                                 // this is preferrable to using uint32_t to encode the actual document in position{}
                                 // no need to memset() for (maxPos + 1 + Trinity::Limits::MaxPhraseSize), just upto (maxPos + 1)
-                                memset(positions, 0, sizeof(position) * (maxPos + 1));
+                                if (positions) {
+                                        memset(positions, 0, sizeof(position) * (maxPos + 1));
+                                }
+                                memset(sparse, 0, sizeof(sparse));
                                 curSeq = 1; // important; set to 1 not 0
                         } else {
                                 ++curSeq;
                         }
+
+                        denseDoc   = !sparseMode;
+                        sparseSize = 0;
                 }
 
                 // XXX: pos must be > 0
 #if !defined(TRINITY_VERIFY_HITS)
                 [[gnu::always_inline]] void set(const exec_term_id_t termID, const tokenpos_t pos) noexcept {
-                        positions[pos] = {termID, curSeq};
+                        if (likely(denseDoc)) {
+                                positions[pos] = {termID, curSeq};
+                        } else {
+                                sparse_set(termID, pos);
+                        }
                 }
 #else
                 [[gnu::always_inline]] void set(const exec_term_id_t termID, const tokenpos_t pos) {
                         EXPECT(pos < maxPos);
-                        positions[pos] = {termID, curSeq};
+                        if (denseDoc) {
+                                positions[pos] = {termID, curSeq};
+                        } else {
+                                sparse_set(termID, pos);
+                        }
                 }
 #endif
 
@@ -88,7 +168,11 @@ namespace Trinity {
                 // based on my folly benchmarks
                 // XXX: pos must be > 0
                 inline bool test(const exec_term_id_t termID, const tokenpos_t pos) const noexcept {
-                        return positions[pos].docSeq == curSeq && positions[pos].termID == termID;
+                        if (likely(denseDoc)) {
+                                return positions[pos].docSeq == curSeq && positions[pos].termID == termID;
+                        } else {
+                                return sparse_test(termID, pos);
+                        }
                 }
 
 #else
@@ -117,13 +201,30 @@ namespace Trinity {
                         static_assert(sizeof(termID) == sizeof(uint16_t));
                         static_assert(sizeof(curSeq) == sizeof(uint16_t));
 
+                        if (!denseDoc)
+                                return sparse_test(termID, pos);
+
                         return ((uint32_t(termID) << 16) | curSeq) == *(uint32_t *)&positions[pos];
                 }
 #endif
 
                 // This can facilitate tracking sequences(e.g 2+ qeury terms matches in a document) of a MatchedIndexDocumentsFilter::consider()  impl.
                 inline void unset(const tokenpos_t pos) noexcept {
-                        positions[pos].docSeq = 0;
+                        if (denseDoc) {
+                                positions[pos].docSeq = 0;
+                        } else {
+                                // there's no term 0, so the slot is kept, but won't match
+                                for (uint32_t i = pos & (SparseCapacity - 1);; i = (i + 1) & (SparseCapacity - 1)) {
+                                        auto &s = sparse[i];
+
+                                        if (s.docSeq != curSeq) {
+                                                return;
+                                        } else if (s.pos == pos) {
+                                                s.termID = 0;
+                                                return;
+                                        }
+                                }
+                        }
                 }
 
                 // We can probably just sort all phrase terms by freq asc
@@ -0,0 +1,572 @@
+#include "eliasfano_codec.h"
+#include <ansifmt.h>
+#include <memory>
+
+static_assert(sizeof(Trinity::Codecs::EliasFano::partition_header) == 20);
+
+#pragma mark bits
+
+static inline uint32_t bits_for(const uint32_t v) noexcept {
+        return v ? 32 - __builtin_clz(v) : 0;
+}
+
+static inline uint32_t words_for(const uint64_t bits) noexcept {
+        return (bits + 63) / 64;
+}
+
+// Number of high bits of an Elias-Fano sequence of n values in [0, u)
+static inline uint32_t ef_high_bits(const uint32_t n, const uint32_t u, const uint8_t l) noexcept {
+        return n + ((u - 1) >> l) + 1;
+}
+
+static inline uint64_t load_word(const uint8_t *const p, const uint32_t i) noexcept {
+        uint64_t w;
+
+        memcpy(&w, p + i * sizeof(uint64_t), sizeof(uint64_t));
+        return w;
+}
+
+// width <= 32; may read upto 7 bytes past the last bit(see CHUNK_PADDING)
+static inline uint32_t read_bits(const uint8_t *const p, const uint64_t bit, const uint8_t width) noexcept {
+        if (!width)
+                return 0;
+
+        uint64_t w;
+
+        memcpy(&w, p + (bit >> 3), sizeof(uint64_t));
+        return (w >> (bit & 7)) & ((uint64_t(1) << width) - 1);
+}
+
+// position of the first set bit at or after pos; it must exist
+static inline uint32_t next_set_bit(const uint8_t *const p, const uint32_t pos) noexcept {
+        auto i = pos / 64;
+        auto w = load_word(p, i) & (~uint64_t(0) << (pos & 63));
+
+        while (!w)
+                w = load_word(p, ++i);
+
+        return i * 64 + __builtin_ctzll(w);
+}
+
+// position of the n-th(1-based) unset bit; it must exist
+static inline uint32_t select_zero(const uint8_t *const p, uint32_t n) noexcept {
+        uint32_t i{0};
+
+        for (;; ++i) {
+                const auto zeros = 64 - __builtin_popcountll(load_word(p, i));
+
+                if (n <= zeros)
+                        break;
+
+                n -= zeros;
+        }
+
+        auto w = ~load_word(p, i);
+
+        while (--n)
+                w &= w - 1;
+
+        return i * 64 + __builtin_ctzll(w);
+}
+
+// number of set bits in [0, pos)
+static inline uint32_t rank(const uint8_t *const p, const uint32_t pos) noexcept {
+        const auto n = pos / 64;
+        uint32_t   res{0};
+
+        for (uint32_t i{0}; i != n; ++i)
+                res += __builtin_popcountll(load_word(p, i));
+
+        if (const auto r = pos & 63)
+                res += __builtin_popcountll(load_word(p, n) & ((uint64_t(1) << r) - 1));
+
+        return res;
+}
+
+static inline void write_bits(std::vector<uint64_t> *const out, const uint64_t bit, const uint64_t v, const uint8_t width) {
+        if (!width)
+                return;
+
+        const auto i = bit / 64;
+        const auto s = bit & 63;
+        auto &     words{*out};
+
+        words[i] |= v << s;
+        if (s + width > 64)
+                words[i + 1] |= v >> (64 - s);
+}
+
+static inline void reset_bits(std::vector<uint64_t> *const out, const uint64_t bits) {
+        // an extra word so that write_bits() won't need to check for overflows
+        out->assign(words_for(bits) + 1, 0);
+}
+
+#pragma mark ENCODER
+
+void Trinity::Codecs::EliasFano::Encoder::begin_term() {
+        auto out{&sess->indexOut};
+
+        curTermOffset          = out->size() + sess->indexOutFlushed;
+        lastCommitedDocID      = 0;
+        prevPartitionLastDocID = 0;
+        curPartitionSize       = 0;
+        termDocuments          = 0;
+        maxFreq                = 0;
+        partitionsData.clear();
+        hitsData.clear();
+        directory.clear();
+}
+
+void Trinity::Codecs::EliasFano::Encoder::begin_document(const isrc_docid_t documentID) {
+        require(documentID);
+        if (unlikely(documentID <= lastCommitedDocID)) {
+                Print("Unexpected documentID(", documentID, ") <= lastCommitedDocID(", lastCommitedDocID, ")\n");
+                std::abort();
+        }
+
+        if (!curPartitionSize) {
+                curPartitionHitsOffset = hitsData.size();
+                partitionMaxFreq       = 0;
+                partitionMinNorm       = UINT8_MAX;
+        }
+
+        curDocID       = documentID;
+        curFreq        = 0;
+        curNorm        = 0;
+        lastPos        = 0;
+        curPayloadSize = 0;
+}
+
+void Trinity::Codecs::EliasFano::Encoder::new_hit(const uint32_t pos, const range_base<const uint8_t *, const uint8_t> payload) {
+        const uint8_t payloadSize = payload.size();
+
+        if (!pos && !payloadSize) {
+                // this is perfectly valid
+                return;
+        }
+
+        Drequire(payload.size() <= sizeof(uint64_t));
+        Drequire(pos < Limits::MaxPosition);
+        Drequire(pos >= lastPos);
+
+        const uint32_t delta = pos - lastPos;
+
+        // same as Google's codec
+        if (payloadSize != curPayloadSize) {
+                hitsData.encode_varbyte32((delta << 1) | 1);
+                hitsData.pack(payloadSize);
+                curPayloadSize = payloadSize;
+        } else {
+                hitsData.encode_varbyte32(delta << 1);
+        }
+
+        if (payloadSize)
+                hitsData.serialize(payload.offset, payloadSize);
+
+        ++curFreq;
+        lastPos = pos;
+}
+
+void Trinity::Codecs::EliasFano::Encoder::end_document() {
+        documents[curPartitionSize] = curDocID;
+        freqs[curPartitionSize]     = curFreq;
+        partitionMaxFreq            = std::max(partitionMaxFreq, curFreq);
+        partitionMinNorm            = std::min(partitionMinNorm, curNorm);
+
+        if (++curPartitionSize == PARTITION_SIZE)
+                commit_partition();
+
+        lastCommitedDocID = curDocID;
+        ++termDocuments;
+}
+
+void Trinity::Codecs::EliasFano::Encoder::commit_partition() {
+        static constexpr bool trace{false};
+        const auto            n    = curPartitionSize;
+        const auto            base = prevPartitionLastDocID;
+        const auto            last = documents[n - 1];
+        // values are (document - base - 1), in [0, u)
+        const uint32_t   u = last - base;
+        const uint8_t    l = u > n ? bits_for(u / n) - 1 : 0;
+        const uint64_t   efBits{uint64_t(n) * l + words_for(ef_high_bits(n, u, l)) * 64};
+        const uint64_t   bitmapBits{uint64_t(words_for(u)) * 64};
+        partition_header ph;
+
+        ph.lastDocID  = last;
+        ph.dataOffset = partitionsData.size();
+        ph.hitsOffset = curPartitionHitsOffset;
+        ph.maxFreq    = partitionMaxFreq;
+        ph.minNorm    = partitionMinNorm;
+        ph.lowBits    = 0;
+        ph.freqBits   = bits_for(partitionMaxFreq);
+
+        if (u == n) {
+                ph.type = Type::Range;
+        } else if (bitmapBits <= efBits) {
+                ph.type = Type::Bitmap;
+
+                reset_bits(&bits, u);
+                for (uint32_t i{0}; i != n; ++i)
+                        write_bits(&bits, documents[i] - base - 1, 1, 1);
+
+                partitionsData.serialize(bits.data(), words_for(u) * sizeof(uint64_t));
+        } else {
+                const auto highBits = ef_high_bits(n, u, l);
+
+                ph.type    = Type::EF;
+                ph.lowBits = l;
+
+                reset_bits(&bits, uint64_t(n) * l);
+                for (uint32_t i{0}; i != n; ++i)
+                        write_bits(&bits, uint64_t(i) * l, (documents[i] - base - 1) & ((uint64_t(1) << l) - 1), l);
+                partitionsData.serialize(bits.data(), (uint64_t(n) * l + 7) / 8);
+
+                reset_bits(&bits, highBits);
+                for (uint32_t i{0}; i != n; ++i)
+                        write_bits(&bits, ((documents[i] - base - 1) >> l) + i, 1, 1);
+                partitionsData.serialize(bits.data(), words_for(highBits) * sizeof(uint64_t));
+        }
+
+        if (trace)
+                SLog("Partition (", base, ", ", last, "] n = ", n, ", u = ", u, ", type = ", unsigned(ph.type), ", l = ", l, ", freqBits = ", ph.freqBits, "\n");
+
+        reset_bits(&bits, uint64_t(n) * ph.freqBits);
+        for (uint32_t i{0}; i != n; ++i)
+                write_bits(&bits, uint64_t(i) * ph.freqBits, freqs[i], ph.freqBits);
+        partitionsData.serialize(bits.data(), (uint64_t(n) * ph.freqBits + 7) / 8);
+
+        directory.serialize(&ph, sizeof(ph));
+
+        maxFreq                = std::max(maxFreq, partitionMaxFreq);
+        prevPartitionLastDocID = last;
+        curPartitionSize       = 0;
+}
+
+void Trinity::Codecs::EliasFano::Encoder::end_term(term_index_ctx *tctx) {
+        auto out{&sess->indexOut};
+
+        if (curPartitionSize)
+                commit_partition();
+
+        if (termDocuments) {
+                const chunk_header h{uint32_t(sizeof(chunk_header) + directory.size() + partitionsData.size()), maxFreq};
+
+                out->serialize(&h, sizeof(h));
+                out->serialize(directory.data(), directory.size());
+                out->serialize(partitionsData.data(), partitionsData.size());
+                out->serialize(hitsData.data(), hitsData.size());
+                memset(out->RoomFor(CHUNK_PADDING), 0, CHUNK_PADDING);
+        }
+
+        tctx->indexChunk.Set(curTermOffset, (out->size() + sess->indexOutFlushed) - curTermOffset);
+        tctx->documents = termDocuments;
+}
+
+range32_t Trinity::Codecs::EliasFano::IndexSession::append_index_chunk(const Trinity::Codecs::AccessProxy *src_, const term_index_ctx srcTCTX) {
+        auto       src = static_cast<const Trinity::Codecs::EliasFano::AccessProxy *>(src_);
+        const auto o   = indexOut.size() + indexOutFlushed;
+
+        // chunks are relocatable; all offsets are relative to the chunk
+        indexOut.serialize(src->indexPtr + srcTCTX.indexChunk.offset, srcTCTX.indexChunk.size());
+        return {uint32_t(o), srcTCTX.indexChunk.size()};
+}
+
+void Trinity::Codecs::EliasFano::IndexSession::begin() {
+}
+
+void Trinity::Codecs::EliasFano::IndexSession::end() {
+}
+
+Trinity::Codecs::Encoder *Trinity::Codecs::EliasFano::IndexSession::new_encoder() {
+        return new Trinity::Codecs::EliasFano::Encoder(this);
+}
+
+#pragma mark DECODER
+
+void Trinity::Codecs::EliasFano::Decoder::init(const term_index_ctx &tctx, Trinity::Codecs::AccessProxy *access) {
+        indexTermCtx = tctx;
+
+        if (!tctx.indexChunk.size() || !tctx.documents) {
+                partitionsCnt = 0;
+                maxFreq       = 0;
+                return;
+        }
+
+        const auto p = access->indexPtr + tctx.indexChunk.offset;
+        const auto h = reinterpret_cast<const chunk_header *>(p);
+
+        partitions     = reinterpret_cast<const partition_header *>(p + sizeof(chunk_header));
+        partitionsCnt  = partitions_count(tctx.documents);
+        partitionsData = reinterpret_cast<const uint8_t *>(partitions + partitionsCnt);
+        hitsBase       = p + h->hitsOffset;
+        maxFreq        = h->maxFreq;
+}
+
+Trinity::Codecs::PostingsListIterator *Trinity::Codecs::EliasFano::Decoder::new_iterator() {
+        auto it = std::make_unique<Trinity::Codecs::EliasFano::PostingsListIterator>(this);
+
+        it->partition     = UINT32_MAX;
+        it->partitionSize = 0;
+        it->idx           = 0;
+        it->hitsPartition = UINT32_MAX;
+        it->hitsIdx       = 0;
+        it->hitsPtr       = nullptr;
+
+        if (!partitionsCnt)
+                finalize(it.get());
+
+        return it.release();
+}
+
+// First partition in [from, partitionsCnt) where lastDocID >= target, or partitionsCnt
+// Targets are usually close to the current partition, so we gallop before we binary search
+uint32_t Trinity::Codecs::EliasFano::Decoder::partition_search(uint32_t from, const isrc_docid_t target) const noexcept {
+        uint32_t hi{from};
+
+        for (uint32_t step{1}; hi < partitionsCnt && partitions[hi].lastDocID < target; step <<= 1) {
+                from = hi + 1;
+                hi += step;
+        }
+
+        if (hi > partitionsCnt)
+                hi = partitionsCnt;
+
+        while (from < hi) {
+                const auto m = (from + hi) / 2;
+
+                if (partitions[m].lastDocID < target)
+                        from = m + 1;
+                else
+                        hi = m;
+        }
+
+        return from;
+}
+
+void Trinity::Codecs::EliasFano::Decoder::enter_partition(PostingsListIterator *const it, const uint32_t i) {
+        const auto &ph   = partitions[i];
+        const auto  data = partitionsData + ph.dataOffset;
+        const auto  n    = i + 1 == partitionsCnt ? indexTermCtx.documents - i * PARTITION_SIZE : PARTITION_SIZE;
+        const auto  base = i ? partitions[i - 1].lastDocID : 0;
+        const auto  u    = ph.lastDocID - base;
+
+        it->partition          = i;
+        it->partitionSize      = n;
+        it->partitionBase      = base;
+        it->partitionLastDocID = ph.lastDocID;
+        it->type               = ph.type;
+        it->lowBits            = ph.lowBits;
+        it->freqBits           = ph.freqBits;
+        // not positioned yet
+        it->idx = UINT32_MAX;
+
+        switch (ph.type) {
+                case Type::EF:
+                        it->low   = data;
+                        it->high  = data + (uint64_t(n) * ph.lowBits + 7) / 8;
+                        it->freqs = it->high + words_for(ef_high_bits(n, u, ph.lowBits)) * sizeof(uint64_t);
+                        break;
+
+                case Type::Bitmap:
+                        it->high  = data;
+                        it->freqs = data + words_for(u) * sizeof(uint64_t);
+                        break;
+
+                case Type::Range:
+                        it->freqs = data;
+                        break;
+        }
+
+        decodedPostings += n;
+}
+
+// Positions the iterator to the first document in the current partition where (document - partitionBase - 1) >= value
+// There must be one, i.e the target document must be <= partitionLastDocID
+void Trinity::Codecs::EliasFano::Decoder::seek_partition(PostingsListIterator *const it, const uint32_t value) {
+        uint32_t idx, v;
+
+        switch (it->type) {
+                case Type::Range:
+                        idx = v = value;
+                        break;
+
+                case Type::Bitmap: {
+                        const auto pos = next_set_bit(it->high, value);
+
+                        idx        = rank(it->high, pos);
+                        v          = pos;
+                        it->bitPos = pos;
+                } break;
+
+                case Type::EF: {
+                        const auto l = it->lowBits;
+                        const auto h = value >> l;
+                        // the first document with high part >= h is the first one after the h-th bucket terminator(unset bit)
+                        uint32_t pos = h ? select_zero(it->high, h) + 1 : 0;
+
+                        idx = pos - h;
+                        if (it->idx != UINT32_MAX && idx <= it->idx) {
+                                // we are already past that; the current document is < value
+                                idx = it->idx + 1;
+                                pos = it->bitPos + 1;
+                        }
+
+                        for (;; ++idx, ++pos) {
+                                pos = next_set_bit(it->high, pos);
+                                v   = ((pos - idx) << l) | read_bits(it->low, uint64_t(idx) * l, l);
+
+                                if (v >= value)
+                                        break;
+                        }
+
+                        it->bitPos = pos;
+                } break;
+        }
+
+        it->idx            = idx;
+        it->curDocument.id = it->partitionBase + 1 + v;
+        it->freq           = read_bits(it->freqs, uint64_t(idx) * it->freqBits, it->freqBits);
+}
+
+void Trinity::Codecs::EliasFano::Decoder::next(PostingsListIterator *const it) {
+        if (it->idx + 1 >= it->partitionSize) {
+                // partition is UINT32_MAX before we enter the first partition
+                const auto p = it->partition + 1;
+
+                if (p >= partitionsCnt) {
+                        finalize(it);
+                } else {
+                        enter_partition(it, p);
+                        seek_partition(it, 0);
+                }
+                return;
+        }
+
+        const auto idx = ++(it->idx);
+        uint32_t   v;
+
+        switch (it->type) {
+                case Type::Range:
+                        v = idx;
+                        break;
+
+                case Type::Bitmap:
+                        it->bitPos = next_set_bit(it->high, it->bitPos + 1);
+                        v          = it->bitPos;
+                        break;
+
+                case Type::EF:
+                        it->bitPos = next_set_bit(it->high, it->bitPos + 1);
+                        v          = ((it->bitPos - idx) << it->lowBits) | read_bits(it->low, uint64_t(idx) * it->lowBits, it->lowBits);
+                        break;
+        }
+
+        it->curDocument.id = it->partitionBase + 1 + v;
+        it->freq           = read_bits(it->freqs, uint64_t(idx) * it->freqBits, it->freqBits);
+}
+
+void Trinity::Codecs::EliasFano::Decoder::advance(PostingsListIterator *const it, const isrc_docid_t target) {
+        static constexpr bool trace{false};
+
+        if (trace)
+                SLog(ansifmt::bold, ansifmt::color_green, "SKIPPING to ", target, ansifmt::reset, ", currently at ", it->curDocument.id, ", partition = ", it->partition, "\n");
+
+        if (target <= it->curDocument.id) {
+                // also if we have exhausted the postings list
+                return;
+        }
+
+        if (it->partition == UINT32_MAX || target > it->partitionLastDocID) {
+                const auto p = partition_search(it->partition == UINT32_MAX ? 0 : it->partition + 1, target);
+
+                if (p == partitionsCnt) {
+                        finalize(it);
+                        return;
+                }
+
+                enter_partition(it, p);
+        }
+
+        seek_partition(it, target - it->partitionBase - 1);
+}
+
+Trinity::isrc_docid_t Trinity::Codecs::EliasFano::Decoder::block_bound(PostingsListIterator *const it, const isrc_docid_t target, block_impact *const impact) {
+        // targets are almost always increasing, but not necessarily so
+        const auto from = it->partition < partitionsCnt && target > it->partitionBase ? it->partition : 0;
+        const auto p    = partition_search(from, target);
+
+        if (p == partitionsCnt) {
+                // no documents past target
+                impact->maxFreq = 0;
+                impact->minNorm = UINT8_MAX;
+                return DocIDsEND;
+        }
+
+        impact->maxFreq = partitions[p].maxFreq;
+        impact->minNorm = partitions[p].minNorm;
+        return partitions[p].lastDocID;
+}
+
+void Trinity::Codecs::EliasFano::Decoder::materialize_hits(PostingsListIterator *const it, DocWordsSpace *const dwspace, term_hit *const out) {
+        const auto termID{execCtxTermID};
+        const auto idx{it->idx};
+        uint8_t    payloadSize{0};
+        uint64_t   payload{0};
+        auto *const bytes = reinterpret_cast<uint8_t *>(&payload);
+        tokenpos_t pos{0};
+        uint32_t   step;
+
+        if (it->hitsPartition != it->partition || it->hitsIdx > idx) {
+                it->hitsPartition = it->partition;
+                it->hitsIdx       = 0;
+                it->hitsPtr       = hitsBase + partitions[it->partition].hitsOffset;
+        }
+
+        auto p{it->hitsPtr};
+
+        // skip hits of documents we didn't materialize hits for
+        for (auto i = it->hitsIdx; i != idx; ++i) {
+                for (auto n = read_bits(it->freqs, uint64_t(i) * it->freqBits, it->freqBits); n; --n) {
+                        varbyte_get32(p, step);
+
+                        if (step & 1)
+                                payloadSize = *p++;
+
+                        p += payloadSize;
+                }
+
+                payloadSize = 0;
+        }
+
+        for (tokenpos_t i{0}; i != it->freq; ++i) {
+                varbyte_get32(p, step);
+
+                if (step & 1) {
+                        payloadSize = *p++;
+                        DEXPECT(payloadSize <= sizeof(uint64_t));
+                }
+
+                pos += step >> 1;
+
+                if (payloadSize) {
+                        memcpy(bytes, p, payloadSize);
+                        p += payloadSize;
+                } else
+                        payload = 0;
+
+                if (pos)
+                        dwspace->set(termID, pos);
+
+                out[i] = {payload, pos, payloadSize};
+        }
+
+        it->hitsPtr = p;
+        it->hitsIdx = idx + 1;
+}
+
+Trinity::Codecs::Decoder *Trinity::Codecs::EliasFano::AccessProxy::new_decoder(const term_index_ctx &tctx) {
+        auto d = std::make_unique<Trinity::Codecs::EliasFano::Decoder>();
+
+        d->init(tctx, this);
+        return d.release();
+}
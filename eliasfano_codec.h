@@ -0,0 +1,237 @@
+// A codec based on partitioned Elias-Fano, see "Partitioned Elias-Fano Indexes"(Ottaviano, Venturini)
+// Postings lists are split into fixed-size partitions; each partition is encoded as an Elias-Fano sequence, or as a bitmap if
+// that is smaller(or not at all if it is a dense range of documents), relative to the last document ID of the previous partition.
+//
+// Partitions can be accessed directly, and Elias-Fano sequences support next-greater-or-equal lookups without
+// decoding anything else but the element we land on, so advance() is cheap and no skiplist is needed.
+// Frequencies are bit-packed so that they too can be accessed directly, and hits are stored in a separate stream in the term's index chunk,
+// accessed only if materialize_hits() is invoked.
+#pragma once
+#include "codecs.h"
+
+#define TRINITY_CODECS_ELIASFANO_AVAILABLE 1
+
+static_assert(sizeof(Trinity::isrc_docid_t) <= sizeof(uint32_t));
+
+namespace Trinity {
+        namespace Codecs {
+                namespace EliasFano {
+                        static constexpr size_t PARTITION_SIZE{128};
+
+                        // Index chunk layout:
+                        // chunk_header, chunk_header::partitions(see partitions_count()) partition_header, partitions data, hits, padding
+                        //
+                        // Partition data(n documents, universe u, see partition_header):
+                        // Type::EF:     n * l low bits, (n + ((u - 1) >> l) + 1) high bits(in 64bit words), n * freqBits freqs
+                        // Type::Bitmap: u bits(in 64bit words), n * freqBits freqs
+                        // Type::Range:  n * freqBits freqs
+                        struct chunk_header final {
+                                // relative to the chunk
+                                uint32_t hitsOffset;
+                                uint32_t maxFreq;
+                        };
+
+                        enum class Type : uint8_t {
+                                EF = 0,
+                                Bitmap,
+                                // all documents in (previous partition lastDocID, lastDocID]
+                                Range
+                        };
+
+                        struct partition_header final {
+                                isrc_docid_t lastDocID;
+                                // relative to the partitions data
+                                uint32_t dataOffset;
+                                // relative to the hits
+                                uint32_t hitsOffset;
+                                uint32_t maxFreq;
+                                uint8_t  minNorm;
+                                Type     type;
+                                // for Type::EF
+                                uint8_t lowBits;
+                                uint8_t freqBits;
+                        };
+
+                        // We may read up to that many bytes past the last bit of a bit-packed sequence
+                        static constexpr size_t CHUNK_PADDING{sizeof(uint64_t)};
+
+                        constexpr uint32_t partitions_count(const uint32_t documents) noexcept {
+                                return (documents + PARTITION_SIZE - 1) / PARTITION_SIZE;
+                        }
+
+                        struct IndexSession final
+                            : public Trinity::Codecs::IndexSession {
+                                void begin() override final;
+
+                                void end() override final;
+
+                                Trinity::Codecs::Encoder *new_encoder() override final;
+
+                                IndexSession(const char *bp)
+                                    : Trinity::Codecs::IndexSession{bp, unsigned(Capabilities::AppendIndexChunk)} {
+                                }
+
+                                strwlen8_t codec_identifier() override final {
+                                        return "ELIASFANO"_s8;
+                                }
+
+                                range32_t append_index_chunk(const Trinity::Codecs::AccessProxy *, const term_index_ctx srcTCTX) override final;
+                        };
+
+                        class Encoder final
+                            : public Trinity::Codecs::Encoder {
+                              private:
+                                IOBuffer                  partitionsData, hitsData, directory;
+                                std::vector<uint64_t>     bits;
+                                isrc_docid_t              curDocID, lastCommitedDocID, prevPartitionLastDocID;
+                                isrc_docid_t              documents[PARTITION_SIZE];
+                                uint32_t                  freqs[PARTITION_SIZE];
+                                uint32_t                  curPartitionSize, curPartitionHitsOffset;
+                                uint32_t                  curFreq, lastPos;
+                                uint32_t                  partitionMaxFreq, maxFreq;
+                                uint8_t                   curPayloadSize, curNorm, partitionMinNorm;
+                                uint32_t                  curTermOffset;
+                                uint32_t                  termDocuments;
+
+                              private:
+                                void commit_partition();
+
+                              public:
+                                Encoder(Trinity::Codecs::IndexSession *s)
+                                    : Trinity::Codecs::Encoder{s} {
+                                }
+
+                                void begin_term() override final;
+
+                                void begin_document(const isrc_docid_t documentID) override final;
+
+                                void new_hit(const uint32_t pos, const range_base<const uint8_t *, const uint8_t> payload) override final;
+
+                                void document_norm(const uint8_t norm) override final {
+                                        curNorm = norm;
+                                }
+
+                                void end_document() override final;
+
+                                void end_term(term_index_ctx *tctx) override final;
+                        };
+
+                        struct AccessProxy final
+                            : public Trinity::Codecs::AccessProxy {
+                                AccessProxy(const char *bp, const uint8_t *p)
+                                    : Trinity::Codecs::AccessProxy{bp, p} {
+                                }
+
+                                strwlen8_t codec_identifier() override final {
+                                        return "ELIASFANO"_s8;
+                                }
+
+                                Trinity::Codecs::Decoder *new_decoder(const term_index_ctx &tctx) override final;
+                        };
+
+                        class Decoder;
+
+                        struct PostingsListIterator final
+                            : public Trinity::Codecs::PostingsListIterator {
+                                friend class Decoder;
+
+                              private:
+                                // UINT32_MAX until we enter the first partition
+                                uint32_t       partition;
+                                uint32_t       partitionSize;
+                                isrc_docid_t   partitionBase, partitionLastDocID;
+                                Type           type;
+                                uint8_t        lowBits, freqBits;
+                                const uint8_t *low, *high, *freqs;
+                                // index of the current document in the partition
+                                uint32_t idx;
+                                // Type::EF: position of the current document's bit in high bits
+                                // Type::Bitmap: position of the current document's bit
+                                uint32_t bitPos;
+
+                                // hits are decoded lazily, so we track where we are in the hits stream
+                                uint32_t       hitsPartition;
+                                uint32_t       hitsIdx;
+                                const uint8_t *hitsPtr;
+
+                              public:
+                                inline isrc_docid_t next() override final;
+
+                                inline isrc_docid_t advance(const isrc_docid_t) override final;
+
+                                inline void materialize_hits(DocWordsSpace *dwspace, term_hit *out) override final;
+
+                                inline isrc_docid_t block_bound(const isrc_docid_t target, block_impact *const impact) override final;
+
+                                inline uint32_t max_freq_bound() override final;
+
+                                PostingsListIterator(Decoder *const d)
+                                    : Trinity::Codecs::PostingsListIterator{reinterpret_cast<Trinity::Codecs::Decoder *>(d)} {
+                                }
+                        };
+
+                        class Decoder final
+                            : public Trinity::Codecs::Decoder {
+                                friend struct PostingsListIterator;
+
+                              private:
+                                const partition_header *partitions;
+                                uint32_t                partitionsCnt;
+                                const uint8_t *         partitionsData;
+                                const uint8_t *         hitsBase;
+                                uint32_t                maxFreq;
+
+                              protected:
+                                void next(PostingsListIterator *);
+
+                                void advance(PostingsListIterator *, const isrc_docid_t);
+
+                                void materialize_hits(PostingsListIterator *, DocWordsSpace *, term_hit *);
+
+                                isrc_docid_t block_bound(PostingsListIterator *, const isrc_docid_t, block_impact *);
+
+                              private:
+                                uint32_t partition_search(uint32_t from, const isrc_docid_t target) const noexcept;
+
+                                void enter_partition(PostingsListIterator *, const uint32_t);
+
+                                void seek_partition(PostingsListIterator *, const uint32_t value);
+
+                                void finalize(PostingsListIterator *const it) {
+                                        it->partition          = partitionsCnt;
+                                        it->partitionSize      = 0;
+                                        it->partitionLastDocID = DocIDsEND;
+                                        it->curDocument.id     = DocIDsEND;
+                                        it->freq               = 0;
+                                }
+
+                              public:
+                                void init(const term_index_ctx &tctx, Trinity::Codecs::AccessProxy *access) override final;
+
+                                Trinity::Codecs::PostingsListIterator *new_iterator() override final;
+                        };
+
+                        isrc_docid_t PostingsListIterator::next() {
+                                static_cast<Codecs::EliasFano::Decoder *>(dec)->next(this);
+                                return curDocument.id;
+                        }
+
+                        isrc_docid_t PostingsListIterator::advance(const isrc_docid_t target) {
+                                static_cast<Codecs::EliasFano::Decoder *>(dec)->advance(this, target);
+                                return curDocument.id;
+                        }
+
+                        void PostingsListIterator::materialize_hits(DocWordsSpace *dwspace, term_hit *out) {
+                                static_cast<Codecs::EliasFano::Decoder *>(dec)->materialize_hits(this, dwspace, out);
+                        }
+
+                        isrc_docid_t PostingsListIterator::block_bound(const isrc_docid_t target, block_impact *const impact) {
+                                return static_cast<Codecs::EliasFano::Decoder *>(dec)->block_bound(this, target, impact);
+                        }
+
+                        uint32_t PostingsListIterator::max_freq_bound() {
+                                return static_cast<Codecs::EliasFano::Decoder *>(dec)->maxFreq;
+                        }
+                } // namespace EliasFano
+        }         // namespace Codecs
+} // namespace Trinity
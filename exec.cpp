@@ -3,10 +3,14 @@
 #include "docwordspace.h"
 #include "matches.h"
 #include "queryexec_ctx.h"
+#include "shared_postings.h"
 #include "similarity.h"
+#include "terms.h"
 #include <prioqueue.h>
+#include <switch_hash.h>
 
 #include <memory>
+#include <optional>
 
 using namespace Trinity;
 thread_local Trinity::queryexec_ctx *curRCTX;
@@ -250,6 +254,67 @@ static bool  all_pli(const std::vector<DocsSetIterators::Iterator *> &its) noexc
 
 void PrintImpl(Buffer &b, const exec_node &n); // compilation_ctx.cpp
 
+// When only the matching documents are needed, a disjunction of tokens expansions(see phrase::expansion) with that many terms or more
+// is materialized as a bitmap of all their documents(see union_terms()), instead of iterating all their postings lists in tandem, which is
+// expensive for the very large disjunctions expansions produce.
+// Other disjunctions are not, because e.g in [rare AND (t1 OR .. t40)] advance()ing the disjunction is far cheaper than decoding all its postings.
+static constexpr size_t DocumentsOnlyTermsUnionThreshold{32};
+
+static bool union_expanded_terms(const queryexec_ctx *const rctx, const compilation_ctx::termsrun *const run) {
+        size_t n{0};
+
+        if (run->size < DocumentsOnlyTermsUnionThreshold) {
+                return false;
+        }
+
+        for (size_t i{0}; i != run->size; ++i) {
+                if (const auto id = run->terms[i]; id < rctx->expansionTerms.size() && rctx->expansionTerms[id]) {
+                        ++n;
+                }
+        }
+
+        return n >= DocumentsOnlyTermsUnionThreshold;
+}
+
+// Only the documents in rctx->docIDsRange are decoded, and if the execution has a budget, we stop once it's exhausted
+static DocsSetIterators::Iterator *union_terms(queryexec_ctx *const rctx, const compilation_ctx::termsrun *const run) {
+        const auto                range  = rctx->docIDsRange;
+        auto *const               budget = rctx->budget;
+        const isrc_docid_t        base   = range.first <= 1 ? 0 : range.first;
+        std::vector<uint64_t>     bitmap;
+        std::vector<isrc_docid_t> ids;
+        uint64_t                  decoded{0};
+        bool                      exhausted{false};
+
+        for (size_t i{0}; i != run->size && !exhausted; ++i) {
+                std::unique_ptr<Codecs::PostingsListIterator> it(rctx->decode_ctx.decoders[run->terms[i]]->new_iterator());
+
+                for (auto id = range.first <= 1 ? it->next() : it->advance(range.first); id < range.last; id = it->next()) {
+                        const auto w = (id - base) / 64;
+
+                        if (w >= bitmap.size()) {
+                                bitmap.resize(std::max<size_t>(w + 1, bitmap.size() * 2), 0);
+                        }
+                        bitmap[w] |= uint64_t(1) << ((id - base) & 63);
+
+                        // the decoded postings are accounted for by budget_tracker, once the span is processed
+                        if (budget && !(++decoded & 4095) && (budget->consume(0, 0) || (budget->maxPostings && budget->postings.load(std::memory_order_relaxed) + decoded >= budget->maxPostings))) {
+                                budget->truncated.store(true, std::memory_order_relaxed);
+                                exhausted = true;
+                                break;
+                        }
+                }
+        }
+
+        for (size_t w{0}; w != bitmap.size(); ++w) {
+                for (auto b = bitmap[w]; b; b &= b - 1) {
+                        ids.emplace_back(base + w * 64 + __builtin_ctzll(b));
+                }
+        }
+
+        return new DocsSetIterators::VectorIDs(std::move(ids));
+}
+
 DocsSetIterators::Iterator *queryexec_ctx::build_iterator(const exec_node n, const uint32_t execFlags) {
         if (n.fp == ENT::matchallterms) {
                 const auto                  run = static_cast<const compilation_ctx::termsrun *>(n.ptr);
@@ -264,6 +329,11 @@ DocsSetIterators::Iterator *queryexec_ctx::build_iterator(const exec_node n, con
                 return reg_docset_it(new DocsSetIterators::Conjuction(decoders, run->size));
         } else if (n.fp == ENT::matchanyterms) {
                 const auto                  run = static_cast<const compilation_ctx::termsrun *>(n.ptr);
+
+                if (documentsOnly && union_expanded_terms(this, run)) {
+                        return reg_docset_it(union_terms(this, run));
+                }
+
                 DocsSetIterators::Iterator *decoders[run->size];
 
                 for (size_t i{0}; i != run->size; ++i) {
@@ -294,7 +364,7 @@ DocsSetIterators::Iterator *queryexec_ctx::build_iterator(const exec_node n, con
                         its[i] = reg_pli(decode_ctx.decoders[p->termIDs[i]]->new_iterator());
                 }
 
-                return reg_docset_it(new DocsSetIterators::Phrase(this, its, p->size, execFlags & unsigned(ExecFlags::AccumulatedScoreScheme), execFlags &unsigned(ExecFlags::DocumentsOnly)));
+                return reg_docset_it(new DocsSetIterators::Phrase(this, its, p->size, p->slop, execFlags & unsigned(ExecFlags::AccumulatedScoreScheme), execFlags &unsigned(ExecFlags::DocumentsOnly)));
         } else if (n.fp == ENT::matchanyphrases) {
                 const auto                  run = static_cast<const compilation_ctx::phrasesrun *>(n.ptr);
                 DocsSetIterators::Iterator *its[run->size];
@@ -306,7 +376,7 @@ DocsSetIterators::Iterator *queryexec_ctx::build_iterator(const exec_node n, con
                         for (size_t i{0}; i != p->size; ++i)
                                 tits[i] = reg_pli(decode_ctx.decoders[p->termIDs[i]]->new_iterator());
 
-                        its[pit] = reg_docset_it(new DocsSetIterators::Phrase(this, tits, p->size, execFlags & unsigned(ExecFlags::AccumulatedScoreScheme), execFlags &unsigned(ExecFlags::DocumentsOnly)));
+                        its[pit] = reg_docset_it(new DocsSetIterators::Phrase(this, tits, p->size, p->slop, execFlags & unsigned(ExecFlags::AccumulatedScoreScheme), execFlags &unsigned(ExecFlags::DocumentsOnly)));
                 }
 
                 return reg_docset_it(new DocsSetIterators::Disjunction(its, run->size));
@@ -321,7 +391,7 @@ DocsSetIterators::Iterator *queryexec_ctx::build_iterator(const exec_node n, con
                         for (size_t i{0}; i != p->size; ++i)
                                 tits[i] = reg_pli(decode_ctx.decoders[p->termIDs[i]]->new_iterator());
 
-                        its[pit] = reg_docset_it(new DocsSetIterators::Phrase(this, tits, p->size, execFlags & unsigned(ExecFlags::AccumulatedScoreScheme), execFlags &unsigned(ExecFlags::DocumentsOnly)));
+                        its[pit] = reg_docset_it(new DocsSetIterators::Phrase(this, tits, p->size, p->slop, execFlags & unsigned(ExecFlags::AccumulatedScoreScheme), execFlags &unsigned(ExecFlags::DocumentsOnly)));
                 }
 
                 return reg_docset_it(new DocsSetIterators::Conjuction(its, run->size));
@@ -450,13 +520,29 @@ DocsSetIterators::Iterator *queryexec_ctx::build_iterator(const exec_node n, con
 
 #pragma mark                        docsset spans builder
 static std::unique_ptr<DocsSetSpan> build_span(DocsSetIterators::Iterator *root, queryexec_ctx *const rctx) {
-        if (root->type == DocsSetIterators::Type::DisjunctionSome && (rctx->documentsOnly || rctx->accumScoreMode)) {
+        if (rctx->accumScoreMode && rctx->dynamicPruning && (root->type == DocsSetIterators::Type::DisjunctionAllPLI || root->type == DocsSetIterators::Type::PostingsListIterator)) {
+                // Block-Max WAND; see ExecFlags::AccumulatedScoreTopK
+                std::vector<Codecs::PostingsListIterator *> its;
+
+                if (root->type == DocsSetIterators::Type::DisjunctionAllPLI) {
+                        for (auto containerIt : static_cast<DocsSetIterators::DisjunctionAllPLI *>(root)->pq)
+                                its.emplace_back(static_cast<Codecs::PostingsListIterator *>(containerIt));
+                } else
+                        its.emplace_back(static_cast<Codecs::PostingsListIterator *>(root));
+
+                return std::make_unique<DocsSetSpanForDisjunctionsWithBlockMax>(its);
+        } else if (root->type == DocsSetIterators::Type::DisjunctionSome && (rctx->documentsOnly || rctx->accumScoreMode)) {
                 auto                                               d = static_cast<DocsSetIterators::DisjunctionSome *>(root);
                 std::vector<Trinity::DocsSetIterators::Iterator *> its;
 
                 for (auto it{d->lead}; it; it = it->next)
                         its.emplace_back(it->it);
 
+                if (rctx->accumScoreMode && rctx->dynamicPruning) {
+                        // MaxScore; see ExecFlags::AccumulatedScoreTopK
+                        return std::make_unique<DocsSetSpanForDisjunctionsWithMaxScore>(d->matchThreshold, its);
+                }
+
                 // Either DocsSetSpanForDisjunctionsWithThresholdAndCost or DocsSetSpanForDisjunctionsWithThreshold
                 // take the same time if we are dealing with iterators that are just PostingsListIterator
                 // though if we have phrases and other complex binary ops, cost makes more sense, so we 'll settle for
@@ -481,7 +567,9 @@ static std::unique_ptr<DocsSetSpan> build_span(DocsSetIterators::Iterator *root,
                                 std::abort();
                 }
 
-                if (rctx->accumScoreMode)
+                if (rctx->accumScoreMode && rctx->dynamicPruning)
+                        return std::make_unique<DocsSetSpanForDisjunctionsWithMaxScore>(1, its);
+                else if (rctx->accumScoreMode)
                         return std::make_unique<DocsSetSpanForDisjunctionsWithThreshold>(1, its, true);
                 else
                         return std::make_unique<DocsSetSpanForDisjunctions>(its);
@@ -504,21 +592,224 @@ static std::unique_ptr<DocsSetSpan> build_span(DocsSetIterators::Iterator *root,
         }
 }
 
+// First document of a newly created iterator in docIDsRange, or a document >= docIDsRange.last
+// We only advance() if we have to; next() is cheaper for the common (whole range) case
+template <typename T>
+static inline isrc_docid_t first_document(T *const it, const isrc_docid_t docIDsRangeFirst) {
+        return docIDsRangeFirst <= 1 ? it->next() : it->advance(docIDsRangeFirst);
+}
+
+#pragma mark exec_budget support
+// Tracks the work done by an execution, and accounts for it in its exec_budget
+struct budget_tracker final {
+        exec_budget *const         budget;
+        const queryexec_ctx *const rctx;
+        uint64_t                   documents{0}; // since the last check()
+        uint64_t                   postings{0};  // accounted for so far
+
+        budget_tracker(exec_budget *const b, const queryexec_ctx *const r)
+            : budget{b}, rctx{r} {
+        }
+
+        // Returns false if the budget has been exhausted
+        bool check() {
+                const auto &decoders = rctx->decode_ctx;
+                uint64_t    total{0};
+
+                for (size_t i{0}; i != decoders.capacity; ++i) {
+                        if (const auto dec = decoders.decoders[i]) {
+                                total += dec->decodedPostings;
+                        }
+                }
+
+                const auto docs = documents;
+
+                documents = 0;
+                std::swap(total, postings);
+                return !budget->consume(docs, postings - total);
+        }
+};
+
+// Counts the documents processed by a span for a budget_tracker
+template <typename H>
+struct budget_proxy final
+    : public MatchesProxy {
+        H *const        handler;
+        uint64_t *const documents;
+
+        budget_proxy(H *const h, uint64_t *const d)
+            : handler{h}, documents{d} {
+        }
+
+        void process(relevant_document_provider *const rdp) override final {
+                ++(*documents);
+                handler->process(rdp);
+        }
+
+        double min_competitive_score() override final {
+                return handler->min_competitive_score();
+        }
+};
+
+// If there's no budget, the whole range is processed at once. Otherwise, it is processed
+// in windows of exec_budget::WindowSize documents IDs, and we check the budget after each window.
+// Spans process [min, max) and return the next document they may match, so that we can skip empty windows.
+template <typename H>
+static void process_span(DocsSetSpan *const span, H *const handler, const isrc_docids_range range, budget_tracker *const tracker) {
+        if (!tracker) {
+                span->process(handler, range.first, range.last);
+                return;
+        }
+
+        budget_proxy<H> proxy(handler, &tracker->documents);
+
+        for (auto next = range.first; next < range.last;) {
+                const auto windowEnd = range.last - next > exec_budget::WindowSize ? next + exec_budget::WindowSize : range.last;
+
+                next = std::max(span->process(&proxy, next, windowEnd), windowEnd);
+                if (!tracker->check()) {
+                        if constexpr (traceExec)
+                                SLog("Budget exhausted at ", next, "\n");
+
+                        break;
+                }
+        }
+}
+
 #pragma mark Trinity Queries Execution Engine
 
-void Trinity::exec_query(const query &in,
-                         IndexSource *const __restrict__ idxsrc,
-                         masked_documents_registry *const __restrict__ maskedDocumentsRegistry,
-                         MatchedIndexDocumentsFilter *__restrict__ const matchesFilter,
-                         IndexDocumentsFilter *__restrict__ const documentsFilter,
-                         const uint32_t                      execFlags,
-                         Similarity::IndexSourceTermsScorer *scorer) {
-        struct query_term_instance final
-            : public query_term_ctx::instance_struct {
-                str8_t token;
+// Exactly one of (in, plan) is set
+// If plan is set, we don't need to normalize and compile the query; we only need to resolve its terms and instantiate it
+#pragma mark                        tokens expansion
+// Replaces tokens to be expanded(see phrase::expansion) with a disjunction of the terms of the index source that match them
+// or with a ConstFalse node if there are no such terms. If there are more than Limits::MaxTermExpansions such terms, those with the
+// highest documents frequency are selected.
+//
+// The expanded tokens inherit the properties of the original token(index, flags, etc), so that to the
+// execution engine and the MatchedIndexDocumentsFilter, they are equivalent to the original token.
+// The terms the tokens were expanded to are appended to expanded
+static void expand_tokens(query &q, IndexSource *const idxsrc, std::vector<str8_t> *const expanded) {
+        struct candidate final {
+                uint32_t documents;
+                str8_t   term;
+
+                bool operator<(const candidate &o) const noexcept {
+                        // for the min-heap
+                        return documents > o.documents;
+                }
+        };
+        std::vector<candidate> candidates;
+        const auto             consider = [&](const str8_t term, const term_index_ctx &tctx) {
+                if (!tctx.documents) {
+                        return;
+                } else if (candidates.size() == Limits::MaxTermExpansions) {
+                        if (tctx.documents <= candidates.front().documents) {
+                                return;
+                        }
+
+                        std::pop_heap(candidates.begin(), candidates.end());
+                        candidates.pop_back();
+                }
+
+                candidates.push_back({tctx.documents, {q.allocator.CopyOf(term.data(), term.size()), term.size()}});
+                std::push_heap(candidates.begin(), candidates.end());
         };
 
-        if (!in) {
+        for (auto n : q.nodes()) {
+                if (n->type != ast_node::Type::Token || n->p->expansion == TermExpansion::None) {
+                        continue;
+                }
+
+                const auto pattern = n->p->terms[0].token;
+
+                candidates.clear();
+                if (n->p->expansion == TermExpansion::Wildcard) {
+                        std::unique_ptr<IndexSourceTermsView> view(idxsrc->new_terms_view(wildcard_literal_prefix(pattern)));
+
+                        if (view) {
+                                for (; !view->done(); view->next()) {
+                                        const auto cur = view->cur();
+
+                                        if (wildcard_match(pattern, cur.first)) {
+                                                consider(cur.first, cur.second);
+                                        }
+                                }
+                        }
+                } else {
+                        // fuzzy; the view seeks past the terms that begin with any prefix the automaton rejects
+                        std::unique_ptr<IndexSourceTermsView> view(idxsrc->new_terms_view({pattern.data(), uint8_t(0)}));
+
+                        if (view) {
+                                levenshtein_automaton a(pattern, n->p->expansion == TermExpansion::FuzzyOneEdit ? 1 : 2);
+
+                                fuzzy_match_terms(a, view.get(), [&](const str8_t term, const term_index_ctx &tctx, const uint8_t) {
+                                        consider(term, tctx);
+                                });
+                        }
+                }
+
+                if (candidates.empty()) {
+                        n->set_const_false();
+                        continue;
+                }
+
+                std::sort(candidates.begin(), candidates.end(), [](const auto &a, const auto &b) noexcept {
+                        return terms_cmp(a.term.data(), a.term.size(), b.term.data(), b.term.size()) < 0;
+                });
+                for (const auto &c : candidates) {
+                        expanded->emplace_back(c.term);
+                }
+
+                const auto src  = n->p;
+                const auto make = [&](const auto &self, const candidate *const b, const candidate *const e) -> ast_node * {
+                        if (e - b == 1) {
+                                auto node = ast_node::make(q.allocator, ast_node::Type::Token);
+                                auto p    = static_cast<phrase *>(q.allocator.Alloc(sizeof(phrase) + sizeof(term)));
+
+                                // see ast_node::copy()
+                                p->size                               = 1;
+                                p->rep                                = src->rep;
+                                p->slop                               = src->slop;
+                                p->expansion                          = TermExpansion::None;
+                                p->index                              = src->index;
+                                p->app_phrase_id                      = src->app_phrase_id;
+                                p->toNextSpan                         = src->toNextSpan;
+                                p->flags                              = src->flags;
+                                p->inputRange                         = src->inputRange;
+                                p->rewrite_ctx.range                  = src->rewrite_ctx.range;
+                                p->rewrite_ctx.srcSeqSize             = src->rewrite_ctx.srcSeqSize;
+                                p->rewrite_ctx.translationCoefficient = src->rewrite_ctx.translationCoefficient;
+                                p->terms[0].token                     = b->term;
+                                p->terms[0].u32                       = src->terms[0].u32;
+                                node->p                               = p;
+                                return node;
+                        }
+
+                        // balanced, so that we won't recurse too deep when compiling
+                        const auto mid  = b + (e - b) / 2;
+                        auto       node = ast_node::make(q.allocator, ast_node::Type::BinOp);
+
+                        node->binop.op  = Operator::OR;
+                        node->binop.lhs = self(self, b, mid);
+                        node->binop.rhs = self(self, mid, e);
+                        return node;
+                };
+
+                *n = *make(make, candidates.data(), candidates.data() + candidates.size());
+        }
+}
+
+static void exec_query_impl(const query *const                  in,
+                            const compiled_query_plan *const    plan,
+                            IndexSource *const __restrict__ idxsrc,
+                            masked_documents_registry *const __restrict__ maskedDocumentsRegistry,
+                            MatchedIndexDocumentsFilter *__restrict__ const matchesFilter,
+                            IndexDocumentsFilter *__restrict__ const documentsFilter,
+                            const uint32_t                      execFlags,
+                            Similarity::IndexSourceTermsScorer *scorer,
+                            const isrc_docids_range             docIDsRange,
+                            exec_budget *const                  budget) {
+        if (plan ? !*plan : !*in) {
                 if constexpr (traceCompile)
                         SLog("No root node\n");
 
@@ -528,16 +819,26 @@ void Trinity::exec_query(const query &in,
         // We need a copy of that query here
         // for we we will need to modify it
         const auto _start = Timings::Microseconds::Tick();
-        query      q(in, true); // shallow copy, no need for a deep copy here
+        std::optional<query> q;
+        std::vector<str8_t>  expandedTerms;
 
-        // Normalize just in case
-        if (!q.normalize()) {
-                if constexpr (traceCompile)
-                        SLog("No root node after normalization\n");
+        if (!plan) {
+                q.emplace(*in, true); // shallow copy, no need for a deep copy here
 
-                return;
+                // tokens expansions are specific to the index source
+                expand_tokens(*q, idxsrc, &expandedTerms);
+
+                // Normalize just in case
+                if (!q->normalize()) {
+                        if constexpr (traceCompile)
+                                SLog("No root node after normalization\n");
+
+                        return;
+                }
         }
 
+        const auto finalIndex = plan ? plan->final_index() : q->final_index();
+
         const bool documentsOnly  = execFlags & uint32_t(ExecFlags::DocumentsOnly);
         const bool accumScoreMode = execFlags & uint32_t(ExecFlags::AccumulatedScoreScheme);
         const bool defaultMode    = !documentsOnly && !accumScoreMode;
@@ -558,7 +859,22 @@ void Trinity::exec_query(const query &in,
         }
 
 
+        if (budget && budget->consume(0, 0)) {
+                // i.e a budget shared with other executions that has been exhausted already
+                if constexpr (traceExec)
+                        SLog("Budget exhausted, will not execute\n");
+
+                return;
+        }
+
         queryexec_ctx rctx(idxsrc, documentsOnly, accumScoreMode);
+        budget_tracker budgetTrackerStorage(budget, &rctx);
+        auto *const    budgetTracker = budget ? &budgetTrackerStorage : nullptr;
+
+        rctx.dynamicPruning = accumScoreMode && (execFlags & uint32_t(ExecFlags::AccumulatedScoreTopK));
+        rctx.payloads       = !(execFlags & uint32_t(ExecFlags::DisregardPayloads));
+        rctx.docIDsRange    = docIDsRange;
+        rctx.budget         = budget;
 
         struct comp_ctx final
             : public compilation_ctx {
@@ -582,88 +898,76 @@ void Trinity::exec_query(const query &in,
 
         } compilationCtx(&rctx);
 
-        if (defaultMode) {
-                std::vector<ast_node *> stack{q.root}; // use a stack because we don't care about the evaluation order
-                std::vector<phrase *>   collected;
-
-                // collect phrases from the AST
-                do {
-                        auto n = stack.back();
-
-                        stack.pop_back();
-                        switch (n->type) {
-                                case ast_node::Type::Token:
-				[[fallthrough]];
-                                case ast_node::Type::Phrase: {
-                                        auto p{n->p};
+        exec_node rootExecNode;
 
-                                        collected.emplace_back(p);
+        if (plan) {
+                // Resolve the plan's distinct terms, in the order they were registered with the plan(see collect_query_term_instances())
+                // and instantiate the plan with the terms IDs of this index source.
+                const auto &                terms = plan->distinct_terms();
+                const auto                  n     = terms.size();
+                std::vector<exec_term_id_t> termIDs(n + 1);
 
-                                        // We are going to use comp_ctx to resolve
-                                        // all query tokens here before we invoke compile_query(), because it will
-                                        // wind up invoking reorder_root()
-                                        // so the order at which terms is resolved may not match the order of terms in the original query
-                                        // and we want to respect that order so that applications may rely on it for whatever reason later.
-                                        for (size_t i{0}; i < p->size; ++i) {
-						compilationCtx.resolve_query_term(p->terms[i].token);
-					}
+                {
+                        std::vector<str8_t> all(terms.begin(), terms.end());
 
-                                } break;
+                        rctx.resolve_terms(all);
+                }
 
-                                case ast_node::Type::MatchSome:
-                                        stack.insert(stack.end(), n->match_some.nodes, n->match_some.nodes + n->match_some.size);
-                                        break;
+                termIDs[0] = 0;
+                for (size_t i{0}; i != n; ++i) {
+                        termIDs[i + 1] = compilationCtx.resolve_query_term(terms[i]);
+                }
 
-                                case ast_node::Type::UnaryOp:
-                                        if (n->unaryop.op != Operator::NOT)
-                                                stack.emplace_back(n->unaryop.expr);
-                                        break;
+                if (defaultMode) {
+                        originalQueryTokenInstances = plan->query_term_instances();
+                }
 
-                                case ast_node::Type::ConstTrueExpr:
-                                        stack.emplace_back(n->expr);
-                                        break;
+                const auto before = Timings::Microseconds::Tick();
 
-                                case ast_node::Type::BinOp:
-                                        if (n->binop.op == Operator::AND || n->binop.op == Operator::STRICT_AND || n->binop.op == Operator::OR) {
-                                                stack.emplace_back(n->binop.lhs);
-                                                stack.emplace_back(n->binop.rhs);
-                                        } else if (n->binop.op == Operator::NOT)
-                                                stack.emplace_back(n->binop.lhs);
-                                        break;
+                rootExecNode = plan->instantiate(compilationCtx, termIDs.data());
 
-                                default:
-                                        break;
+                if constexpr (traceCompile)
+                        SLog(duration_repr(Timings::Microseconds::Since(before)), " to instantiate, ", duration_repr(Timings::Microseconds::Since(_start)), " since start:", rootExecNode, "\n");
+        } else {
+                // Resolve all query terms in one go(see IndexSource::terms_ctx()), instead of
+                // resolving them one at a time while compiling the query.
+                {
+                        std::vector<str8_t> all;
+
+                        for (const auto n : q->nodes()) {
+                                if (n->type == ast_node::Type::Token || n->type == ast_node::Type::Phrase) {
+                                        for (size_t i{0}; i != n->p->size; ++i) {
+                                                all.emplace_back(n->p->terms[i].token);
+                                        }
+                                }
                         }
-                } while (!stack.empty());
-
-                // collected phrases
-                for (const auto it : collected) {
-                        const uint8_t rep = it->size == 1 ? it->rep : 1;
-                        const auto    toNextSpan{it->toNextSpan};
-                        const auto    flags{it->flags};
-                        const auto    rewriteRange{it->rewrite_ctx.range};
-                        const auto    translationCoefficient{it->rewrite_ctx.translationCoefficient};
-                        const auto    srcSeqSize{it->rewrite_ctx.srcSeqSize};
-                        const auto    app_phrase_id{it->app_phrase_id};
-
-                        // for each phrase token
-                        for (uint16_t pos{it->index}, i{0}; i != it->size; ++i, ++pos) {
-                                if constexpr (traceCompile)
-                                        SLog("Collected instance: [", it->terms[i].token, "] index:", pos, " rep:", rep, " toNextSpan:", i == (it->size - 1) ? toNextSpan : 1, "\n");
 
-                                originalQueryTokenInstances.push_back({{pos, flags, rep, uint8_t(i == (it->size - 1) ? toNextSpan : 1), app_phrase_id, {rewriteRange, translationCoefficient, srcSeqSize}}, it->terms[i].token}); // need to be careful to get this right for phrases
-                        }
+                        rctx.resolve_terms(all);
                 }
-        }
 
-        if constexpr (traceCompile)
-                SLog("Compiling:", q, "\n");
+                if (defaultMode) {
+                        collect_query_term_instances(q->root, compilationCtx, &originalQueryTokenInstances);
+                }
+
+                if constexpr (traceCompile)
+                        SLog("Compiling:", *q, "\n");
 
-        const auto    before       = Timings::Microseconds::Tick();
-        auto          rootExecNode = compile_query(q.root, compilationCtx);
+                const auto before = Timings::Microseconds::Tick();
 
-        if constexpr (traceCompile)
-                SLog(duration_repr(Timings::Microseconds::Since(before)), " to compile, ", duration_repr(Timings::Microseconds::Since(_start)), " since start:", rootExecNode, "\n");
+                rootExecNode = compile_query(q->root, compilationCtx);
+
+                if constexpr (traceCompile)
+                        SLog(duration_repr(Timings::Microseconds::Since(before)), " to compile, ", duration_repr(Timings::Microseconds::Since(_start)), " since start:", rootExecNode, "\n");
+
+                for (const auto &t : expandedTerms) {
+                        if (const auto it = rctx.termsDict.find(t); it != rctx.termsDict.end() && it->second) {
+                                if (it->second >= rctx.expansionTerms.size()) {
+                                        rctx.expansionTerms.resize(it->second + 1, false);
+                                }
+                                rctx.expansionTerms[it->second] = true;
+                        }
+                }
+        }
 
         if (unlikely(rootExecNode.fp == ENT::dummyop || rootExecNode.fp == ENT::constfalse)) {
                 if constexpr (traceCompile)
@@ -878,7 +1182,7 @@ void Trinity::exec_query(const query &in,
 
         if (defaultMode) {
                 // doesn't make sense in other exec.modes
-                matchesFilter->prepare(const_cast<const query_index_terms **>(queryIndicesTerms), q.final_index());
+                matchesFilter->prepare(const_cast<const query_index_terms **>(queryIndicesTerms), finalIndex);
         }
 
         if constexpr (traceCompile)
@@ -891,7 +1195,8 @@ void Trinity::exec_query(const query &in,
 
 #pragma mark Execution
         try {
-                if (rootExecNode.fp == ENT::matchterm && !accumScoreMode) {
+                // The single term specializations don't support budgets; with a budget, we use a span for a single term, like we do for any other query
+                if (rootExecNode.fp == ENT::matchterm && !accumScoreMode && !budget) {
                         isrc_docid_t docID;
 
                         // SPECIALIZATION: single term
@@ -915,7 +1220,7 @@ void Trinity::exec_query(const query &in,
                                         if constexpr (traceCompile)
                                                 SLog("SPECIALIZATION: documentsFilter\n");
 
-                                        while (likely((docID = it->next()) != DocIDsEND)) {
+                                        for (docID = first_document(it, docIDsRange.first); likely(docID < docIDsRange.last); docID = it->next()) {
                                                 const auto globalDocID = requireDocIDTranslation ? idxsrc->translate_docid(docID) : docID;
 
                                                 if (!documentsFilter->filter(globalDocID) && !maskedDocumentsRegistry->test(globalDocID)) {
@@ -934,7 +1239,7 @@ void Trinity::exec_query(const query &in,
                                         if constexpr (traceCompile)
                                                 SLog("SPECIALIZATION: fast\n");
 
-                                        while (likely((docID = it->next()) != DocIDsEND)) {
+                                        for (docID = first_document(it, docIDsRange.first); likely(docID < docIDsRange.last); docID = it->next()) {
 #if DOCSONLY_BATCH_SIZE > 0
                                                 const auto id = requireDocIDTranslation ? idxsrc->translate_docid(docID) : docID;
 
@@ -952,7 +1257,7 @@ void Trinity::exec_query(const query &in,
                                         if constexpr (traceCompile)
                                                 SLog("Specialization: masked\n");
 
-                                        while (likely((docID = it->next()) != DocIDsEND)) {
+                                        for (docID = first_document(it, docIDsRange.first); likely(docID < docIDsRange.last); docID = it->next()) {
                                                 const auto globalDocID = requireDocIDTranslation ? idxsrc->translate_docid(docID) : docID;
 
                                                 if (!maskedDocumentsRegistry->test(globalDocID)) {
@@ -1002,7 +1307,7 @@ void Trinity::exec_query(const query &in,
                                                 if constexpr (traceExec)
                                                         SLog("documentsFilter AND maskedDocumentsRegistry\n");
 
-                                                while (likely((docID = it->next()) != DocIDsEND)) {
+                                                for (docID = first_document(it, docIDsRange.first); likely(docID < docIDsRange.last); docID = it->next()) {
                                                         const auto globalDocID = requireDocIDTranslation ? idxsrc->translate_docid(docID) : docID;
 
                                                         if (!documentsFilter->filter(globalDocID) && !maskedDocumentsRegistry->test(globalDocID)) {
@@ -1015,7 +1320,7 @@ void Trinity::exec_query(const query &in,
                                                 if constexpr (traceExec)
                                                         SLog("documentsFilter\n");
 
-                                                while (likely((docID = it->next()) != DocIDsEND)) {
+                                                for (docID = first_document(it, docIDsRange.first); likely(docID < docIDsRange.last); docID = it->next()) {
                                                         const auto globalDocID = requireDocIDTranslation ? idxsrc->translate_docid(docID) : docID;
 
                                                         if (!documentsFilter->filter(globalDocID)) {
@@ -1030,7 +1335,7 @@ void Trinity::exec_query(const query &in,
                                                 SLog("maskedDocumentsRegistry\n");
 					}
 
-                                        while (likely((docID = it->next()) != DocIDsEND)) {
+                                        for (docID = first_document(it, docIDsRange.first); likely(docID < docIDsRange.last); docID = it->next()) {
                                                 const auto globalDocID = requireDocIDTranslation ? idxsrc->translate_docid(docID) : docID;
 
                                                 if (!maskedDocumentsRegistry->test(globalDocID)) {
@@ -1055,7 +1360,7 @@ void Trinity::exec_query(const query &in,
                                                 SLog("No filtering\n");
 					}
 
-                                        while (likely((docID = it->next()) != DocIDsEND)) {
+                                        for (docID = first_document(it, docIDsRange.first); likely(docID < docIDsRange.last); docID = it->next()) {
                                                 const auto globalDocID = requireDocIDTranslation ? idxsrc->translate_docid(docID) : docID;
 						const auto freq = it->freq;
 
@@ -1121,7 +1426,7 @@ void Trinity::exec_query(const query &in,
 
                                                 } handler(&rctx, idxsrc, matchesFilter, maskedDocumentsRegistry, documentsFilter);
 
-                                                span->process(&handler, 1, DocIDsEND);
+                                                process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                                 matchedDocuments = handler.n;
                                         } else {
                                                 struct Handler final
@@ -1149,7 +1454,7 @@ void Trinity::exec_query(const query &in,
 
                                                 } handler(&rctx, idxsrc, matchesFilter, documentsFilter);
 
-                                                span->process(&handler, 1, DocIDsEND);
+                                                process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                                 matchedDocuments = handler.n;
                                         }
                                 } else if (maskedDocumentsRegistry && !maskedDocumentsRegistry->empty()) {
@@ -1178,7 +1483,7 @@ void Trinity::exec_query(const query &in,
 
                                         } handler(&rctx, idxsrc, matchesFilter, maskedDocumentsRegistry);
 
-                                        span->process(&handler, 1, DocIDsEND);
+                                        process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                         matchedDocuments = handler.n;
                                 } else {
                                         if (idxsrc->require_docid_translation()) {
@@ -1202,7 +1507,7 @@ void Trinity::exec_query(const query &in,
 
                                                 } handler(&rctx, idxsrc, matchesFilter);
 
-                                                span->process(&handler, 1, DocIDsEND);
+                                                process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                                 matchedDocuments = handler.n;
                                         } else {
                                                 struct Handler final
@@ -1225,7 +1530,7 @@ void Trinity::exec_query(const query &in,
 
                                                 } handler(&rctx, idxsrc, matchesFilter);
 
-                                                span->process(&handler, 1, DocIDsEND);
+                                                process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                                 matchedDocuments = handler.n;
                                         }
                                 }
@@ -1252,13 +1557,17 @@ void Trinity::exec_query(const query &in,
                                                                 }
                                                         }
 
+                                                        double min_competitive_score() override final {
+                                                                return matchesFilter->min_competitive_score();
+                                                        }
+
                                                         Handler(queryexec_ctx *const c, IndexSource *const src, MatchedIndexDocumentsFilter *mf, masked_documents_registry *mr, IndexDocumentsFilter *df)
                                                             : idxsrc{src}, ctx{c}, requireDocIDTranslation{src->require_docid_translation()}, matchesFilter{mf}, maskedDocumentsRegistry{mr}, documentsFilter{df} {
                                                         }
 
                                                 } handler(&rctx, idxsrc, matchesFilter, maskedDocumentsRegistry, documentsFilter);
 
-                                                span->process(&handler, 1, DocIDsEND);
+                                                process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                                 matchedDocuments = handler.n;
                                         } else {
                                                 struct Handler final
@@ -1280,13 +1589,17 @@ void Trinity::exec_query(const query &in,
                                                                 }
                                                         }
 
+                                                        double min_competitive_score() override final {
+                                                                return matchesFilter->min_competitive_score();
+                                                        }
+
                                                         Handler(queryexec_ctx *const c, IndexSource *const src, MatchedIndexDocumentsFilter *mf, IndexDocumentsFilter *df)
                                                             : idxsrc{src}, ctx{c}, requireDocIDTranslation{src->require_docid_translation()}, matchesFilter{mf}, documentsFilter{df} {
                                                         }
 
                                                 } handler(&rctx, idxsrc, matchesFilter, documentsFilter);
 
-                                                span->process(&handler, 1, DocIDsEND);
+                                                process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                                 matchedDocuments = handler.n;
                                         }
                                 } else if (maskedDocumentsRegistry && !maskedDocumentsRegistry->empty()) {
@@ -1309,13 +1622,17 @@ void Trinity::exec_query(const query &in,
                                                         }
                                                 }
 
+                                                double min_competitive_score() override final {
+                                                        return matchesFilter->min_competitive_score();
+                                                }
+
                                                 Handler(queryexec_ctx *const c, IndexSource *const src, MatchedIndexDocumentsFilter *mf, masked_documents_registry *mr)
                                                     : idxsrc{src}, ctx{c}, requireDocIDTranslation{src->require_docid_translation()}, matchesFilter{mf}, maskedDocumentsRegistry{mr} {
                                                 }
 
                                         } handler(&rctx, idxsrc, matchesFilter, maskedDocumentsRegistry);
 
-                                        span->process(&handler, 1, DocIDsEND);
+                                        process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                         matchedDocuments = handler.n;
                                 } else {
                                         struct Handler final
@@ -1334,13 +1651,17 @@ void Trinity::exec_query(const query &in,
                                                         ++n;
                                                 }
 
+                                                double min_competitive_score() override final {
+                                                        return matchesFilter->min_competitive_score();
+                                                }
+
                                                 Handler(queryexec_ctx *const c, IndexSource *const src, MatchedIndexDocumentsFilter *mf)
                                                     : idxsrc{src}, ctx{c}, requireDocIDTranslation{src->require_docid_translation()}, matchesFilter{mf} {
                                                 }
 
                                         } handler(&rctx, idxsrc, matchesFilter);
 
-                                        span->process(&handler, 1, DocIDsEND);
+                                        process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                         matchedDocuments = handler.n;
                                 }
                         } else {
@@ -1386,7 +1707,7 @@ void Trinity::exec_query(const query &in,
 
                                                 } handler(&rctx, idxsrc, matchesFilter, maskedDocumentsRegistry, documentsFilter);
 
-                                                span->process(&handler, 1, DocIDsEND);
+                                                process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                                 matchedDocuments = handler.n;
                                         } else {
                                                 struct Handler final
@@ -1424,7 +1745,7 @@ void Trinity::exec_query(const query &in,
 
                                                 } handler(&rctx, idxsrc, matchesFilter, documentsFilter);
 
-                                                span->process(&handler, 1, DocIDsEND);
+                                                process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                                 matchedDocuments = handler.n;
                                         }
                                 } else if (maskedDocumentsRegistry && !maskedDocumentsRegistry->empty()) {
@@ -1463,7 +1784,7 @@ void Trinity::exec_query(const query &in,
 
                                         } handler(&rctx, idxsrc, matchesFilter, maskedDocumentsRegistry);
 
-                                        span->process(&handler, 1, DocIDsEND);
+                                        process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                         matchedDocuments = handler.n;
                                 } else {
                                         struct Handler final
@@ -1497,7 +1818,7 @@ void Trinity::exec_query(const query &in,
 
                                         } handler(&rctx, idxsrc, matchesFilter);
 
-                                        span->process(&handler, 1, DocIDsEND);
+                                        process_span(span.get(), &handler, docIDsRange, budgetTracker);
                                         matchedDocuments = handler.n;
                                 }
                         }
@@ -1515,3 +1836,268 @@ void Trinity::exec_query(const query &in,
         if (traceCompile || traceExec)
                 SLog(ansifmt::bold, ansifmt::color_red, dotnotation_repr(matchedDocuments), " matched in ", duration_repr(duration), ansifmt::reset, " (", Timings::Microseconds::ToMillis(duration), " ms) ", duration_repr(durationAll), " all\n");
 }
+
+void Trinity::exec_query(const query &in,
+                         IndexSource *const __restrict__ idxsrc,
+                         masked_documents_registry *const __restrict__ maskedDocumentsRegistry,
+                         MatchedIndexDocumentsFilter *__restrict__ const matchesFilter,
+                         IndexDocumentsFilter *__restrict__ const documentsFilter,
+                         const uint32_t                      execFlags,
+                         Similarity::IndexSourceTermsScorer *scorer,
+                         const isrc_docids_range             docIDsRange,
+                         exec_budget *const                  budget) {
+        exec_query_impl(&in, nullptr, idxsrc, maskedDocumentsRegistry, matchesFilter, documentsFilter, execFlags, scorer, docIDsRange, budget);
+}
+
+void Trinity::exec_query(const compiled_query_plan &plan,
+                         IndexSource *const __restrict__ idxsrc,
+                         masked_documents_registry *const __restrict__ maskedDocumentsRegistry,
+                         MatchedIndexDocumentsFilter *__restrict__ const matchesFilter,
+                         IndexDocumentsFilter *__restrict__ const documentsFilter,
+                         const uint32_t                      execFlags,
+                         Similarity::IndexSourceTermsScorer *scorer,
+                         const isrc_docids_range             docIDsRange,
+                         exec_budget *const                  budget) {
+        exec_query_impl(nullptr, &plan, idxsrc, maskedDocumentsRegistry, matchesFilter, documentsFilter, execFlags, scorer, docIDsRange, budget);
+}
+
+void Trinity::exec_queries_batch(const compiled_query_plan *const *plans, const std::size_t plansCnt,
+                                 IndexSourcesCollection *const collection, const uint16_t sourceIdx,
+                                 MatchedIndexDocumentsFilter **matchesFilters, IndexDocumentsFilter *const documentsFilter,
+                                 const uint32_t                      execFlags,
+                                 Similarity::IndexSourceTermsScorer *scorer,
+                                 const std::size_t                   sharedPostingsBudget,
+                                 exec_budget *const                  budget) {
+        auto *const idxsrc        = collection->sources[sourceIdx];
+        const bool  documentsOnly = execFlags & uint32_t(ExecFlags::DocumentsOnly);
+        const bool  defaultMode   = !documentsOnly && !(execFlags & uint32_t(ExecFlags::AccumulatedScoreScheme));
+
+        validate_flags(execFlags);
+
+        if (idxsrc->index_empty()) {
+                return;
+        }
+
+        struct term_refs final {
+                str8_t         term;
+                term_index_ctx tctx;
+                uint32_t       refs{0};
+                bool           hits{false};
+        };
+
+        const auto                                                   _start = Timings::Microseconds::Tick();
+        SharedPostingsIndexSource                                    src(idxsrc);
+        std::unordered_map<str8_t, term_refs>                        terms;
+        std::vector<term_refs *>                                     candidates;
+        std::vector<std::unique_ptr<Codecs::Materialized::postings>> materialized;
+        auto                                                         remaining{sharedPostingsBudget};
+
+        // src is not reference counted by anyone else
+        DEFER({ src.ResetRefs(); });
+
+        // Distinct terms across all plans, and how many plans use each of them
+        for (size_t i{0}; i != plansCnt; ++i) {
+                const auto plan = plans[i];
+
+                if (!plan || !*plan) {
+                        continue;
+                }
+
+                const auto &planTerms = plan->distinct_terms();
+
+                for (size_t k{0}; k != planTerms.size(); ++k) {
+                        auto &t = terms[planTerms[k]];
+
+                        t.term = planTerms[k];
+                        ++t.refs;
+                        // we need the hits if the term may be a phrase term, or if we need to capture the matched terms
+                        t.hits |= defaultMode || plan->phrase_term(k + 1);
+                }
+        }
+
+        // Only terms used by 2+ plans are worth decoding in memory
+        for (auto &it : terms) {
+                auto &t = it.second;
+
+                if (t.refs < 2) {
+                        continue;
+                }
+
+                // src caches the resolved term_index_ctx, so that it won't need to be resolved again by each plan
+                t.tctx = src.term_ctx(t.term);
+                if (t.tctx.documents) {
+                        candidates.emplace_back(&t);
+                }
+        }
+
+        // Terms that would be decoded more times, and have more documents, first
+        std::sort(candidates.begin(), candidates.end(), [](const auto a, const auto b) noexcept {
+                return uint64_t(a->tctx.documents) * (a->refs - 1) > uint64_t(b->tctx.documents) * (b->refs - 1);
+        });
+
+        for (auto t : candidates) {
+                if (t->tctx.documents * sizeof(isrc_docid_t) > remaining) {
+                        // can't possibly fit
+                        continue;
+                }
+
+                const auto content = t->hits ? Codecs::Materialized::Content::Hits : documentsOnly ? Codecs::Materialized::Content::DocIDs : Codecs::Materialized::Content::Freqs;
+                auto       p       = std::make_unique<Codecs::Materialized::postings>();
+
+                if (Codecs::Materialized::materialize(idxsrc, t->term, t->tctx, content, remaining, p.get())) {
+                        remaining -= p->footprint();
+                        src.share(t->term, p.get());
+                        materialized.emplace_back(std::move(p));
+                }
+        }
+
+        if constexpr (traceCompile)
+                SLog(dotnotation_repr(materialized.size()), " of ", dotnotation_repr(terms.size()), " terms shared among ", plansCnt, " plans, ", size_repr(sharedPostingsBudget - remaining), ", took ", duration_repr(Timings::Microseconds::Since(_start)), "\n");
+
+        for (size_t i{0}; i != plansCnt; ++i) {
+                if (const auto plan = plans[i]; plan && *plan) {
+                        auto scanner = collection->scanner_registry_for(sourceIdx);
+
+                        exec_query(*plan, &src, scanner.get(), matchesFilters[i], documentsFilter, execFlags, scorer, {}, budget);
+                }
+        }
+}
+
+void Trinity::exec_query_cached(const query &in, QueryResultsCache *const cache,
+                                IndexSourcesCollection *const collection, const uint16_t sourceIdx,
+                                MatchedIndexDocumentsFilter *const matchesFilter, IndexDocumentsFilter *const documentsFilter,
+                                const uint32_t                      execFlags,
+                                Similarity::IndexSourceTermsScorer *scorer,
+                                exec_budget *const                  budget) {
+        auto *const    source         = collection->sources[sourceIdx];
+        const bool     documentsOnly  = execFlags & uint32_t(ExecFlags::DocumentsOnly);
+        const bool     accumScoreMode = execFlags & uint32_t(ExecFlags::AccumulatedScoreScheme);
+        const bool     topK           = execFlags & uint32_t(ExecFlags::AccumulatedScoreTopK);
+        // cached scores are only valid for the same scoring function
+        const uint64_t scorerKey = accumScoreMode && scorer ? scorer->cache_key() : 0;
+
+        if (!cache || !(documentsOnly || (accumScoreMode && !topK && scorerKey))) {
+                auto scanner = collection->scanner_registry_for(sourceIdx);
+
+                exec_query(in, source, scanner.get(), matchesFilter, documentsFilter, execFlags, scorer, {}, budget);
+                return;
+        }
+
+        // Equivalent queries should map to the same results, so we need to normalize before we build the key
+        query    q(in, true); // shallow copy, no need for a deep copy here
+        IOBuffer key;
+        auto     validity = collection->masking_signature(sourceIdx);
+
+        if (q) {
+                q.normalize();
+        }
+
+        key.pack(source->generation(), execFlags, scorerKey);
+        compiled_query_plan::canonical_key(q, &key);
+
+        if (accumScoreMode) {
+                // scores may depend on all sources in the collection(e.g field statistics)
+                const auto sig = collection->signature();
+
+                validity = FNVHash64(validity, reinterpret_cast<const uint8_t *>(&sig), sizeof(sig));
+        }
+
+        if (const auto res = cache->lookup({key.data(), key.size()}, validity)) {
+                const auto *const ids = res->documents.data();
+                const auto        n   = res->documents.size();
+
+                if constexpr (traceExec)
+                        SLog("Cached results for ", dotnotation_repr(n), " documents\n");
+
+                if (accumScoreMode) {
+                        const auto *const scores = res->scores.data();
+
+                        for (size_t i{0}; i != n; ++i) {
+                                if (!documentsFilter || !documentsFilter->filter(ids[i])) {
+                                        matchesFilter->consider(ids[i], scores[i]);
+                                }
+                        }
+                } else if (!documentsFilter) {
+                        matchesFilter->consider(ids, n);
+                } else {
+                        for (size_t i{0}; i != n; ++i) {
+                                if (!documentsFilter->filter(ids[i])) {
+                                        matchesFilter->consider(ids[i]);
+                                }
+                        }
+                }
+                return;
+        }
+
+        auto scanner = collection->scanner_registry_for(sourceIdx);
+
+        if (documentsFilter) {
+                exec_query(q, source, scanner.get(), matchesFilter, documentsFilter, execFlags, scorer, {}, budget);
+                return;
+        }
+
+        // Tracks the matched documents(and scores) while forwarding them to the application's filter
+        struct recorder final
+            : public MatchedIndexDocumentsFilter {
+                MatchedIndexDocumentsFilter *const target;
+                QueryResultsCache::results *const  res;
+                const std::size_t                  maxFootprint;
+                bool                               overflow{false};
+
+                recorder(MatchedIndexDocumentsFilter *const t, QueryResultsCache::results *const r, const std::size_t m)
+                    : target{t}, res{r}, maxFootprint{m} {
+                }
+
+                void check_overflow() {
+                        if (unlikely(res->footprint() > maxFootprint)) {
+                                // not worth caching; stop tracking
+                                overflow = true;
+                                res->documents.clear();
+                                res->documents.shrink_to_fit();
+                                res->scores.clear();
+                                res->scores.shrink_to_fit();
+                        }
+                }
+
+                void consider(const docid_t id) override final {
+                        if (!overflow) {
+                                res->documents.emplace_back(id);
+                                check_overflow();
+                        }
+                        target->consider(id);
+                }
+
+                void consider(const docid_t *const ids, const size_t cnt) override final {
+                        if (!overflow) {
+                                res->documents.insert(res->documents.end(), ids, ids + cnt);
+                                check_overflow();
+                        }
+                        target->consider(ids, cnt);
+                }
+
+                void consider(const docid_t id, const double score) override final {
+                        if (!overflow) {
+                                res->documents.emplace_back(id);
+                                res->scores.emplace_back(score);
+                                check_overflow();
+                        }
+                        target->consider(id, score);
+                }
+
+                double min_competitive_score() override final {
+                        return target->min_competitive_score();
+                }
+        };
+
+        auto     res = std::make_shared<QueryResultsCache::results>();
+        recorder r(matchesFilter, res.get(), cache->max_results_footprint());
+
+        exec_query(q, source, scanner.get(), &r, nullptr, execFlags, scorer, {}, budget);
+
+        // truncated results are not complete, so they can't be cached
+        if (!r.overflow && !(budget && budget->truncated.load(std::memory_order_relaxed))) {
+                res->documents.shrink_to_fit();
+                res->scores.shrink_to_fit();
+                cache->insert({key.data(), key.size()}, source->generation(), validity, std::move(res));
+        }
+}
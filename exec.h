@@ -1,11 +1,14 @@
 // Please refer to https://github.com/phaistos-networks/Trinity/wiki/Query-Execution-Engine-Internals
 #pragma once
 #include "docidupdates.h"
+#include "exec_plan.h"
+#include "exec_pool.h"
 #include "index_source.h"
 #include "matches.h"
 #include "queries.h"
+#include "results_cache.h"
 #include "similarity.h"
-#include <future>
+#include <atomic>
 
 namespace Trinity {
         enum class ExecFlags : uint32_t {
@@ -39,17 +42,137 @@ namespace Trinity {
                 // this flag. If set, query_index_term::flags will be set to 0.
                 // This is really only relevant if the default exec. mode is selected
                 // i.e neither DocumentsOnly nor AccumulatedScoreScheme are set in the passed flags to exec_query()
-                DisregardTokenFlagsForQueryIndicesTerms = 4
+                DisregardTokenFlagsForQueryIndicesTerms = 4,
+
+                // Only meaningful in conjuction with AccumulatedScoreScheme
+                // If set, the engine will use MatchedIndexDocumentsFilter::min_competitive_score() as a dynamic threshold, and
+                // will not consider() documents that can't possibly score higher than that. For disjunctions of terms, this
+                // is implemented using Block-Max WAND(see DocsSetSpanForDisjunctionsWithBlockMax), which means we get to skip
+                // whole postings lists blocks without decoding them. Other disjunctions(e.g of phrases, or N of M) use MaxScore (see DocsSetSpanForDisjunctionsWithMaxScore).
+                //
+                // This is what you want if you are only going to keep the top-K documents, where K is small.
+                // You will need to override MatchedIndexDocumentsFilter::min_competitive_score() and your Similarity scorer should
+                // implement IndexSourceTermsScorer::max_score() -- otherwise no documents will be skipped.
+                AccumulatedScoreTopK = 8,
+
+                // Only meaningful in the default execution mode.
+                // If set, term_hit::payload and term_hit::payloadLen of the matched terms hits will be 0; codecs will not
+                // decode payloads at all, which is considerably cheaper if you don't need them in MatchedIndexDocumentsFilter::consider().
+                DisregardPayloads = 16
         };
 
         static inline void validate_flags(const uint32_t f) {
                 if (const auto mask = f & (unsigned(ExecFlags::DocumentsOnly) | unsigned(ExecFlags::AccumulatedScoreScheme)); mask && (mask & (mask - 1)))
                         throw Switch::invalid_argument("DocumentsOnly and AccumulatedScoreScheme are mutually exclusive modes");
+
+                if ((f & unsigned(ExecFlags::AccumulatedScoreTopK)) && !(f & unsigned(ExecFlags::AccumulatedScoreScheme)))
+                        throw Switch::invalid_argument("AccumulatedScoreTopK requires AccumulatedScoreScheme");
         }
 
+        // A [first, last) range of index source documents IDs
+        // exec_query() will only consider documents in that range. This is how exec_query_par_partitioned() splits
+        // an index source into partitions that can be executed in parallel.
+        struct isrc_docids_range final {
+                isrc_docid_t first{1};
+                isrc_docid_t last{DocIDsEND};
+
+                constexpr bool whole() const noexcept {
+                        return first <= 1 && last == DocIDsEND;
+                }
+        };
+
+        // Limits the work exec_query() may do, so that you can cap the latency of expensive queries without losing the documents matched so far.
+        // A limit set to 0 is not enforced.
+        //
+        // Limits are checked after every WindowSize documents IDs are processed, so they may be exceeded somewhat before the execution is stopped.
+        // If it is stopped, truncated is set, and the filter will have been passed all the documents matched until then.
+        // The counters are updated atomically, so you can use the same budget for all executions of a request, including
+        // concurrent executions(e.g of different index sources); once any of them runs out of budget, all will stop.
+        struct exec_budget final {
+                static constexpr isrc_docid_t WindowSize{16384};
+
+                // Timings::Microseconds::Tick() based
+                uint64_t deadline{0};
+                // Documents matched by the query, before they are filtered or masked
+                uint64_t maxDocuments{0};
+                // Postings decoded by codecs(see Codecs::Decoder::decodedPostings)
+                uint64_t maxPostings{0};
+
+                std::atomic<uint64_t> documents{0};
+                std::atomic<uint64_t> postings{0};
+                std::atomic<bool>     truncated{false};
+
+                void set_timeout(const uint64_t micros) noexcept {
+                        deadline = Timings::Microseconds::Tick() + micros;
+                }
+
+                // Accounts for the provided work, and returns true if the budget has been exhausted, in which case truncated is set
+                bool consume(const uint64_t documentsCnt, const uint64_t postingsCnt) noexcept {
+                        const auto d = documents.fetch_add(documentsCnt, std::memory_order_relaxed) + documentsCnt;
+                        const auto p = postings.fetch_add(postingsCnt, std::memory_order_relaxed) + postingsCnt;
+
+                        if (truncated.load(std::memory_order_relaxed) || (maxDocuments && d >= maxDocuments) || (maxPostings && p >= maxPostings) || (deadline && Timings::Microseconds::Tick() >= deadline)) {
+                                truncated.store(true, std::memory_order_relaxed);
+                                return true;
+                        }
+
+                        return false;
+                }
+        };
+
+        // If you are going to execute multiple docIDsRange of the same index source concurrently, make
+        // sure you use a different maskedDocumentsRegistry and scorer for each of them; they are not thread-safe.
         void exec_query(const query &in, IndexSource *, masked_documents_registry *const maskedDocumentsRegistry, MatchedIndexDocumentsFilter *, IndexDocumentsFilter *const f = nullptr,
-                        const uint32_t                      flags  = 0,
-                        Similarity::IndexSourceTermsScorer *scorer = nullptr);
+                        const uint32_t                      flags       = 0,
+                        Similarity::IndexSourceTermsScorer *scorer      = nullptr,
+                        const isrc_docids_range             docIDsRange = {},
+                        exec_budget *const                  budget      = nullptr);
+
+        // Same as above, except that the query has already been compiled into a plan(see exec_plan.h), so that
+        // exec_query() only needs to resolve the plan's terms and instantiate it for this index source.
+        // If you execute the same queries frequently, use a QueryPlansCache to get the plans.
+        void exec_query(const compiled_query_plan &plan, IndexSource *, masked_documents_registry *const maskedDocumentsRegistry, MatchedIndexDocumentsFilter *, IndexDocumentsFilter *const f = nullptr,
+                        const uint32_t                      flags       = 0,
+                        Similarity::IndexSourceTermsScorer *scorer      = nullptr,
+                        const isrc_docids_range             docIDsRange = {},
+                        exec_budget *const                  budget      = nullptr);
+
+        // Like exec_query(), except that the matched documents(and their scores, if AccumulatedScoreScheme is selected) are looked up in cache
+        // first(see QueryResultsCache), and if they were stored after a previous execution of the same query on that source, and the documents
+        // masked for that source haven't changed since, the query is not executed at all; the cached documents are consider()ed instead.
+        //
+        // Only DocumentsOnly and AccumulatedScoreScheme(without AccumulatedScoreTopK) executions can make use of the cache. The matched_document
+        // state of the default execution mode can't be cached, and with AccumulatedScoreTopK the matched documents depend on min_competitive_score().
+        // Otherwise, this is the same as exec_query().
+        // Scores are only cached for as long as the collection's sources remain the same, so your scorer should
+        // depend on nothing else(e.g the field statistics of those sources). They are keyed by the scorer's
+        // IndexSourceTermsScorer::cache_key(), and not cached at all for scorers that don't provide one.
+        //
+        // If f is set, it is applied to the cached documents, but the results of executions with f set are not cached, for
+        // they are specific to f.
+        void exec_query_cached(const query &in, QueryResultsCache *cache, IndexSourcesCollection *collection, const uint16_t sourceIdx,
+                               MatchedIndexDocumentsFilter *, IndexDocumentsFilter *const f = nullptr,
+                               const uint32_t                      flags  = 0,
+                               Similarity::IndexSourceTermsScorer *scorer = nullptr,
+                               exec_budget *const                  budget = nullptr);
+
+        // Executes many queries(plans) against the same index source, sharing the work they have in common.
+        //
+        // Applications often fan a single request into many related queries(rewrites, category filters, spelling alternatives) that share
+        // most of their terms. Here, each distinct term is resolved once, and the postings lists of terms that are used by 2+ plans
+        // are decoded once, in memory(upto sharedPostingsBudget bytes), and all plans are executed against those(see SharedPostingsIndexSource) instead of
+        // decoding them again for each plan.
+        //
+        // matchesFilters[i] is used for plans[i]. A masked_documents_registry is consumed as documents are tested, so
+        // the source is identified by its index in collection, and a registry is created for each plan(see IndexSourcesCollection::scanner_registry_for()).
+        // If you are going to use AccumulatedScoreScheme, scorer is used for all plans. If budget is set, it is shared by all plans.
+        void exec_queries_batch(const compiled_query_plan *const *plans, const std::size_t plansCnt,
+                                IndexSourcesCollection *collection, const uint16_t sourceIdx,
+                                MatchedIndexDocumentsFilter **matchesFilters, IndexDocumentsFilter *const f = nullptr,
+                                const uint32_t                      flags                = 0,
+                                Similarity::IndexSourceTermsScorer *scorer               = nullptr,
+                                const std::size_t                   sharedPostingsBudget = 256 * 1024 * 1024,
+                                exec_budget *const                  budget               = nullptr);
 
         // Handy utility function; executes query on all index sources in the provided collection in sequence and returns
         // a vector with the match filters/results of each execution.
@@ -60,8 +183,10 @@ namespace Trinity {
         //
         // Note that execution of sources does not depend on state of other sources - they are isolated so parallel processing them requires
         // no coordination.
-        template <typename T, typename... Arg>
-        std::vector<std::unique_ptr<T>> exec_query(const query &in, IndexSourcesCollection *collection, IndexDocumentsFilter *f, const uint32_t flags, Arg &&... args) {
+        //
+        // Q is either a query or a compiled_query_plan; with a plan, the query is only compiled once instead of once per index source.
+        template <typename T, typename Q, typename... Arg>
+        std::vector<std::unique_ptr<T>> exec_query(const Q &in, IndexSourcesCollection *collection, IndexDocumentsFilter *f, const uint32_t flags, Arg &&... args) {
                 static_assert(std::is_base_of<MatchedIndexDocumentsFilter, T>::value, "Expected a MatchedIndexDocumentsFilter subclass");
                 const auto                      n = collection->sources.size();
                 std::vector<std::unique_ptr<T>> out;
@@ -80,16 +205,21 @@ namespace Trinity {
                 return out;
         }
 
-        // Parallel queries execution, using std::async()
+        // Parallel queries execution, using an ExecPool(see exec_pool.h)
         // This variant also supports ExecFlags::AccumulatedScoreScheme
         // You will need to provide a cs for this to work
-        template <typename T, typename... Arg>
-        std::vector<std::unique_ptr<T>> exec_query_par(const query &in, 
-		IndexSourcesCollection *collection, 
-		IndexDocumentsFilter *f, 
-		const uint32_t flags, 
-		Trinity::Similarity::IndexSourcesCollectionTermsScorer *cs, 
-		Arg &&... args) {
+        //
+        // All but the first index source are scheduled into the pool with the provided priority, and the first is executed
+        // in the calling thread. You can invoke it from a pool worker thread; it will execute pending tasks while it waits for the others.
+        template <typename T, typename Q, typename... Arg>
+        std::vector<std::unique_ptr<T>> exec_query_par(const Q &                                               in,
+                                                       ExecPool *                                              pool,
+                                                       const ExecPool::Priority                                priority,
+                                                       IndexSourcesCollection *                                collection,
+                                                       IndexDocumentsFilter *                                  f,
+                                                       const uint32_t                                          flags,
+                                                       Trinity::Similarity::IndexSourcesCollectionTermsScorer *cs,
+                                                       Arg &&... args) {
                 static_assert(std::is_base_of<MatchedIndexDocumentsFilter, T>::value, "Expected a MatchedIndexDocumentsFilter subclass");
                 const auto                      n = collection->sources.size();
                 std::vector<std::unique_ptr<T>> out;
@@ -111,66 +241,238 @@ namespace Trinity {
                         cs->reset(collection);
                 }
 
-                if (n == 1) {
-                        // fast-path: single source
+                const auto exec = [&, accumScoreScheme](const uint32_t i) {
+                        auto                                                source  = collection->sources[i];
+                        auto                                                scanner = collection->scanner_registry_for(i);
+                        auto                                                filter  = std::make_unique<T>(std::forward<Arg>(args)...);
+                        std::unique_ptr<Similarity::IndexSourceTermsScorer> scorer;
+
+                        if (accumScoreScheme) {
+                                scorer.reset(cs->new_source_scorer(source));
+                        }
+
+                        exec_query(in, source, scanner.get(), filter.get(), f, flags, scorer.get());
+                        return filter;
+                };
+                std::vector<std::future<std::unique_ptr<T>>> futures;
+
+                // Schedule all but the first into the pool
+                // we 'll handle the first here.
+                for (uint32_t i{1}; i < n; ++i) {
+                        if (false == collection->sources[i]->index_empty()) {
+                                futures.emplace_back(pool->schedule([&exec, i]() { return exec(i); }, priority));
+                        }
+                }
+
+                try {
                         if (false == collection->sources[0]->index_empty()) {
-                                auto                                                source  = collection->sources[0];
-                                auto                                                scanner = collection->scanner_registry_for(0);
-                                auto                                                filter  = std::make_unique<T>(std::forward<Arg>(args)...);
-                                std::unique_ptr<Similarity::IndexSourceTermsScorer> scorer;
+                                out.push_back(exec(0));
+                        }
+                } catch (...) {
+                        // scheduled tasks reference our state
+                        try {
+                                pool->wait_all(futures, priority);
+                        } catch (...) {
+                        }
+                        throw;
+                }
+
+                for (auto &it : pool->wait_all(futures, priority)) {
+                        out.push_back(std::move(it));
+                }
+
+                return out;
+        }
+
+        // Same as above, using ExecPool::default_pool()
+        template <typename T, typename Q, typename... Arg>
+        std::vector<std::unique_ptr<T>> exec_query_par(const Q &in, 
+		IndexSourcesCollection *collection, 
+		IndexDocumentsFilter *f, 
+		const uint32_t flags, 
+		Trinity::Similarity::IndexSourcesCollectionTermsScorer *cs, 
+		Arg &&... args) {
+                return exec_query_par<T>(in, ExecPool::default_pool(), ExecPool::Priority::Normal, collection, f, flags, cs, std::forward<Arg>(args)...);
+        }
+
+        // Splits the documents IDs space of an index source into upto `partitions` ranges, based on its
+        // field_statistics::lowestDocID and highestDocID. The first and the last ranges are open-ended, so that if
+        // those bounds are not accurate(they are only a hint), we will get unbalanced partitions, but we won't miss any documents.
+        // If the bounds are not known, or the source is too small to be worth it, a single (whole) range is returned.
+        static inline std::vector<isrc_docids_range> partition_docids_space(IndexSource *const source, const uint16_t partitions) {
+                static constexpr isrc_docid_t minPartitionSpan{64 * 1024};
+                const auto                    fs = source->default_field_stats();
+                std::vector<isrc_docids_range> out;
+
+                if (partitions > 1 && fs.highestDocID && fs.highestDocID > fs.lowestDocID) {
+                        const auto span = fs.highestDocID - fs.lowestDocID + 1;
+                        const auto n    = std::min<isrc_docid_t>(partitions, span / minPartitionSpan);
+
+                        if (n > 1) {
+                                const auto step = span / n;
 
-                                if (accumScoreScheme) {
-                                        scorer.reset(cs->new_source_scorer(source));
-				}
+                                for (isrc_docid_t i{0}, first{1}; i != n; ++i) {
+                                        const auto last = i + 1 == n ? DocIDsEND : fs.lowestDocID + step * (i + 1);
 
-                                exec_query(in, source, scanner.get(), filter.get(), f, flags, scorer.get());
-                                out.push_back(std::move(filter));
+                                        out.push_back({first, last});
+                                        first = last;
+                                }
+
+                                return out;
                         }
+                }
+
+                out.push_back({});
+                return out;
+        }
+
+        // Like exec_query_par(), except that each index source is also split into upto `partitions` documents IDs ranges
+        // (see partition_docids_space()), and each range is executed in parallel. This is useful when you have few and large index sources(e.g right after
+        // you have merged them), where exec_query_par() can't make use of all available cores.
+        //
+        // Returns the filter of each (source, range) execution; you are expected to merge/reduce them as you would for exec_query_par().
+        // Note that if you are using ExecFlags::AccumulatedScoreTopK, each range tracks its own min_competitive_score(), so there will be less pruning
+        // than when executing the whole source.
+        template <typename T, typename Q, typename... Arg>
+        std::vector<std::unique_ptr<T>> exec_query_par_partitioned(const Q &                                               in,
+                                                                   ExecPool *                                              pool,
+                                                                   const ExecPool::Priority                                priority,
+                                                                   IndexSourcesCollection *                                collection,
+                                                                   IndexDocumentsFilter *                                  f,
+                                                                   const uint32_t                                          flags,
+                                                                   Trinity::Similarity::IndexSourcesCollectionTermsScorer *cs,
+                                                                   const uint16_t                                          partitions,
+                                                                   Arg &&... args) {
+                static_assert(std::is_base_of<MatchedIndexDocumentsFilter, T>::value, "Expected a MatchedIndexDocumentsFilter subclass");
+                const auto                                         n = collection->sources.size();
+                std::vector<std::unique_ptr<T>>                    out;
+                std::vector<std::pair<uint32_t, isrc_docids_range>> tasks;
+
+                validate_flags(flags);
+
+                if (!n) {
                         return out;
                 }
 
-                std::vector<std::future<std::unique_ptr<T>>> futures;
+                const bool accumScoreScheme = flags & unsigned(ExecFlags::AccumulatedScoreScheme);
 
-                // Schedule all but the first via std::async()
-                // we 'll handle the first here.
-                for (size_t i{1}; i != n; ++i) {
-                        if (false == collection->sources[i]->index_empty()) {
-                                futures.emplace_back(
-                                    std::async(std::launch::async, [&, accumScoreScheme](const uint32_t i) {
-                                            auto                                                source  = collection->sources[i];
-                                            auto                                                scanner = collection->scanner_registry_for(i);
-                                            auto                                                filter  = std::make_unique<T>(std::forward<Arg>(args)...);
-                                            std::unique_ptr<Similarity::IndexSourceTermsScorer> scorer;
-
-                                            if (accumScoreScheme) {
-                                                    scorer.reset(cs->new_source_scorer(source));
-                                            }
-
-                                            exec_query(in, source, scanner.get(), filter.get(), f, flags, scorer.get());
-                                            return filter;
-                                    },
-                                               i));
+                if (accumScoreScheme) {
+                        if (!cs) {
+                                throw Switch::invalid_argument("IndexSourcesCollectionTermsScorer not set");
                         }
+
+                        cs->reset(collection);
+                }
+
+                for (uint32_t i{0}; i != n; ++i) {
+                        if (auto source = collection->sources[i]; false == source->index_empty()) {
+                                for (const auto r : partition_docids_space(source, partitions)) {
+                                        tasks.push_back({i, r});
+                                }
+                        }
+                }
+
+                if (tasks.empty()) {
+                        return out;
                 }
 
-                if (auto source = collection->sources[0]; false == source->index_empty()) {
-                        auto                                                scanner = collection->scanner_registry_for(0);
+                // Each execution gets its own masked documents registry and scorer; they are not thread-safe
+                const auto exec = [&, accumScoreScheme](const std::pair<uint32_t, isrc_docids_range> task) {
+                        auto                                                source  = collection->sources[task.first];
+                        auto                                                scanner = collection->scanner_registry_for(task.first);
                         auto                                                filter  = std::make_unique<T>(std::forward<Arg>(args)...);
                         std::unique_ptr<Similarity::IndexSourceTermsScorer> scorer;
 
                         if (accumScoreScheme) {
                                 scorer.reset(cs->new_source_scorer(source));
-			}
+                        }
 
-                        exec_query(in, source, scanner.get(), filter.get(), f, flags, scorer.get());
-                        out.push_back(std::move(filter));
+                        exec_query(in, source, scanner.get(), filter.get(), f, flags, scorer.get(), task.second);
+                        return filter;
+                };
+                std::vector<std::future<std::unique_ptr<T>>> futures;
+
+                // Schedule all but the first into the pool
+                // we 'll handle the first here.
+                for (size_t i{1}; i < tasks.size(); ++i) {
+                        futures.emplace_back(pool->schedule([&exec, task = tasks[i]]() { return exec(task); }, priority));
                 }
 
-                while (futures.size()) {
-                        auto &f = futures.back();
+                try {
+                        out.push_back(exec(tasks.front()));
+                } catch (...) {
+                        try {
+                                pool->wait_all(futures, priority);
+                        } catch (...) {
+                        }
+                        throw;
+                }
+
+                for (auto &it : pool->wait_all(futures, priority)) {
+                        out.push_back(std::move(it));
+                }
+
+                return out;
+        }
+
+        // Same as above, using ExecPool::default_pool()
+        template <typename T, typename Q, typename... Arg>
+        std::vector<std::unique_ptr<T>> exec_query_par_partitioned(const Q &                                               in,
+                                                                   IndexSourcesCollection *                                collection,
+                                                                   IndexDocumentsFilter *                                  f,
+                                                                   const uint32_t                                          flags,
+                                                                   Trinity::Similarity::IndexSourcesCollectionTermsScorer *cs,
+                                                                   const uint16_t                                          partitions,
+                                                                   Arg &&... args) {
+                return exec_query_par_partitioned<T>(in, ExecPool::default_pool(), ExecPool::Priority::Normal, collection, f, flags, cs, partitions, std::forward<Arg>(args)...);
+        }
+
+        // Executes all plans on all index sources in the provided collection, in sequence, using exec_queries_batch() for each source.
+        // Returns the match filters of each plan(i.e out[i] holds the filters of plans[i] for each source), which you are expected to merge/reduce.
+        template <typename T, typename... Arg>
+        std::vector<std::vector<std::unique_ptr<T>>> exec_queries_batch(const std::vector<const compiled_query_plan *> &        plans,
+                                                                        IndexSourcesCollection *                                collection,
+                                                                        IndexDocumentsFilter *                                  f,
+                                                                        const uint32_t                                          flags,
+                                                                        Trinity::Similarity::IndexSourcesCollectionTermsScorer *cs,
+                                                                        Arg &&... args) {
+                static_assert(std::is_base_of<MatchedIndexDocumentsFilter, T>::value, "Expected a MatchedIndexDocumentsFilter subclass");
+                const auto                                   n = collection->sources.size();
+                std::vector<std::vector<std::unique_ptr<T>>> out(plans.size());
+                std::vector<MatchedIndexDocumentsFilter *>   filters(plans.size());
+
+                validate_flags(flags);
+
+                const bool accumScoreScheme = flags & unsigned(ExecFlags::AccumulatedScoreScheme);
+
+                if (accumScoreScheme) {
+                        if (!cs) {
+                                throw Switch::invalid_argument("IndexSourcesCollectionTermsScorer not set");
+                        }
+
+                        cs->reset(collection);
+                }
+
+                for (uint16_t i{0}; i != n; ++i) {
+                        auto                                                source = collection->sources[i];
+                        std::unique_ptr<Similarity::IndexSourceTermsScorer> scorer;
+
+                        if (source->index_empty()) {
+                                continue;
+                        }
+
+                        if (accumScoreScheme) {
+                                scorer.reset(cs->new_source_scorer(source));
+                        }
+
+                        for (size_t k{0}; k != plans.size(); ++k) {
+                                auto filter = std::make_unique<T>(std::forward<Arg>(args)...);
+
+                                filters[k] = filter.get();
+                                out[k].push_back(std::move(filter));
+                        }
 
-                        out.push_back(std::move(f.get()));
-                        futures.pop_back();
+                        exec_queries_batch(plans.data(), plans.size(), collection, i, filters.data(), f, flags, scorer.get());
                 }
 
                 return out;
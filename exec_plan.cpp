@@ -0,0 +1,437 @@
+#include "exec_plan.h"
+#include <switch_hash.h>
+
+using namespace Trinity;
+
+namespace // static/local this module
+{
+        static constexpr bool traceCompile{false};
+}
+
+void Trinity::collect_query_term_instances(ast_node *root, compilation_ctx &cctx, std::vector<query_term_instance> *out) {
+        std::vector<ast_node *> stack{root}; // use a stack because we don't care about the evaluation order
+        std::vector<phrase *>   collected;
+
+        // collect phrases from the AST
+        do {
+                auto n = stack.back();
+
+                stack.pop_back();
+                switch (n->type) {
+                        case ast_node::Type::Token:
+                                [[fallthrough]];
+                        case ast_node::Type::Phrase: {
+                                auto p{n->p};
+
+                                collected.emplace_back(p);
+
+                                // We are going to use cctx to resolve
+                                // all query tokens here before we invoke compile_query(), because it will
+                                // wind up invoking reorder_root()
+                                // so the order at which terms is resolved may not match the order of terms in the original query
+                                // and we want to respect that order so that applications may rely on it for whatever reason later.
+                                for (size_t i{0}; i < p->size; ++i) {
+                                        cctx.resolve_query_term(p->terms[i].token);
+                                }
+
+                        } break;
+
+                        case ast_node::Type::MatchSome:
+                                stack.insert(stack.end(), n->match_some.nodes, n->match_some.nodes + n->match_some.size);
+                                break;
+
+                        case ast_node::Type::UnaryOp:
+                                if (n->unaryop.op != Operator::NOT)
+                                        stack.emplace_back(n->unaryop.expr);
+                                break;
+
+                        case ast_node::Type::ConstTrueExpr:
+                                stack.emplace_back(n->expr);
+                                break;
+
+                        case ast_node::Type::BinOp:
+                                if (n->binop.op == Operator::AND || n->binop.op == Operator::STRICT_AND || n->binop.op == Operator::OR) {
+                                        stack.emplace_back(n->binop.lhs);
+                                        stack.emplace_back(n->binop.rhs);
+                                } else if (n->binop.op == Operator::NOT)
+                                        stack.emplace_back(n->binop.lhs);
+                                break;
+
+                        default:
+                                break;
+                }
+        } while (!stack.empty());
+
+        // collected phrases
+        for (const auto it : collected) {
+                const uint8_t rep = it->size == 1 ? it->rep : 1;
+                const auto    toNextSpan{it->toNextSpan};
+                const auto    flags{it->flags};
+                const auto    rewriteRange{it->rewrite_ctx.range};
+                const auto    translationCoefficient{it->rewrite_ctx.translationCoefficient};
+                const auto    srcSeqSize{it->rewrite_ctx.srcSeqSize};
+                const auto    app_phrase_id{it->app_phrase_id};
+
+                // for each phrase token
+                for (uint16_t pos{it->index}, i{0}; i != it->size; ++i, ++pos) {
+                        if constexpr (traceCompile)
+                                SLog("Collected instance: [", it->terms[i].token, "] index:", pos, " rep:", rep, " toNextSpan:", i == (it->size - 1) ? toNextSpan : 1, "\n");
+
+                        out->push_back({{pos, flags, rep, uint8_t(i == (it->size - 1) ? toNextSpan : 1), app_phrase_id, {rewriteRange, translationCoefficient, srcSeqSize}}, it->terms[i].token}); // need to be careful to get this right for phrases
+                }
+        }
+}
+
+#pragma mark compiled_query_plan
+uint16_t compiled_query_plan::CCTX::resolve_query_term(const str8_t term) {
+        const auto res = localMap.emplace(term, 0); // intern string
+
+        if (res.second) {
+                res.first->second = localMap.size();
+                const_cast<str8_t *>(&res.first->first)->Set(allocator.CopyOf(term.data(), term.size()), term.size());
+
+                EXPECT(allTerms.size() == localMap.size() - 1);
+                allTerms.emplace_back(res.first->first);
+        }
+
+        return res.first->second;
+}
+
+static void collect_phrase_terms(const exec_node n, std::vector<bool> &out) {
+        const auto mark = [&out](const compilation_ctx::phrase *const p) {
+                for (size_t i{0}; i != p->size; ++i)
+                        out[p->termIDs[i]] = true;
+        };
+
+        switch (n.fp) {
+                case ENT::matchphrase:
+                        mark(static_cast<const compilation_ctx::phrase *>(n.ptr));
+                        break;
+
+                case ENT::matchallphrases:
+                case ENT::matchanyphrases: {
+                        const auto run = static_cast<const compilation_ctx::phrasesrun *>(n.ptr);
+
+                        for (size_t i{0}; i != run->size; ++i)
+                                mark(run->phrases[i]);
+                } break;
+
+                case ENT::logicaland:
+                case ENT::logicalor:
+                case ENT::logicalnot: {
+                        const auto ctx = static_cast<const compilation_ctx::binop_ctx *>(n.ptr);
+
+                        collect_phrase_terms(ctx->lhs, out);
+                        collect_phrase_terms(ctx->rhs, out);
+                } break;
+
+                case ENT::unaryand:
+                case ENT::unarynot:
+                case ENT::consttrueexpr:
+                        collect_phrase_terms(static_cast<const compilation_ctx::unaryop_ctx *>(n.ptr)->expr, out);
+                        break;
+
+                case ENT::matchsome: {
+                        const auto pm = static_cast<const compilation_ctx::partial_match_ctx *>(n.ptr);
+
+                        for (size_t i{0}; i != pm->size; ++i)
+                                collect_phrase_terms(pm->nodes[i], out);
+                } break;
+
+                case ENT::matchallnodes:
+                case ENT::matchanynodes: {
+                        const auto g = static_cast<const compilation_ctx::nodes_group *>(n.ptr);
+
+                        for (size_t i{0}; i != g->size; ++i)
+                                collect_phrase_terms(g->nodes[i], out);
+                } break;
+
+                default:
+                        break;
+        }
+}
+
+compiled_query_plan::compiled_query_plan(const query &in)
+    : q(in) {
+        if (q) {
+                // tokens expansions are resolved against each index source(see phrase::expansion), so a plan can't
+                // capture them; otherwise the patterns would be looked up as literal terms
+                for (const auto n : q.nodes()) {
+                        if (n->type == ast_node::Type::Token && n->p->expansion != TermExpansion::None)
+                                throw Switch::data_error("Tokens expansions are not supported by compiled query plans");
+                }
+        }
+
+        if (!q || !q.normalize()) {
+                root.fp = ENT::constfalse;
+                return;
+        }
+
+        // We always collect the instances, because the plan is independent of the execution mode
+        collect_query_term_instances(q.root, cctx, &instances);
+
+        root = compile_query(q.root, cctx);
+        if (root.fp == ENT::dummyop)
+                root.fp = ENT::constfalse;
+        else {
+                phraseTerms.resize(cctx.allTerms.size() + 1, false);
+                collect_phrase_terms(root, phraseTerms);
+        }
+}
+
+static compilation_ctx::phrase *clone_phrase(const compilation_ctx::phrase *const p, compilation_ctx &out, const exec_term_id_t *const termIDs) {
+        auto ptr = static_cast<compilation_ctx::phrase *>(out.allocator.Alloc(sizeof(compilation_ctx::phrase) + sizeof(exec_term_id_t) * p->size));
+
+        ptr->size = p->size;
+        ptr->slop = p->slop;
+        for (size_t i{0}; i != p->size; ++i) {
+                if (const auto id = termIDs[p->termIDs[i]])
+                        ptr->termIDs[i] = id;
+                else
+                        return nullptr;
+        }
+
+        return ptr;
+}
+
+// Sets folded if any node was replaced with ENT::constfalse, or any terms or phrases of a run were dropped
+static exec_node clone_node(const exec_node n, compilation_ctx &out, const exec_term_id_t *const termIDs, bool &folded) {
+        exec_node res{n};
+
+        switch (n.fp) {
+                case ENT::matchterm:
+                        if (const auto id = termIDs[n.u16]) {
+                                res.u16 = id;
+                        } else {
+                                res.fp = ENT::constfalse;
+                                folded = true;
+                        }
+                        break;
+
+                case ENT::matchphrase:
+                        if (auto p = clone_phrase(static_cast<const compilation_ctx::phrase *>(n.ptr), out, termIDs)) {
+                                res.ptr = p;
+                        } else {
+                                res.fp = ENT::constfalse;
+                                folded = true;
+                        }
+                        break;
+
+                case ENT::matchallterms:
+                case ENT::matchanyterms: {
+                        const auto run = static_cast<const compilation_ctx::termsrun *>(n.ptr);
+                        auto       ptr = static_cast<compilation_ctx::termsrun *>(out.allocator.Alloc(sizeof(compilation_ctx::termsrun) + sizeof(exec_term_id_t) * run->size));
+
+                        ptr->size = 0;
+                        for (size_t i{0}; i != run->size; ++i) {
+                                if (const auto id = termIDs[run->terms[i]])
+                                        ptr->terms[ptr->size++] = id;
+                                else if (n.fp == ENT::matchallterms)
+                                        break;
+                        }
+
+                        if (ptr->size != run->size) {
+                                folded = true;
+                                if (n.fp == ENT::matchallterms || !ptr->size) {
+                                        res.fp = ENT::constfalse;
+                                        break;
+                                }
+                        }
+
+                        res.ptr = ptr;
+                } break;
+
+                case ENT::matchallphrases:
+                case ENT::matchanyphrases: {
+                        const auto run = static_cast<const compilation_ctx::phrasesrun *>(n.ptr);
+                        auto       ptr = static_cast<compilation_ctx::phrasesrun *>(out.allocator.Alloc(sizeof(compilation_ctx::phrasesrun) + sizeof(compilation_ctx::phrase *) * run->size));
+
+                        ptr->size = 0;
+                        for (size_t i{0}; i != run->size; ++i) {
+                                if (auto p = clone_phrase(run->phrases[i], out, termIDs))
+                                        ptr->phrases[ptr->size++] = p;
+                                else if (n.fp == ENT::matchallphrases)
+                                        break;
+                        }
+
+                        if (ptr->size != run->size) {
+                                folded = true;
+                                if (n.fp == ENT::matchallphrases || !ptr->size) {
+                                        res.fp = ENT::constfalse;
+                                        break;
+                                }
+                        }
+
+                        res.ptr = ptr;
+                } break;
+
+                case ENT::logicaland:
+                case ENT::logicalor:
+                case ENT::logicalnot: {
+                        const auto ctx = static_cast<const compilation_ctx::binop_ctx *>(n.ptr);
+
+                        res.ptr = out.register_binop(clone_node(ctx->lhs, out, termIDs, folded), clone_node(ctx->rhs, out, termIDs, folded));
+                } break;
+
+                case ENT::unaryand:
+                case ENT::unarynot:
+                case ENT::consttrueexpr:
+                        res.ptr = out.register_unaryop(clone_node(static_cast<const compilation_ctx::unaryop_ctx *>(n.ptr)->expr, out, termIDs, folded));
+                        break;
+
+                case ENT::matchsome: {
+                        const auto pm  = static_cast<const compilation_ctx::partial_match_ctx *>(n.ptr);
+                        auto       ptr = static_cast<compilation_ctx::partial_match_ctx *>(out.allocate(sizeof(compilation_ctx::partial_match_ctx) + sizeof(exec_node) * pm->size));
+
+                        ptr->min  = pm->min;
+                        ptr->size = pm->size;
+                        for (size_t i{0}; i != pm->size; ++i)
+                                ptr->nodes[i] = clone_node(pm->nodes[i], out, termIDs, folded);
+
+                        res.ptr = ptr;
+                } break;
+
+                case ENT::matchallnodes:
+                case ENT::matchanynodes: {
+                        const auto g   = static_cast<const compilation_ctx::nodes_group *>(n.ptr);
+                        auto       ptr = static_cast<compilation_ctx::nodes_group *>(out.allocator.Alloc(sizeof(compilation_ctx::nodes_group) + sizeof(exec_node) * g->size));
+
+                        ptr->size = g->size;
+                        for (size_t i{0}; i != g->size; ++i)
+                                ptr->nodes[i] = clone_node(g->nodes[i], out, termIDs, folded);
+
+                        res.ptr = ptr;
+                } break;
+
+                case ENT::constfalse:
+                case ENT::consttrue:
+                case ENT::dummyop:
+                        break;
+
+                default:
+                        // not generated by compile_query()
+                        std::abort();
+        }
+
+        return res;
+}
+
+exec_node compiled_query_plan::instantiate(compilation_ctx &out, const exec_term_id_t *const termIDs) const {
+        if (!*this)
+                return {ENT::constfalse, {}};
+
+        bool       folded{false};
+        const auto res = clone_node(root, out, termIDs, folded);
+
+        if constexpr (traceCompile)
+                SLog("Instantiated:", res, ", folded = ", folded, "\n");
+
+        // Only if terms or phrases can't be matched we need to optimize again
+        return folded ? optimize_compiled_query(res, out) : res;
+}
+
+static void serialize_node(const ast_node *const n, IOBuffer *const out) {
+        out->pack(uint8_t(n->type));
+
+        switch (n->type) {
+                case ast_node::Type::BinOp:
+                        out->pack(uint8_t(n->binop.op));
+                        serialize_node(n->binop.lhs, out);
+                        serialize_node(n->binop.rhs, out);
+                        break;
+
+                case ast_node::Type::UnaryOp:
+                        out->pack(uint8_t(n->unaryop.op));
+                        serialize_node(n->unaryop.expr, out);
+                        break;
+
+                case ast_node::Type::ConstTrueExpr:
+                        serialize_node(n->expr, out);
+                        break;
+
+                case ast_node::Type::MatchSome:
+                        out->pack(n->match_some.min, n->match_some.size);
+                        for (size_t i{0}; i != n->match_some.size; ++i)
+                                serialize_node(n->match_some.nodes[i], out);
+                        break;
+
+                case ast_node::Type::Token:
+                case ast_node::Type::Phrase: {
+                        const auto p = n->p;
+
+                        // everything that's either used by the compiler or tracked in query_term_instance
+                        out->pack(p->size, p->rep, p->slop, uint8_t(p->expansion), p->index, p->toNextSpan, p->flags, p->app_phrase_id,
+                                  p->rewrite_ctx.range.offset, p->rewrite_ctx.range.len, p->rewrite_ctx.translationCoefficient, p->rewrite_ctx.srcSeqSize);
+
+                        for (size_t i{0}; i != p->size; ++i) {
+                                const auto token = p->terms[i].token;
+
+                                out->pack(token.size());
+                                out->serialize(token.data(), token.size());
+                        }
+                } break;
+
+                default:
+                        break;
+        }
+}
+
+void compiled_query_plan::canonical_key(const query &q, IOBuffer *const out) {
+        out->pack(q.final_index());
+        if (q.root)
+                serialize_node(q.root, out);
+}
+
+#pragma mark QueryPlansCache
+std::shared_ptr<const compiled_query_plan> QueryPlansCache::plan_for(const query &in) {
+        // We need to normalize before we compute the key, so that equivalent queries will map to the same plan
+        query    q(in, true); // shallow copy, no need for a deep copy here
+        IOBuffer key;
+
+        if (q)
+                q.normalize();
+
+        compiled_query_plan::canonical_key(q, &key);
+
+        const auto hash = FNVHash64(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+
+        {
+                std::lock_guard<std::mutex> g(lock);
+
+                if (auto it = map.find(hash); it != map.end() && it->second->key.size() == key.size() && !memcmp(it->second->key.data(), key.data(), key.size())) {
+                        lru.splice(lru.begin(), lru, it->second);
+                        ++stats.hits;
+                        return it->second->plan;
+                }
+
+                ++stats.misses;
+        }
+
+        // Compile outside the lock; if another thread compiles the same query concurrently, the last one wins
+        auto plan = std::make_shared<const compiled_query_plan>(in);
+
+        std::lock_guard<std::mutex> g(lock);
+
+        if (auto it = map.find(hash); it != map.end()) {
+                // stale, or a hash collision
+                lru.erase(it->second);
+                map.erase(it);
+        }
+
+        lru.push_front({hash, std::string(key.data(), key.size()), plan});
+        map.emplace(hash, lru.begin());
+
+        while (lru.size() > capacity) {
+                map.erase(lru.back().hash);
+                lru.pop_back();
+        }
+
+        return plan;
+}
+
+void QueryPlansCache::clear() {
+        std::lock_guard<std::mutex> g(lock);
+
+        map.clear();
+        lru.clear();
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "compilation_ctx.h"
+#include "matches.h"
+#include "queries.h"
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace Trinity {
+        // An instance of a query token in the original(before optimizations) query
+        // See matched_document::queryTermInstances
+        struct query_term_instance final
+            : public query_term_ctx::instance_struct {
+                str8_t token;
+        };
+
+        // Collects all term instances of the query, and resolves their tokens via cctx in the order they are found in the query
+        // We only need to do this for specific AST branches and node types(i.e we ignore all RHS expressions of logical NOT nodes)
+        // This must be performed before compile_query() (see exec_query() comments)
+        void collect_query_term_instances(ast_node *root, compilation_ctx &cctx, std::vector<query_term_instance> *out);
+
+        // A query compiled into an exec_nodes tree, independently of any index source or queryexec_ctx.
+        //
+        // exec_query() normalizes, compiles and optimizes the query for each index source, which can take hundreds of microseconds
+        // for large(e.g rewritten) queries. A compiled_query_plan does all that once, with terms identified by plan-local IDs, and exec_query(plan, ..)
+        // only needs to resolve the plan's distinct terms against the index source, instantiate() the tree with the resolved terms IDs, and perform
+        // the cost-based reordering pass. If any of the terms is not matched by the index source, the instantiated tree is re-optimized.
+        //
+        // Plans are immutable once constructed, so they can be used concurrently for multiple index sources. See QueryPlansCache.
+        class compiled_query_plan final {
+              private:
+                struct CCTX final
+                    : public compilation_ctx {
+                        std::unordered_map<str8_t, exec_term_id_t> localMap;
+                        std::vector<str8_t>                        allTerms;
+
+                        uint16_t resolve_query_term(const str8_t term) override final;
+                } cctx;
+
+                query                            q;
+                exec_node                        root;
+                std::vector<query_term_instance> instances;
+                std::vector<bool>                phraseTerms; // indexed by plan-local ID
+
+              public:
+                // in is copied; you don't need to retain it
+                // Throws Switch::data_error if the query has tokens to be expanded(see phrase::expansion); use exec_query(query, ..) for those
+                compiled_query_plan(const query &in);
+
+                operator bool() const noexcept {
+                        return root.fp != ENT::constfalse && root.fp != ENT::dummyop;
+                }
+
+                auto final_index() const noexcept {
+                        return q.final_index();
+                }
+
+                // Distinct terms of the compiled query; the plan-local ID of distinct_terms()[i] is (i + 1)
+                const auto &distinct_terms() const noexcept {
+                        return cctx.allTerms;
+                }
+
+                const auto &query_term_instances() const noexcept {
+                        return instances;
+                }
+
+                // true if the term, identified by its plan-local ID, is matched as part of a phrase, which means
+                // its hits need to be accessed regardless of the execution mode
+                bool phrase_term(const exec_term_id_t id) const noexcept {
+                        return id < phraseTerms.size() && phraseTerms[id];
+                }
+
+                // Clones the compiled tree, allocating from out, where each plan-local term ID is mapped to termIDs[id], which should be 0
+                // if the term is not matched by the index source. Returns ENT::constfalse if the query can't match any documents.
+                exec_node instantiate(compilation_ctx &out, const exec_term_id_t *const termIDs) const;
+
+                // Serializes the normalized query q into out; two queries with the same key compile to the same plan
+                static void canonical_key(const query &q, IOBuffer *const out);
+        };
+
+        // A bounded(LRU) cache of compiled_query_plan, keyed by the hash of the normalized query canonical key
+        // It is thread-safe. Plans are reference counted so that they can be evicted while still in use.
+        class QueryPlansCache final {
+              private:
+                struct entry final {
+                        uint64_t                                   hash;
+                        std::string                                key;
+                        std::shared_ptr<const compiled_query_plan> plan;
+                };
+
+                const std::size_t                                    capacity;
+                std::mutex                                           lock;
+                std::list<entry>                                     lru; // most recently used first
+                std::unordered_map<uint64_t, std::list<entry>::iterator> map;
+
+              public:
+                struct {
+                        uint64_t hits{0};
+                        uint64_t misses{0};
+                } stats;
+
+              public:
+                QueryPlansCache(const std::size_t c = 4096)
+                    : capacity{c ?: 1} {
+                }
+
+                // Returns the plan for query q, compiling it if it is not cached already
+                // Throws Switch::data_error for queries compiled_query_plan doesn't support
+                std::shared_ptr<const compiled_query_plan> plan_for(const query &q);
+
+                void clear();
+        };
+} // namespace Trinity
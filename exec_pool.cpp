@@ -0,0 +1,243 @@
+#include "exec_pool.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+
+// The pool, and the index of the worker in it, if this is a worker thread
+static thread_local std::pair<Trinity::ExecPool *, uint16_t> curWorker{nullptr, 0};
+
+// Parses a kernel cpus/nodes list, e.g "0-3,8-11,16"
+static std::vector<uint16_t> parse_ids_list(const char *p, const char *const e) {
+        std::vector<uint16_t> out;
+
+        while (p < e) {
+                if (!isdigit(*p)) {
+                        ++p;
+                        continue;
+                }
+
+                uint32_t first{0};
+
+                for (; p < e && isdigit(*p); ++p)
+                        first = first * 10 + (*p - '0');
+
+                auto last{first};
+
+                if (p < e && *p == '-') {
+                        for (last = 0, ++p; p < e && isdigit(*p); ++p)
+                                last = last * 10 + (*p - '0');
+                }
+
+                for (auto i{first}; i <= last && i < std::numeric_limits<uint16_t>::max(); ++i)
+                        out.push_back(i);
+        }
+
+        return out;
+}
+
+static std::vector<uint16_t> read_ids_list(const char *path) {
+        char buf[4096];
+        int  fd = open(path, O_RDONLY);
+
+        if (fd == -1)
+                return {};
+
+        const auto r = read(fd, buf, sizeof(buf));
+
+        close(fd);
+        if (r <= 0)
+                return {};
+
+        return parse_ids_list(buf, buf + r);
+}
+
+std::vector<std::vector<uint16_t>> Trinity::ExecPool::numa_nodes_cpus() {
+        std::vector<std::vector<uint16_t>> out;
+        char                               path[128];
+
+        for (const auto node : read_ids_list("/sys/devices/system/node/online")) {
+                snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", unsigned(node));
+
+                if (auto cpus = read_ids_list(path); !cpus.empty())
+                        out.push_back(std::move(cpus));
+        }
+
+        return out;
+}
+
+Trinity::ExecPool::ExecPool(const uint16_t workersCnt, const bool pinWorkers) {
+        const auto n     = workersCnt ?: std::max<uint16_t>(1, std::thread::hardware_concurrency());
+        const auto nodes = pinWorkers ? numa_nodes_cpus() : std::vector<std::vector<uint16_t>>{};
+
+        for (uint16_t i{0}; i != n; ++i) {
+                auto w = std::make_unique<worker>();
+
+                if (!nodes.empty())
+                        w->node = i % nodes.size();
+                workers.push_back(std::move(w));
+        }
+
+        // Only start them once all workers exist; they will attempt to steal from each other
+        for (uint16_t i{0}; i != n; ++i) {
+                auto w = workers[i].get();
+
+                try {
+                        w->thread = std::thread([this, i]() {
+                                run_worker(i);
+                        });
+                } catch (...) {
+                        shutdown();
+                        throw;
+                }
+
+                if (!nodes.empty()) {
+                        cpu_set_t set;
+
+                        CPU_ZERO(&set);
+                        for (const auto cpu : nodes[w->node])
+                                CPU_SET(cpu, &set);
+
+                        // Best effort; if it fails, e.g because of cgroups restrictions, the worker is just not pinned
+                        pthread_setaffinity_np(w->thread.native_handle(), sizeof(set), &set);
+                }
+        }
+}
+
+void Trinity::ExecPool::shutdown() {
+        {
+                std::lock_guard<std::mutex> g(sleepLock);
+
+                stop = true;
+        }
+
+        sleepCond.notify_all();
+        for (auto &w : workers) {
+                if (w->thread.joinable())
+                        w->thread.join();
+        }
+}
+
+Trinity::ExecPool::~ExecPool() {
+        shutdown();
+}
+
+void Trinity::ExecPool::push(std::function<void()> &&task, const Priority priority) {
+        const auto n = workers.size();
+        auto       w = curWorker.first == this ? workers[curWorker.second].get() : workers[nextQueue.fetch_add(1, std::memory_order_relaxed) % n].get();
+
+        // Account for it before we queue it, so that pending is never lower than the number of queued tasks
+        pending.fetch_add(1, std::memory_order_release);
+
+        {
+                std::lock_guard<std::mutex> g(w->lock);
+
+                w->queues[unsigned(priority)].push_back(std::move(task));
+        }
+
+        // Acquire and release sleepLock so that we won't notify between a worker's check of pending and its wait()
+        {
+                std::lock_guard<std::mutex> g(sleepLock);
+        }
+        sleepCond.notify_one();
+        notify_waiters();
+}
+
+void Trinity::ExecPool::notify_waiters() {
+        events.fetch_add(1, std::memory_order_seq_cst);
+
+        // wait() registers itself as a waiter before it checks events, so either it will see the update, or we will see it
+        if (waiters.load(std::memory_order_seq_cst)) {
+                {
+                        std::lock_guard<std::mutex> g(sleepLock);
+                }
+                waitCond.notify_all();
+        }
+}
+
+bool Trinity::ExecPool::take(const uint16_t self, std::function<void()> *const out, const unsigned first, const unsigned last) {
+        const auto n         = workers.size();
+        const bool isWorker  = self < n;
+        const auto localNode = isWorker ? workers[self]->node : 0;
+
+        if (!pending.load(std::memory_order_acquire))
+                return false;
+
+        for (auto prio{first}; prio <= last; ++prio) {
+                if (isWorker) {
+                        auto                        w = workers[self].get();
+                        std::lock_guard<std::mutex> g(w->lock);
+                        auto &                      q = w->queues[prio];
+
+                        if (!q.empty()) {
+                                *out = std::move(q.back());
+                                q.pop_back();
+                                pending.fetch_sub(1, std::memory_order_relaxed);
+                                return true;
+                        }
+                }
+
+                // Steal; workers of the same node first
+                for (unsigned pass{0}; pass != 2; ++pass) {
+                        for (uint16_t k{1}; k <= n; ++k) {
+                                const uint16_t i = (self + k) % n;
+                                auto           w = workers[i].get();
+
+                                if (i == self || (w->node == localNode) != (pass == 0))
+                                        continue;
+
+                                std::lock_guard<std::mutex> g(w->lock);
+                                auto &                      q = w->queues[prio];
+
+                                if (!q.empty()) {
+                                        *out = std::move(q.front());
+                                        q.pop_front();
+                                        pending.fetch_sub(1, std::memory_order_relaxed);
+                                        return true;
+                                }
+                        }
+                }
+        }
+
+        return false;
+}
+
+bool Trinity::ExecPool::run_pending(const Priority priority) {
+        std::function<void()> task;
+        const uint16_t        self = curWorker.first == this ? curWorker.second : std::numeric_limits<uint16_t>::max();
+
+        if (!take(self, &task, unsigned(priority), unsigned(priority)))
+                return false;
+
+        task();
+        notify_waiters();
+        return true;
+}
+
+void Trinity::ExecPool::run_worker(const uint16_t self) {
+        std::function<void()> task;
+
+        curWorker = {this, self};
+        for (;;) {
+                if (take(self, &task)) {
+                        task();
+                        task = nullptr;
+                        notify_waiters();
+                        continue;
+                }
+
+                std::unique_lock<std::mutex> g(sleepLock);
+
+                sleepCond.wait(g, [this]() {
+                        return stop || pending.load(std::memory_order_acquire);
+                });
+
+                if (stop && !pending.load(std::memory_order_acquire))
+                        return;
+        }
+}
+
+Trinity::ExecPool *Trinity::ExecPool::default_pool() {
+        static ExecPool pool;
+
+        return &pool;
+}
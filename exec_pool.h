@@ -0,0 +1,147 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <switch.h>
+#include <thread>
+#include <vector>
+
+namespace Trinity {
+        // A persistent, work-stealing, threads pool.
+        //
+        // exec_query_par() and friends used to std::async() a new thread for each index source for every query, and at high QPS creating and
+        // tearing down those threads was expensive, and with many concurrent queries we 'd end up with (many) more threads than cores.
+        // Instead, you create an ExecPool once, and schedule work into it.
+        //
+        // - Concurrency is bounded by the number of workers; no matter how many queries are executed concurrently, no more than
+        // that many tasks will be running.
+        // - Each worker owns a queue for each Priority. Tasks scheduled from a worker thread are pushed to that worker's queue(good for locality), otherwise
+        // they are distributed among workers queues. Workers execute their own tasks LIFO, and steal other workers' tasks FIFO once they are out of tasks.
+        // Higher priority tasks are always considered(locally and when stealing) before lower priority tasks, so that e.g interactive queries
+        // are not held back by batch/background queries or merges.
+        // - If pinWorkers is set, workers are distributed across NUMA nodes(as reported by the kernel in /sys/devices/system/node) and each is pinned
+        // to the CPUs of its node. Idle workers will attempt to steal from workers of their node first.
+        //
+        // wait() should be used instead of std::future::get() if you may be waiting from a worker thread; it will execute pending
+        // tasks of the priority the awaited tasks were scheduled with, instead of blocking the worker, so that nested scheduling can't
+        // deadlock the pool. It never executes tasks of other priorities, so that e.g a high priority query won't execute background work inline.
+        class ExecPool final {
+              public:
+                enum class Priority : uint8_t {
+                        High = 0,
+                        Normal,
+                        Low
+                };
+
+              private:
+                static constexpr std::size_t PrioritiesCnt{3};
+
+                struct worker final {
+                        std::mutex                         lock;
+                        std::deque<std::function<void()>> queues[PrioritiesCnt];
+                        uint16_t                           node{0};
+                        std::thread                        thread;
+                };
+
+                std::vector<std::unique_ptr<worker>> workers;
+                std::atomic<std::size_t>             pending{0};
+                std::atomic<uint32_t>                nextQueue{0};
+                std::mutex                           sleepLock;
+                std::condition_variable              sleepCond;
+                bool                                 stop{false};
+                // Bumped whenever a task is queued or completed; wait() blocks on waitCond until it changes
+                std::atomic<uint64_t>                events{0};
+                std::atomic<uint32_t>                waiters{0};
+                std::condition_variable              waitCond;
+
+              private:
+                // Considers tasks of priorities in [first, last]
+                bool take(const uint16_t self, std::function<void()> *const out, const unsigned first = 0, const unsigned last = PrioritiesCnt - 1);
+
+                void notify_waiters();
+
+                void push(std::function<void()> &&task, const Priority priority);
+
+                void run_worker(const uint16_t self);
+
+                void shutdown();
+
+                static std::vector<std::vector<uint16_t>> numa_nodes_cpus();
+
+              public:
+                // If workersCnt is 0, std::thread::hardware_concurrency() workers are created
+                ExecPool(const uint16_t workersCnt = 0, const bool pinWorkers = false);
+
+                ~ExecPool();
+
+                auto size() const noexcept {
+                        return workers.size();
+                }
+
+                // Executes one pending task of the given priority, if any, in the calling thread
+                // Returns false if there were no such tasks to execute
+                bool run_pending(const Priority priority);
+
+                template <typename F>
+                auto schedule(F &&f, const Priority priority = Priority::Normal) {
+                        using R = decltype(f());
+                        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+                        auto res  = task->get_future();
+
+                        push([task]() { (*task)(); }, priority);
+                        return res;
+                }
+
+                // priority should be the priority f's task was scheduled with
+                template <typename T>
+                T wait(std::future<T> &f, const Priority priority = Priority::Normal) {
+                        while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                                const auto gen = events.load(std::memory_order_seq_cst);
+
+                                if (run_pending(priority) || f.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                                        continue;
+                                }
+
+                                // Nothing we can help with; block until a task is queued or completed
+                                std::unique_lock<std::mutex> g(sleepLock);
+
+                                waiters.fetch_add(1, std::memory_order_seq_cst);
+                                waitCond.wait(g, [this, gen]() {
+                                        return events.load(std::memory_order_seq_cst) != gen;
+                                });
+                                waiters.fetch_sub(1, std::memory_order_relaxed);
+                        }
+                        return f.get();
+                }
+
+                // Waits for all futures, even if any of them failed, and then either returns their values
+                // or rethrows the first exception. Unlike with std::async() futures, destroying a future
+                // we got from schedule() won't block, so make sure you wait for all tasks that reference your state.
+                template <typename T>
+                std::vector<T> wait_all(std::vector<std::future<T>> &futures, const Priority priority = Priority::Normal) {
+                        std::vector<T>     out;
+                        std::exception_ptr e;
+
+                        for (auto &f : futures) {
+                                try {
+                                        out.push_back(wait(f, priority));
+                                } catch (...) {
+                                        if (!e)
+                                                e = std::current_exception();
+                                }
+                        }
+
+                        futures.clear();
+                        if (e)
+                                std::rethrow_exception(e);
+
+                        return out;
+                }
+
+                // A process-wide pool, created on first use, with std::thread::hardware_concurrency() workers
+                // This is what exec_query_par() uses unless you provide your own pool.
+                static ExecPool *default_pool();
+        };
+} // namespace Trinity
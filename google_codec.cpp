@@ -632,6 +632,7 @@ void Trinity::Codecs::Google::Decoder::unpack_block(PostingsListIterator *const
         it->p              = p;
         it->blockLastDocID = thisBlockLastDocID;
         documents[k]       = thisBlockLastDocID;
+        decodedPostings += n;
 
         // We don't need to track current block documents cnt, because
         // we can just check if (documents[blockDocIdx] == blockLastDocID)
@@ -5,15 +5,35 @@ void Trinity::IndexSourcesCollection::commit() {
                 return b->generation() < a->generation();
         });
 
+        uint64_t maskingSignature = BeginFNVHash64();
+
         map.clear();
         all.clear();
+        maskingSignatures.clear();
         for (auto s : sources) {
                 auto ud = s->masked_documents();
 
                 map.push_back({s, all.size()});
-                if (ud)
+                maskingSignatures.push_back(maskingSignature);
+                if (ud) {
+                        const auto gen = s->generation();
+
                         all.push_back(ud);
+                        maskingSignature = FNVHash64(maskingSignature, reinterpret_cast<const uint8_t *>(&gen), sizeof(gen));
+                }
+        }
+}
+
+uint64_t Trinity::IndexSourcesCollection::signature() const noexcept {
+        uint64_t h = BeginFNVHash64();
+
+        for (const auto s : sources) {
+                const auto gen = s->generation();
+
+                h = FNVHash64(h, reinterpret_cast<const uint8_t *>(&gen), sizeof(gen));
         }
+
+        return h;
 }
 
 Trinity::IndexSourcesCollection::~IndexSourcesCollection() {
@@ -28,3 +48,95 @@ std::unique_ptr<Trinity::masked_documents_registry> Trinity::IndexSourcesCollect
 
         return masked_documents_registry::make(all.data(), n);
 }
+
+#pragma mark term_ctx_cache
+Trinity::term_ctx_cache::~term_ctx_cache() {
+        for (auto &it : shards) {
+                delete[] it.buckets.load(std::memory_order_relaxed);
+        }
+}
+
+bool Trinity::term_ctx_cache::lookup(const str8_t term, const uint64_t h, term_index_ctx *const out) const noexcept {
+        const auto buckets = shards[h % SHARDS].buckets.load(std::memory_order_acquire);
+
+        if (!buckets) {
+                return false;
+        }
+
+        const auto &b = buckets[bucket_index(h)];
+
+        for (const auto &it : b.slots) {
+                const auto seq = it.seq.load(std::memory_order_acquire);
+
+                if (seq & 1) {
+                        // being updated
+                        continue;
+                }
+
+                const auto len        = it.len;
+                const auto hash       = it.hash;
+                const auto documents  = it.documents;
+                const auto indexChunk = it.indexChunk;
+                const bool match      = len && hash == h && len == term.size() && !memcmp(it.key, term.data(), len);
+
+                // if the slot was updated while we were reading it, we can't trust what we read
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (it.seq.load(std::memory_order_relaxed) != seq) {
+                        continue;
+                }
+
+                if (match) {
+                        *out = term_index_ctx(documents, indexChunk);
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+void Trinity::term_ctx_cache::insert(const str8_t term, const uint64_t h, const term_index_ctx tctx) {
+        if (!term.size() || term.size() > Limits::MaxTermLength) {
+                return;
+        }
+
+        auto &                      s = shards[h % SHARDS];
+        std::lock_guard<std::mutex> g(s.lock);
+        auto                        buckets = s.buckets.load(std::memory_order_relaxed);
+
+        if (!buckets) {
+                buckets = new bucket[bucketsPerShard];
+                s.buckets.store(buckets, std::memory_order_release);
+        }
+
+        auto &b      = buckets[bucket_index(h)];
+        slot *target = nullptr;
+
+        for (auto &it : b.slots) {
+                if (!it.len) {
+                        if (!target) {
+                                target = &it;
+                        }
+                } else if (it.hash == h && it.len == term.size() && !memcmp(it.key, term.data(), term.size())) {
+                        // another thread resolved it first
+                        return;
+                }
+        }
+
+        if (!target) {
+                target = b.slots + b.next;
+                b.next = (b.next + 1) % WAYS;
+        }
+
+        const auto seq = target->seq.load(std::memory_order_relaxed);
+
+        target->seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        target->len        = term.size();
+        target->hash       = h;
+        target->documents  = tctx.documents;
+        target->indexChunk = tctx.indexChunk;
+        memcpy(target->key, term.data(), term.size());
+
+        target->seq.store(seq + 2, std::memory_order_release);
+}
@@ -1,12 +1,77 @@
 #pragma once
 #include "codecs.h"
+#include "trinity_limits.h"
+#include <atomic>
 #include <mutex>
 #include <switch.h>
 #include <switch_dictionary.h>
+#include <switch_hash.h>
 #include <switch_mallocators.h>
 #include <switch_refcnt.h>
 
 namespace Trinity {
+        struct IndexSourceTermsView; // terms.h
+
+        // A concurrent, bounded, cache of term_index_ctx; see IndexSource::term_ctx()
+        //
+        // We used to use a std::unordered_map<> guarded by a mutex, but with many threads executing queries on the same sources
+        // that lock was heavily contended, and the map would grow without bounds for long-lived sources.
+        //
+        // Lookups don't lock; each slot is protected by a sequence lock, so readers just retry(or consider it a miss) if they raced with a writer.
+        // Inserts lock the shard of the term. The cache is set-associative; a term can only be cached in one of the WAYS slots
+        // of its bucket, and if they are all in use, the least recently inserted term of the bucket is evicted.
+        // The slots of a shard are allocated the first time a term is inserted in it.
+        class term_ctx_cache final {
+              public:
+                static constexpr std::size_t SHARDS{64};
+                static constexpr std::size_t WAYS{4};
+                static constexpr std::size_t DefaultCapacity{16384};
+
+              private:
+                struct slot final {
+                        std::atomic<uint32_t> seq{0}; // odd while the slot is being updated
+                        uint8_t               len{0}; // 0 if the slot is not used
+                        uint64_t              hash;
+                        uint32_t              documents;
+                        range32_t             indexChunk;
+                        char                  key[Limits::MaxTermLength];
+                };
+
+                struct bucket final {
+                        slot    slots[WAYS];
+                        uint8_t next{0}; // next slot to evict; only accessed with the shard locked
+                };
+
+                struct shard final {
+                        std::mutex            lock;
+                        std::atomic<bucket *> buckets{nullptr};
+                } shards[SHARDS];
+
+                const uint32_t bucketsPerShard;
+
+              private:
+                inline auto bucket_index(const uint64_t h) const noexcept {
+                        return (h / SHARDS) % bucketsPerShard;
+                }
+
+              public:
+                // capacity is in terms
+                term_ctx_cache(const std::size_t capacity = DefaultCapacity)
+                    : bucketsPerShard(std::max<std::size_t>(1, capacity / (SHARDS * WAYS))) {
+                }
+
+                ~term_ctx_cache();
+
+                static inline uint64_t hash(const str8_t term) noexcept {
+                        return FNVHash64(reinterpret_cast<const uint8_t *>(term.data()), term.size());
+                }
+
+                // h is hash(term)
+                bool lookup(const str8_t term, const uint64_t h, term_index_ctx *const out) const noexcept;
+
+                void insert(const str8_t term, const uint64_t h, const term_index_ctx tctx);
+        };
+
         // An index source provides term_index_ctx and decoders to the query execution runtime
         // It can be a RO wrapper to an index segment, a wrapper to a simple hashtable/list, anything
         // Lucene implements near real-time search by providing a segment wrapper(i.e index source) which accesses the indexer state directly
@@ -18,10 +83,8 @@ namespace Trinity {
         class IndexSource
             : public RefCounted<IndexSource> {
               protected:
-                std::mutex                                 cacheLock;
-                simple_allocator                           keysAllocator{512};
-                std::unordered_map<str8_t, term_index_ctx> cache;
-                uint64_t                                   gen{0}; // See IndexSourcesCollection
+                term_ctx_cache termsCache;
+                uint64_t       gen{0}; // See IndexSourcesCollection
 
               public:
                 // We currently don't support multiple fields
@@ -50,25 +113,72 @@ namespace Trinity {
                         uint64_t sumTermsDocs{0}; // lucene: Terms##getSumDocFreq() sum of TermsIndexEnum::docFreq()
                                                   // Total distinct docments that have at least one term for this "field"
                         uint32_t docsCnt{0};
+
+                        // Lowest and highest document IDs indexed in this source, or 0 if not known
+                        // Those are only used as a hint, so they don't need to be exact. See exec_query_par_partitioned()
+                        isrc_docid_t lowestDocID{0};
+                        isrc_docid_t highestDocID{0};
+
+                        inline void track_document_id(const isrc_docid_t id) noexcept {
+                                if (!lowestDocID || id < lowestDocID)
+                                        lowestDocID = id;
+                                if (id > highestDocID)
+                                        highestDocID = id;
+                        }
                 };
 
               public:
+                // termsCacheCapacity is the maximum number of terms term_ctx() will cache
+                IndexSource(const std::size_t termsCacheCapacity = term_ctx_cache::DefaultCapacity)
+                    : termsCache(termsCacheCapacity) {
+                }
+
                 inline auto generation() const noexcept {
                         return gen;
                 }
 
                 term_index_ctx term_ctx(const str8_t term) {
-                        [[maybe_unused]] static constexpr bool trace{false};
-                        std::lock_guard<std::mutex>            g(cacheLock);
+                        const auto     h = term_ctx_cache::hash(term);
+                        term_index_ctx res;
+
+                        if (termsCache.lookup(term, h, &res)) {
+                                return res;
+                        }
+
+                        // If multiple threads miss concurrently, they will all resolve it, but that's
+                        // preferable to having them wait for each other
+                        res = resolve_term_ctx(term);
+                        termsCache.insert(term, h, res);
+                        return res;
+                }
+
+                // Resolves terms[i] to out[i], for each of the n terms, which must be sorted(see terms_cmp())
+                // The terms that are not cached are resolved together, with a single resolve_terms_ctx() call.
+                void terms_ctx(const str8_t *const terms, const std::size_t n, term_index_ctx *const out) {
+                        // n is not bounded(e.g tokens expansions), so we don't use the stack here
+                        std::vector<str8_t>   missTerms;
+                        std::vector<uint32_t> missIndices;
+                        std::vector<uint64_t> missHashes;
 
-                        auto p = cache.insert({term, {}});
+                        for (std::size_t i{0}; i != n; ++i) {
+                                const auto h = term_ctx_cache::hash(terms[i]);
 
-                        if (p.second) {
-                                const_cast<str8_t *>(&p.first->first)->Set(keysAllocator.CopyOf(term.data(), term.size()), term.size());
-                                p.first->second = resolve_term_ctx(term);
+                                if (!termsCache.lookup(terms[i], h, out + i)) {
+                                        missTerms.push_back(terms[i]);
+                                        missIndices.push_back(i);
+                                        missHashes.push_back(h);
+                                }
                         }
 
-                        return p.first->second;
+                        if (const auto misses = missTerms.size()) {
+                                std::vector<term_index_ctx> resolved(misses);
+
+                                resolve_terms_ctx(missTerms.data(), misses, resolved.data());
+                                for (std::size_t i{0}; i != misses; ++i) {
+                                        out[missIndices[i]] = resolved[i];
+                                        termsCache.insert(missTerms[i], missHashes[i], resolved[i]);
+                                }
+                        }
                 }
 
 #if 0 // This would probably be a good idea, but we don't need this, and it would make some optimisations in updated_documents_scanner::test() possible because                     \
@@ -97,6 +207,21 @@ namespace Trinity {
 
                 virtual term_index_ctx resolve_term_ctx(const str8_t term) = 0;
 
+                // Resolves terms[i] to out[i], for each of the n sorted terms; see terms_ctx()
+                // Override it if your source can resolve multiple terms faster than one at a time(e.g see SegmentIndexSource)
+                virtual void resolve_terms_ctx(const str8_t *const terms, const std::size_t n, term_index_ctx *const out) {
+                        for (std::size_t i{0}; i != n; ++i) {
+                                out[i] = resolve_term_ctx(terms[i]);
+                        }
+                }
+
+                // Returns a view of the terms of this source that begin with prefix(all terms, if prefix is empty), in order, or nullptr if
+                // the source can't enumerate its terms. This is used for expanding query tokens(see phrase::expansion), but you can also use
+                // it for e.g autocompletion. You are responsible for deleting the view.
+                virtual IndexSourceTermsView *new_terms_view(const str8_t prefix) {
+                        return nullptr;
+                }
+
                 // For performance reasons, if you are going to perform any kind of translation in your translate_docid()
                 // then you should also implement and override this method, and return true, so that the exec.engine
                 // will know if it needs to invoke the virtual method translate_docid() or not. This is for performance reasons.
@@ -220,6 +345,8 @@ namespace Trinity {
                 // for each source, we track how many of the first update_documents in all[]
                 // we should consider for masking documents
                 std::vector<std::pair<IndexSource *, uint16_t>> map;
+                // for each source, a signature of the generations of the sources whose updated_documents we consider for masking its documents
+                std::vector<uint64_t> maskingSignatures;
 
               public:
                 std::vector<IndexSource *> sources;
@@ -235,5 +362,14 @@ namespace Trinity {
                 void commit();
 
                 std::unique_ptr<Trinity::masked_documents_registry> scanner_registry_for(const uint16_t idx);
+
+                // If the signature for a source is the same in two collections, then scanner_registry_for() that source
+                // will mask the same documents in both of them. See QueryResultsCache
+                inline uint64_t masking_signature(const uint16_t idx) const noexcept {
+                        return maskingSignatures[idx];
+                }
+
+                // A signature of the generations of all sources in the collection
+                uint64_t signature() const noexcept;
         };
 } // namespace Trinity
@@ -265,9 +265,14 @@ void Trinity::persist_segment(const Trinity::IndexSource::field_statistics &fs,
         const auto codecID = sess->codec_identifier();
         IOBuffer   b;
 
-        b.pack(uint8_t(1), codecID.size());
+        // release 2 also tracks the codec format version
+        // release 3 also tracks the documents IDs bounds
+        // see SegmentIndexSource::SegmentIndexSource()
+        b.pack(uint8_t(3), codecID.size());
         b.serialize(codecID.data(), codecID.size());
         b.pack(fs.sumTermHits, fs.totalTerms, fs.sumTermsDocs, fs.docsCnt);
+        b.pack(sess->format_version());
+        b.pack(fs.lowestDocID, fs.highestDocID);
 
         if (write(fd, b.data(), b.size()) != b.size()) {
                 close(fd);
@@ -315,6 +320,8 @@ void SegmentIndexSession::commit(Trinity::Codecs::IndexSession *const sess) {
                 uint32_t     hitsOffset;
                 uint16_t     hitsCnt; // XXX: see comments earlier
                 uint8_t      rangeIdx;
+                // encoded document length norm; see Codecs::encode_norm()
+                uint8_t norm;
         };
 
         static constexpr bool                        trace{false};
@@ -337,6 +344,9 @@ void SegmentIndexSession::commit(Trinity::Codecs::IndexSession *const sess) {
         const auto scan = [&defaultFieldStats = this->defaultFieldStats, flushFreq = this->flushFreq, indexFd, enc = enc_.get(), &map, sess](const auto &ranges) {
                 uint8_t                   payloadSize;
                 std::vector<segment_data> all[32];
+                // (all[] index, offset) of the current document's segment_data, so that we can set the norm
+                // once we have processed all the document's terms
+                std::vector<std::pair<uint8_t, uint32_t>> docSegmentData;
                 term_index_ctx            tctx;
                 const auto                R = ranges.data();
                 uint64_t                  before;
@@ -364,7 +374,11 @@ void SegmentIndexSession::commit(Trinity::Codecs::IndexSession *const sess) {
                                 }
 
                                 ++defaultFieldStats.docsCnt;
+                                defaultFieldStats.track_document_id(documentID);
 
+                                uint32_t documentLength{0};
+
+                                docSegmentData.clear();
                                 do {
                                         const auto term = *(uint32_t *)p;
                                         p += sizeof(uint32_t);
@@ -385,8 +399,17 @@ void SegmentIndexSession::commit(Trinity::Codecs::IndexSession *const sess) {
                                                 p += payloadSize;
                                         } while (--hitsCnt);
 
-                                        all[term & (sizeof_array(all) - 1)].emplace_back(segment_data{term, documentID, uint32_t(base - data), saved, i});
+                                        auto &v = all[term & (sizeof_array(all) - 1)];
+
+                                        docSegmentData.emplace_back(term & (sizeof_array(all) - 1), v.size());
+                                        v.emplace_back(segment_data{term, documentID, uint32_t(base - data), saved, i, 0});
+                                        documentLength += saved;
                                 } while (--termsCnt);
+
+                                const auto norm = Codecs::encode_norm(documentLength);
+
+                                for (const auto &it : docSegmentData)
+                                        all[it.first][it.second].norm = norm;
                         }
                 }
                 if (trace)
@@ -446,6 +469,7 @@ void SegmentIndexSession::commit(Trinity::Codecs::IndexSession *const sess) {
                                         defaultFieldStats.sumTermHits += hitsCnt;
 
                                         enc->begin_document(documentID);
+                                        enc->document_norm(it->norm);
                                         for (uint32_t i{0}; i != hitsCnt; ++i) {
                                                 varbyte_get32(p, _t);
                                                 const auto deltaMask{_t};
@@ -2,10 +2,11 @@
 #include "utils.h"
 #include <ansifmt.h>
 #include <switch_bitops.h>
-#ifdef LUCENE_USE_STREAMVBYTE
+#ifdef LUCENE_HAVE_STREAMVBYTE
 #include <ext/streamvbyte/include/streamvbyte.h>
 #include <ext/streamvbyte/include/streamvbytedelta.h>
-#elif defined(LUCENE_USE_MASKEDVBYTE)
+#endif
+#ifdef LUCENE_HAVE_MASKEDVBYTE
 #include <ext/MaskedVByte/include/varintdecode.h>
 #include <ext/MaskedVByte/include/varintencode.h>
 #endif
@@ -22,55 +23,78 @@ static bool all_equal(const uint32_t *const __restrict__ values, const size_t n)
         return true;
 }
 
-#ifdef LUCENE_USE_FASTPFOR
-static void ints_encode(FastPForLib::FastPFor<4> &forUtil, const uint32_t *values, const size_t n, IOBuffer &out)
-#else
-static void           ints_encode(const uint32_t *values, const size_t n, IOBuffer &out)
-#endif
-{
+static inline uint64_t load_u64(const uint8_t *const p) noexcept {
+        uint64_t v;
+
+        memcpy(&v, p, sizeof(uint64_t));
+        return v;
+}
+
+// Frequency of the i-th document of a dense chunk(see DENSE_CHUNK)
+// may read past the last frequency, see DENSE_CHUNK_PADDING
+static inline uint32_t dense_chunk_freq(const uint8_t *const freqs, const uint32_t minFreq, const uint8_t width, const uint32_t i) noexcept {
+        if (width) {
+                const uint64_t bit = uint64_t(i) * width;
+
+                return minFreq + uint32_t((load_u64(freqs + (bit >> 3)) >> (bit & 7)) & ((uint64_t(1) << width) - 1));
+        } else {
+                return minFreq;
+        }
+}
+
+// The encoding is selected per segment; see Lucene::Encoding
+static void ints_encode(const Trinity::Codecs::Lucene::Encoding encoding, FastPForLib::FastPFor<4> &forUtil, const uint32_t *values, const size_t n, IOBuffer &out) {
         if (all_equal(values, n)) {
                 if (trace) {
                         SLog("ENCODING all equal ", values[0], "\n");
-		}
+                }
 
                 out.pack(uint8_t(0));
                 out.encode_varbyte32(values[0]);
                 return;
         }
 
-#ifdef LUCENE_USE_STREAMVBYTE
-        out.reserve(n * 8 + 256);
-        out.pack(uint8_t(1));
+        switch (encoding) {
+                case Trinity::Codecs::Lucene::Encoding::PFOR: {
+                        const auto offset = out.size();
 
-        const auto len = streamvbyte_encode(const_cast<uint32_t *>(values), n, reinterpret_cast<uint8_t *>(out.end()));
+                        out.RoomFor(sizeof(uint8_t));
+                        out.reserve((n + n) * sizeof(uint32_t));
+                        auto l = out.capacity() / sizeof(uint32_t);
+                        forUtil.encodeArray(values, n, (uint32_t *)out.end(), l);
+                        out.advance_size(l * sizeof(uint32_t));
+                        *(out.data() + offset) = l; // this is great, means we can skip ahead n * sizeof(uint32_t) bytes to get to the next block
+                } break;
 
-        out.advance_size(len);
+#ifdef LUCENE_HAVE_STREAMVBYTE
+                case Trinity::Codecs::Lucene::Encoding::StreamVByte: {
+                        out.reserve(n * 8 + 256);
+                        out.pack(uint8_t(1));
 
-#elif defined(LUCENE_USE_MASKEDVBYTE)
-        out.reserve(n * 8);
-        out.pack(uint8_t(1));
+                        const auto len = streamvbyte_encode(const_cast<uint32_t *>(values), n, reinterpret_cast<uint8_t *>(out.end()));
 
-        const auto len = vbyte_encode(const_cast<uint32_t *>(values), n, (uint8_t *)out.end());
+                        out.advance_size(len);
+                } break;
+#endif
 
-        out.advance_size(len);
-#else
-        const auto offset = out.size();
-
-        out.RoomFor(sizeof(uint8_t));
-        out.reserve((n + n) * sizeof(uint32_t));
-        auto l = out.capacity() / sizeof(uint32_t);
-        forUtil.encodeArray(values, n, (uint32_t *)out.end(), l);
-        out.advance_size(l * sizeof(uint32_t));
-        *(out.data() + offset) = l; // this is great, means we can skip ahead n * sizeof(uint32_t) bytes to get to the next block
+#ifdef LUCENE_HAVE_MASKEDVBYTE
+                case Trinity::Codecs::Lucene::Encoding::MaskedVByte: {
+                        out.reserve(n * 8);
+                        out.pack(uint8_t(1));
+
+                        const auto len = vbyte_encode(const_cast<uint32_t *>(values), n, (uint8_t *)out.end());
+
+                        out.advance_size(len);
+                } break;
 #endif
+
+                default:
+                        // IndexSession and AccessProxy won't accept encodings not supported by this build
+                        std::abort();
+        }
 }
 
-#ifdef LUCENE_USE_FASTPFOR
-static const uint8_t *ints_decode(FastPForLib::FastPFor<4> &forUtil, const uint8_t *__restrict p, uint32_t *const __restrict values)
-#else
-          static const uint8_t *ints_decode(const uint8_t *__restrict p, uint32_t *const __restrict values)
-#endif
-{
+static const uint8_t *ints_decode(const Trinity::Codecs::Lucene::Encoding encoding, FastPForLib::FastPFor<4> &forUtil, const uint8_t *__restrict p, uint32_t *const __restrict values) {
         if (const auto blockSize = *p++; blockSize == 0) {
                 // all equal values
                 uint32_t value;
@@ -83,22 +107,104 @@ static const uint8_t *ints_decode(FastPForLib::FastPFor<4> &forUtil, const uint8
                 for (size_t i{0}; i != Trinity::Codecs::Lucene::BLOCK_SIZE; ++i)
                         values[i] = value;
         } else {
-#ifdef LUCENE_USE_STREAMVBYTE
-                p += streamvbyte_decode(p, values, Trinity::Codecs::Lucene::BLOCK_SIZE);
-#elif defined(LUCENE_USE_MASKEDVBYTE)
-                p += masked_vbyte_decode(p, values, Trinity::Codecs::Lucene::BLOCK_SIZE);
-#else
-                size_t      n{Trinity::Codecs::Lucene::BLOCK_SIZE};
-                const auto *ptr = reinterpret_cast<const uint32_t *>(p);
+                switch (encoding) {
+                        case Trinity::Codecs::Lucene::Encoding::PFOR: {
+                                size_t      n{Trinity::Codecs::Lucene::BLOCK_SIZE};
+                                const auto *ptr = reinterpret_cast<const uint32_t *>(p);
+
+                                ptr = forUtil.decodeArray(ptr, blockSize, values, n);
+                                p   = reinterpret_cast<const uint8_t *>(ptr);
+                        } break;
+
+#ifdef LUCENE_HAVE_STREAMVBYTE
+                        case Trinity::Codecs::Lucene::Encoding::StreamVByte:
+                                p += streamvbyte_decode(p, values, Trinity::Codecs::Lucene::BLOCK_SIZE);
+                                break;
+#endif
 
-                ptr = forUtil.decodeArray(ptr, blockSize, values, n);
-                p   = reinterpret_cast<const uint8_t *>(ptr);
+#ifdef LUCENE_HAVE_MASKEDVBYTE
+                        case Trinity::Codecs::Lucene::Encoding::MaskedVByte:
+                                p += masked_vbyte_decode(p, values, Trinity::Codecs::Lucene::BLOCK_SIZE);
+                                break;
 #endif
+
+                        default:
+                                std::abort();
+                }
         }
 
         return p;
 }
 
+// Returns a pointer past an ints_encode() encoded block, without decoding it
+static const uint8_t *ints_skip(const Trinity::Codecs::Lucene::Encoding encoding, const uint8_t *__restrict p) {
+        if (const auto blockSize = *p++; blockSize == 0) {
+                uint32_t value;
+
+                varbyte_get32(p, value);
+                return p;
+        } else {
+                switch (encoding) {
+                        case Trinity::Codecs::Lucene::Encoding::PFOR:
+                                return p + blockSize * sizeof(uint32_t);
+
+#ifdef LUCENE_HAVE_STREAMVBYTE
+                        case Trinity::Codecs::Lucene::Encoding::StreamVByte: {
+                                // 2bits key/value(length - 1), followed by the values
+                                static constexpr size_t keysSize{(Trinity::Codecs::Lucene::BLOCK_SIZE + 3) / 4};
+                                size_t                  len{Trinity::Codecs::Lucene::BLOCK_SIZE};
+
+                                for (size_t i{0}; i != keysSize; ++i) {
+                                        const auto k = p[i];
+
+                                        len += (k & 3) + ((k >> 2) & 3) + ((k >> 4) & 3) + (k >> 6);
+                                }
+                                return p + keysSize + len;
+                        }
+#endif
+
+#ifdef LUCENE_HAVE_MASKEDVBYTE
+                        case Trinity::Codecs::Lucene::Encoding::MaskedVByte:
+                                for (size_t n{0}; n != Trinity::Codecs::Lucene::BLOCK_SIZE; ++p)
+                                        n += !(*p & 0x80);
+                                return p;
+#endif
+
+                        default:
+                                std::abort();
+                }
+        }
+}
+
+strwlen8_t Trinity::Codecs::Lucene::codec_identifier(const Encoding e) noexcept {
+        if (e == Encoding::LUCENE_LEGACY_ENCODING)
+                return "LUCENE"_s8;
+
+        switch (e) {
+                case Encoding::PFOR:
+                        return "LUCENE/PFOR"_s8;
+
+                case Encoding::StreamVByte:
+                        return "LUCENE/STREAMVBYTE"_s8;
+
+                case Encoding::MaskedVByte:
+                        return "LUCENE/MASKEDVBYTE"_s8;
+        }
+
+        return "LUCENE"_s8;
+}
+
+bool Trinity::Codecs::Lucene::encoding_for_codec_identifier(const strwlen8_t id, Encoding *const e) noexcept {
+        for (const auto it : {Encoding::PFOR, Encoding::StreamVByte, Encoding::MaskedVByte}) {
+                if (id == codec_identifier(it)) {
+                        *e = it;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
 void Trinity::Codecs::Lucene::IndexSession::begin() {
         // We will need two extra/additional buffers, one for documents, another for the hits
         // TODO: we really need to do the right thing here, reset etc
@@ -136,11 +242,30 @@ void Trinity::Codecs::Lucene::IndexSession::end() {
         }
 }
 
+// Format 0 skiplist entries don't track impacts, but we can derive an upper bound of a block's max freq
+// from the total hits before the first document of adjacent blocks; that's the sum of the block's documents freqs.
+// The last entry's bound also accounts for the tail block, for we can't tell them apart.
+static inline uint32_t v0_skiplist_entry_hits_before(const uint8_t *const e) noexcept {
+        static constexpr size_t skiplistEntrySize{Trinity::Codecs::Lucene::skiplist_entry_size(0)};
+
+        return reinterpret_cast<const uint32_t *>(e)[4] + *(uint16_t *)(e + skiplistEntrySize - sizeof(uint16_t));
+}
+
+static inline uint16_t v0_skiplist_entry_max_freq(const uint8_t *const e, const uint8_t *const end, const uint32_t totalHits) noexcept {
+        static constexpr size_t skiplistEntrySize{Trinity::Codecs::Lucene::skiplist_entry_size(0)};
+        const auto              next = e + skiplistEntrySize;
+        const auto              upto = next == end ? totalHits : v0_skiplist_entry_hits_before(next);
+
+        return std::min<uint32_t>(upto - v0_skiplist_entry_hits_before(e), UINT16_MAX);
+}
+
 range32_t Trinity::Codecs::Lucene::IndexSession::append_index_chunk(const Trinity::Codecs::AccessProxy *src_, const term_index_ctx srcTCTX) {
         const auto src = static_cast<const Trinity::Codecs::Lucene::AccessProxy *>(src_);
         const auto o   = indexOut.size() + indexOutFlushed;
 
         require(srcTCTX.indexChunk.size());
+        // same codec identifier
+        require(src->encoding == encoding);
 
         auto *p = src->indexPtr + srcTCTX.indexChunk.offset, *const end = p + srcTCTX.indexChunk.size();
         const auto hitsDataOffset = *(uint32_t *)p;
@@ -153,11 +278,57 @@ range32_t Trinity::Codecs::Lucene::IndexSession::append_index_chunk(const Trinit
         p += sizeof(uint16_t);
         const auto newHitsDataOffset = positionsOut.size() + positionsOutFlushed;
 
+        // Older formats skiplists may use DENSE_CHUNK entries; we drop the last entry and account for it in the tail block impacts
+        const uint16_t newSkiplistSize = src->formatVersion == FORMAT_VERSION ? skiplistSize : std::min<uint16_t>(skiplistSize, DENSE_CHUNK - 1);
+
         positionsOut.serialize(src->hitsDataPtr + hitsDataOffset, positionsChunkSize);
-        indexOut.pack(uint32_t(newHitsDataOffset), sumHits, positionsChunkSize, skiplistSize);
-        indexOut.serialize(p, end - p);
+        indexOut.pack(uint32_t(newHitsDataOffset), sumHits, positionsChunkSize, newSkiplistSize);
+
+        if (src->formatVersion == FORMAT_VERSION || (src->formatVersion && newSkiplistSize == skiplistSize)) {
+                // format 1 chunks are also valid format 2 chunks
+                indexOut.serialize(p, end - p);
+        } else {
+                // we need to upgrade the skiplist and the tail block impacts
+                const auto skiplistEntrySize = skiplist_entry_size(src->formatVersion);
+                const auto skiplistBase      = end - chunk_trailer_size(src->formatVersion, skiplistSize);
+                const auto skiplistEnd       = skiplistBase + skiplistSize * skiplistEntrySize;
+                uint16_t   tailMaxFreq, i{0};
+                uint8_t    tailMinNorm;
+
+                require(src->formatVersion < FORMAT_VERSION);
+                if (src->formatVersion) {
+                        tailMaxFreq = *(uint16_t *)skiplistEnd;
+                        tailMinNorm = skiplistEnd[sizeof(uint16_t)];
+                } else {
+                        tailMaxFreq = std::min<uint32_t>(sumHits, UINT16_MAX);
+                        tailMinNorm = 0;
+                }
+
+                indexOut.serialize(p, skiplistBase - p);
+
+                for (const auto *it = skiplistBase; it != skiplistEnd; it += skiplistEntrySize, ++i) {
+                        const auto e                = reinterpret_cast<const uint32_t *>(it);
+                        const auto curHitsBlockHits = *(uint16_t *)(it + sizeof(uint32_t) * 5);
+                        const auto maxFreq          = src->formatVersion ? *(uint16_t *)(it + sizeof(uint32_t) * 5 + sizeof(uint16_t)) : v0_skiplist_entry_max_freq(it, skiplistEnd, sumHits);
+                        const auto minNorm          = src->formatVersion ? it[sizeof(uint32_t) * 5 + sizeof(uint16_t) + sizeof(uint16_t)] : uint8_t(0);
+
+                        if (i < newSkiplistSize) {
+                                indexOut.pack(e[0], e[1], e[2], e[3], e[4], curHitsBlockHits, maxFreq, minNorm);
+
+                                if (!src->formatVersion) {
+                                        // the last entry's bound also covers the tail block
+                                        tailMaxFreq = maxFreq;
+                                }
+                        } else {
+                                tailMaxFreq = std::max(tailMaxFreq, maxFreq);
+                                tailMinNorm = std::min(tailMinNorm, minNorm);
+                        }
+                }
 
-        return {uint32_t(o), srcTCTX.indexChunk.size()};
+                indexOut.pack(tailMaxFreq, tailMinNorm);
+        }
+
+        return {uint32_t(o), uint32_t((indexOut.size() + indexOutFlushed) - o)};
 }
 
 void Trinity::Codecs::Lucene::Encoder::begin_term() {
@@ -173,7 +344,12 @@ void Trinity::Codecs::Lucene::Encoder::begin_term() {
         lastHitsBlockOffset    = 0;
         lastHitsBlockTotalHits = 0;
         skiplistCountdown      = SKIPLIST_STEP;
+        untrackedMaxFreq       = 0;
+        untrackedMinNorm       = UINT8_MAX;
+        termMinNorm            = UINT8_MAX;
         skiplist.clear();
+        termDocIDs.clear();
+        termDocFreqs.clear();
 
         sess->indexOut.pack(uint32_t(termPositionsOffset), uint32_t(0), uint32_t(0), uint16_t(0)); // will fill in later. Will also track positions chunk size for efficient merge
 }
@@ -185,22 +361,21 @@ void Trinity::Codecs::Lucene::Encoder::output_block() {
         require(buffered == BLOCK_SIZE);
 
         if (--skiplistCountdown == 0) {
-                if (likely(skiplist.size() < UINT16_MAX)) {
+                if (likely(skiplist.size() < DENSE_CHUNK - 1)) {
                         // keep it sane
                         skiplist.push_back(cur_block);
+                } else {
+                        // impacts of blocks past the last skiplist entry are accounted for in the tail block impacts
+                        untrackedMaxFreq = std::max(untrackedMaxFreq, cur_block.maxFreq);
+                        untrackedMinNorm = std::min(untrackedMinNorm, cur_block.minNorm);
                 }
                 skiplistCountdown = SKIPLIST_STEP;
         }
 
         auto indexOut = &sess->indexOut;
 
-#ifdef LUCENE_USE_FASTPFOR
-        ints_encode(*forUtil, docDeltas, buffered, *indexOut);
-        ints_encode(*forUtil, docFreqs, buffered, *indexOut);
-#else
-                  ints_encode(docDeltas, buffered, *indexOut);
-                  ints_encode(docFreqs, buffered, *indexOut);
-#endif
+        ints_encode(encoding, *forUtil, docDeltas, buffered, *indexOut);
+        ints_encode(encoding, *forUtil, docFreqs, buffered, *indexOut);
         buffered = 0;
 
         if (trace)
@@ -227,14 +402,19 @@ void Trinity::Codecs::Lucene::Encoder::begin_document(const uint32_t documentID)
 
                 // total hits of the current position/hits block
                 cur_block.curHitsBlockHits = totalHits;
+
+                cur_block.maxFreq = 0;
+                cur_block.minNorm = UINT8_MAX;
         }
 
         docDeltas[buffered] = documentID - lastDocID;
         docFreqs[buffered]  = 0;
+        termDocIDs.emplace_back(documentID);
         ++termDocuments;
 
-        lastDocID    = documentID;
-        lastPosition = 0;
+        lastDocID       = documentID;
+        lastPosition    = 0;
+        curDocumentNorm = 0;
 }
 
 void Trinity::Codecs::Lucene::Encoder::new_hit(const uint32_t pos, const range_base<const uint8_t *, const uint8_t> payload) {
@@ -270,13 +450,8 @@ void Trinity::Codecs::Lucene::Encoder::new_hit(const uint32_t pos, const range_b
 
                 sumHits += totalHits;
 
-#ifdef LUCENE_USE_FASTPFOR
-                ints_encode(*forUtil, hitPosDeltas, totalHits, *positionsOut);
-                ints_encode(*forUtil, hitPayloadSizes, totalHits, *positionsOut);
-#else
-                ints_encode(hitPosDeltas, totalHits, *positionsOut);
-                ints_encode(hitPayloadSizes, totalHits, *positionsOut);
-#endif
+                ints_encode(encoding, *forUtil, hitPosDeltas, totalHits, *positionsOut);
+                ints_encode(encoding, *forUtil, hitPayloadSizes, totalHits, *positionsOut);
 
                 {
                         size_t s{0};
@@ -304,13 +479,64 @@ void Trinity::Codecs::Lucene::Encoder::new_hit(const uint32_t pos, const range_b
 }
 
 void Trinity::Codecs::Lucene::Encoder::end_document() {
+        cur_block.maxFreq = std::max<uint32_t>(cur_block.maxFreq, std::min<uint32_t>(docFreqs[buffered], UINT16_MAX));
+        cur_block.minNorm = std::min(cur_block.minNorm, curDocumentNorm);
+        termMinNorm       = std::min(termMinNorm, curDocumentNorm);
+        termDocFreqs.emplace_back(docFreqs[buffered]);
         ++buffered;
 }
 
+// Replaces the blocks of the term's chunk with a bitmap; see DENSE_CHUNK
+void Trinity::Codecs::Lucene::Encoder::output_dense_chunk() {
+        auto *const __restrict__ indexOut = &sess->indexOut;
+        const auto   base                 = termDocIDs.front() & ~isrc_docid_t(63);
+        const auto   words                = (termDocIDs.back() - base) / 64 + 1;
+        const auto   chunkOffset          = termIndexOffset - sess->indexOutFlushed;
+        const auto   minFreq              = *std::min_element(termDocFreqs.begin(), termDocFreqs.end());
+        const auto   maxFreq              = *std::max_element(termDocFreqs.begin(), termDocFreqs.end());
+        const auto   freqBits             = maxFreq == minFreq ? 0 : 32 - __builtin_clz(maxFreq - minFreq);
+        const size_t n                    = termDocIDs.size();
+
+        // drop the blocks; we only need the header
+        indexOut->resize(chunkOffset + sizeof(uint32_t) * 3 + sizeof(uint16_t));
+        *(uint16_t *)(indexOut->data() + chunkOffset + sizeof(uint32_t) * 3) = DENSE_CHUNK;
+
+        indexOut->pack(uint32_t(base), uint32_t(words), uint32_t(minFreq), uint8_t(freqBits), uint16_t(std::min<uint32_t>(maxFreq, UINT16_MAX)), termMinNorm);
+
+        std::vector<uint64_t> bits(std::max<size_t>(words, (n * freqBits + 63) / 64 + 1), 0);
+
+        for (const auto id : termDocIDs) {
+                const auto b = id - base;
+
+                bits[b / 64] |= uint64_t(1) << (b & 63);
+        }
+        indexOut->serialize(bits.data(), words * sizeof(uint64_t));
+
+        if (freqBits) {
+                std::fill(bits.begin(), bits.end(), 0);
+                for (size_t i{0}; i != n; ++i) {
+                        const uint64_t bit = i * freqBits;
+                        const uint64_t v   = termDocFreqs[i] - minFreq;
+                        const auto     s   = bit & 63;
+
+                        bits[bit / 64] |= v << s;
+                        if (s + freqBits > 64)
+                                bits[bit / 64 + 1] |= v >> (64 - s);
+                }
+                indexOut->serialize(bits.data(), (n * freqBits + 7) / 8);
+        }
+
+        indexOut->pad(DENSE_CHUNK_PADDING);
+}
+
 void Trinity::Codecs::Lucene::Encoder::end_term(term_index_ctx *out) {
         auto indexOut              = &sess->indexOut;
         auto *const __restrict__ s = static_cast<Trinity::Codecs::Lucene::IndexSession *>(sess);
 
+        // impacts of the tail block, if any
+        uint16_t tailMaxFreq{0};
+        uint8_t  tailMinNorm{UINT8_MAX};
+
         sumHits += totalHits;
 
         if (trace)
@@ -319,6 +545,11 @@ void Trinity::Codecs::Lucene::Encoder::end_term(term_index_ctx *out) {
         if (buffered == BLOCK_SIZE)
                 output_block();
         else {
+                if (buffered) {
+                        tailMaxFreq = cur_block.maxFreq;
+                        tailMinNorm = cur_block.minNorm;
+                }
+
                 for (size_t i{0}; i != buffered; ++i) {
                         const auto delta = docDeltas[i];
                         const auto freq  = docFreqs[i];
@@ -370,14 +601,22 @@ void Trinity::Codecs::Lucene::Encoder::end_term(term_index_ctx *out) {
         *(uint32_t *)(sess->indexOut.data() + (termIndexOffset - sess->indexOutFlushed) + sizeof(uint32_t) + sizeof(uint32_t))                    = (s->positionsOut.size() + s->positionsOutFlushed) - termPositionsOffset;
         *(uint16_t *)(sess->indexOut.data() + (termIndexOffset - sess->indexOutFlushed) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t)) = skiplistSize;
 
-        if (skiplistSize) {
-                // serialize skiplist here
-                auto *const __restrict__ b = &sess->indexOut;
+        if (termDocuments >= DENSE_MIN_DOCUMENTS && uint64_t(termDocIDs.back() - termDocIDs.front()) + 1 <= uint64_t(termDocuments) * DENSE_MAX_SPAN_RATIO) {
+                output_dense_chunk();
+                skiplist.clear();
+        } else {
+                if (skiplistSize) {
+                        // serialize skiplist here
+                        auto *const __restrict__ b = &sess->indexOut;
 
-                for (const auto &it : skiplist)
-                        b->pack(it.indexOffset, it.lastDocID, it.lastHitsBlockOffset, it.totalDocumentsSoFar, it.lastHitsBlockTotalHits, it.curHitsBlockHits);
+                        for (const auto &it : skiplist)
+                                b->pack(it.indexOffset, it.lastDocID, it.lastHitsBlockOffset, it.totalDocumentsSoFar, it.lastHitsBlockTotalHits, it.curHitsBlockHits, it.maxFreq, it.minNorm);
 
-                skiplist.clear();
+                        skiplist.clear();
+                }
+
+                // see FORMAT_VERSION
+                sess->indexOut.pack(std::max(tailMaxFreq, untrackedMaxFreq), std::min(tailMinNorm, untrackedMinNorm));
         }
 
         out->documents = termDocuments;
@@ -398,17 +637,28 @@ Trinity::Codecs::Decoder *Trinity::Codecs::Lucene::AccessProxy::new_decoder(cons
         return d.release();
 }
 
-void Trinity::Codecs::Lucene::Decoder::refill_hits(PostingsListIterator *it) {
+void Trinity::Codecs::Lucene::Decoder::prefetch() {
+        if (!prefetchable) {
+                return;
+        }
+
+        // The documents blocks(or the bitmap) are stored contiguously from the start of the chunk, and the skiplist
+        // and trailer past them have already been accessed by init()
+        Utilities::prefetch_mapped(postingListBase, std::min<size_t>(chunkEnd - postingListBase, PREFETCH_WINDOW));
+
+        if (hitsChunkSize) {
+                Utilities::prefetch_mapped(hitsBase, std::min<size_t>(hitsChunkSize, PREFETCH_WINDOW));
+        }
+}
+
+void Trinity::Codecs::Lucene::Decoder::refill_hits(hits_cursor *it) {
         uint32_t payloadsChunkLength;
 
         if (it->hitsLeft >= BLOCK_SIZE) {
-#ifdef LUCENE_USE_FASTPFOR
-                it->hdp = ints_decode(*forUtil, it->hdp, it->hitsPositionDeltas);
-                it->hdp = ints_decode(*forUtil, it->hdp, it->hitsPayloadLengths);
-#else
-                it->hdp = ints_decode(it->hdp, it->hitsPositionDeltas);
-                it->hdp = ints_decode(it->hdp, it->hitsPayloadLengths);
-#endif
+                // decoded lazily, see decode_hits()
+                it->positionsBlock      = it->hdp;
+                it->payloadLengthsBlock = ints_skip(encoding, it->positionsBlock);
+                it->hdp                 = ints_skip(encoding, it->payloadLengthsBlock);
 
                 varbyte_get32(it->hdp, payloadsChunkLength);
 
@@ -435,36 +685,46 @@ void Trinity::Codecs::Lucene::Decoder::refill_hits(PostingsListIterator *it) {
                         it->hitsPayloadLengths[i] = payloadLen;
                         payloadsChunkLength += payloadLen;
                 }
-                it->payloadsIt = it->hdp;
+                it->positionsBlock      = nullptr;
+                it->payloadLengthsBlock = nullptr;
+                it->payloadsIt          = it->hdp;
                 it->hdp += payloadsChunkLength;
                 it->payloadsEnd  = it->hdp;
                 it->bufferedHits = it->hitsLeft;
                 it->hitsLeft     = 0;
         }
-        it->hitsIndex = 0;
+        it->hitsIndex     = 0;
+        it->payloadsIndex = 0;
+}
 
-#if 0
-        {
-                auto p{it->payloadsIt};
+void Trinity::Codecs::Lucene::Decoder::decode_hits(hits_cursor *it) {
+        if (const auto p = it->positionsBlock) {
+                ints_decode(encoding, *forUtil, p, it->hitsPositionDeltas);
+                it->positionsBlock = nullptr;
+        }
 
-                for (size_t i{0}; i != it->bufferedHits; ++i)
-                {
-                        const auto len = it->hitsPayloadLengths[i];
-                        uint64_t h;
+        if (payloads) {
+                if (const auto p = it->payloadLengthsBlock) {
+                        ints_decode(encoding, *forUtil, p, it->hitsPayloadLengths);
+                        it->payloadLengthsBlock = nullptr;
+                }
+
+                if (const auto hitsIndex = it->hitsIndex; it->payloadsIndex != hitsIndex) {
+                        // payloads of skipped hits
+                        uint32_t sum{0};
 
-                        memcpy(&h, p, len);
-                        p += len;
+                        for (auto i = it->payloadsIndex; i != hitsIndex; ++i)
+                                sum += it->hitsPayloadLengths[i];
 
-                        SLog("FOR ", i, " ", len, " ", len ? h : 0, "\n");
+                        it->payloadsIt += sum;
+                        it->payloadsIndex = hitsIndex;
                 }
         }
-#endif
 }
 
-[[gnu::hot]] void Trinity::Codecs::Lucene::Decoder::skip_hits(Trinity::Codecs::Lucene::PostingsListIterator *it, const uint32_t n) {
+// Nothing is decoded here; payloads and hits blocks are only accessed if needed(see decode_hits())
+[[gnu::hot]] void Trinity::Codecs::Lucene::Decoder::skip_hits(hits_cursor *it, const uint32_t n) {
         if (auto rem = n) {
-                auto &hitsPayloadLengths{it->hitsPayloadLengths};
-
                 do {
                         if (it->hitsIndex + rem == it->bufferedHits) {
                                 // fast-path TODO: verify me(this works, but hm.)
@@ -480,32 +740,7 @@ void Trinity::Codecs::Lucene::Decoder::refill_hits(PostingsListIterator *it) {
 
                         const auto step = std::min<uint32_t>(rem, it->bufferedHits - it->hitsIndex);
 
-#if defined(TRINITY_ENABLE_PREFETCH)
-                        {
-                                const size_t prefetchIterations = step / 16; // 64/4
-                                const auto   end                = it->hitsIndex + step;
-
-                                for (size_t i{0}; i != prefetchIterations; ++i) {
-                                        _mm_prefetch(hitsPayloadLengths + hitsIndex, _MM_HINT_NTA);
-
-                                        for (const auto upto = hitsIndex + 16; hitsIndex != upto; ++(it->hitsIndex))
-                                                payloadsIt += hitsPayloadLengths[it->hitsIndex];
-                                }
-
-                                while (it->hitsIndex != end)
-                                        it->payloadsIt += hitsPayloadLengths[it->hitsIndex++];
-                        }
-#else
-                        uint32_t sum{0};
-                        auto     hitsIndex{it->hitsIndex};
-
-                        for (size_t i{0}; i != step; ++i)
-                                sum += hitsPayloadLengths[hitsIndex++];
-
-                        it->payloadsIt += sum;
-                        it->hitsIndex = hitsIndex;
-#endif
-
+                        it->hitsIndex += step;
                         it->skippedHits -= step;
                         rem -= step;
                 } while (rem);
@@ -514,13 +749,8 @@ void Trinity::Codecs::Lucene::Decoder::refill_hits(PostingsListIterator *it) {
 
 void Trinity::Codecs::Lucene::Decoder::refill_documents(Trinity::Codecs::Lucene::PostingsListIterator *it) {
         if (it->docsLeft >= BLOCK_SIZE) {
-#ifdef LUCENE_USE_FASTPFOR
-                it->p = ints_decode(*forUtil, it->p, it->docDeltas);
-                it->p = ints_decode(*forUtil, it->p, it->docFreqs);
-#else
-                it->p = ints_decode(it->p, it->docDeltas);
-                it->p = ints_decode(it->p, it->docFreqs);
-#endif
+                it->p = ints_decode(encoding, *forUtil, it->p, it->docDeltas);
+                it->p = ints_decode(encoding, *forUtil, it->p, it->docFreqs);
 
                 it->bufferedDocs = BLOCK_SIZE;
                 it->docsLeft -= BLOCK_SIZE;
@@ -553,6 +783,7 @@ void Trinity::Codecs::Lucene::Decoder::refill_documents(Trinity::Codecs::Lucene:
                 it->docsLeft     = 0;
         }
 
+        decodedPostings += it->bufferedDocs;
         it->docsIndex = 0;
         update_curdoc(it);
 }
@@ -765,54 +996,33 @@ uint32_t Trinity::Codecs::Lucene::Decoder::skiplist_search(PostingsListIterator
 }
 
 void Trinity::Codecs::Lucene::Decoder::materialize_hits(PostingsListIterator *it, DocWordsSpace *const __restrict__ dws, term_hit *const __restrict__ out) {
+        materialize_hits(it, it->docFreqs[it->docsIndex], dws, out);
+        it->docFreqs[it->docsIndex] = 0; // simplifies processing logic
+}
+
+void Trinity::Codecs::Lucene::Decoder::materialize_hits(hits_cursor *it, uint32_t freq, DocWordsSpace *const __restrict__ dws, term_hit *const __restrict__ out) {
         const auto termID{execCtxTermID};
-        auto       freq   = it->docFreqs[it->docsIndex];
         auto       outPtr = out;
+        tokenpos_t pos{0};
 
         if (const auto skippedHits = it->skippedHits) {
                 skip_hits(it, skippedHits);
         }
 
-        // fast-path; can satisfy directly from the current hits block
-        auto       hitsIndex = it->hitsIndex;
-        auto &     hitsPayloadLengths{it->hitsPayloadLengths};
-        auto &     hitsPositionDeltas{it->hitsPositionDeltas};
-        const auto bufferedHits{it->bufferedHits};
-
-        if (const auto upto = hitsIndex + freq; upto <= bufferedHits) {
-                tokenpos_t pos{0};
-
-                while (hitsIndex != upto) {
-                        const auto pl = hitsPayloadLengths[hitsIndex];
-
-                        pos += hitsPositionDeltas[hitsIndex];
-
-#ifdef TRINITY_VERIFY_HITS
-                        EXPECT(pos < 8192);
-#endif
-
-                        outPtr->pos        = pos;
-                        outPtr->payloadLen = pl;
-
-                        if (pos) {
-                                dws->set(termID, pos);
-                        }
+        while (freq) {
+                if (it->hitsIndex == it->bufferedHits) {
+                        refill_hits(it);
+                }
 
-                        outPtr->payload = 0;
-                        if (pl) {
-                                memcpy(&outPtr->payload, it->payloadsIt, pl);
-                                it->payloadsIt += pl;
-                        }
+                decode_hits(it);
 
-                        ++outPtr;
-                        ++hitsIndex;
-                }
-        } else {
-                tokenpos_t pos{0};
+                auto &     hitsPositionDeltas{it->hitsPositionDeltas};
+                auto       hitsIndex = it->hitsIndex;
+                const auto n         = std::min<uint32_t>(it->bufferedHits - hitsIndex, freq);
+                const auto upto      = hitsIndex + n;
 
-                for (;;) {
-                        const auto n    = std::min<uint32_t>(it->bufferedHits - hitsIndex, freq);
-                        const auto upto = hitsIndex + n;
+                if (payloads) {
+                        auto &hitsPayloadLengths{it->hitsPayloadLengths};
 
                         while (hitsIndex != upto) {
                                 const auto pl = hitsPayloadLengths[hitsIndex];
@@ -839,23 +1049,114 @@ void Trinity::Codecs::Lucene::Decoder::materialize_hits(PostingsListIterator *it
                                 ++outPtr;
                                 ++hitsIndex;
                         }
-                        freq -= n;
+                        it->payloadsIndex = hitsIndex;
+                } else {
+                        while (hitsIndex != upto) {
+                                pos += hitsPositionDeltas[hitsIndex];
 
-                        if (freq) {
-                                it->hitsIndex = hitsIndex;
-                                refill_hits(it);
-                                hitsIndex = it->hitsIndex;
-                        } else {
-                                break;
+#ifdef TRINITY_VERIFY_HITS
+                                EXPECT(pos < 8192);
+#endif
+
+                                outPtr->pos        = pos;
+                                outPtr->payloadLen = 0;
+                                outPtr->payload    = 0;
+
+                                if (pos) {
+                                        dws->set(termID, pos);
+                                }
+
+                                ++outPtr;
+                                ++hitsIndex;
                         }
                 }
+
+                it->hitsIndex = hitsIndex;
+                freq -= n;
+        }
+}
+
+// Skiplist entries track the impacts of their block, and the impacts of the tail block(and of any blocks
+// past the last entry, see Encoder::output_block()) are tracked separately. See FORMAT_VERSION and init_skiplist()
+Trinity::isrc_docid_t Trinity::Codecs::Lucene::Decoder::block_bound(PostingsListIterator *it, const isrc_docid_t target, block_impact *const impact) {
+        ensure_skiplist();
+
+        const uint32_t size = skiplist.size;
+
+        if (!size) {
+                // just the tail block
+                impact->maxFreq = tailMaxFreq;
+                impact->minNorm = tailMinNorm;
+                return DocIDsEND;
+        }
+
+        // skiplist.data[i].lastDocID is the last document of the block before block i
+        // so block i spans (skiplist.data[i].lastDocID, skiplist.data[i + 1].lastDocID]
+        auto idx{it->boundSkipListIdx};
+
+        if (target <= skiplist.data[idx].lastDocID) {
+                // targets are almost always increasing, but not necessarily so
+                idx = 0;
         }
 
-        it->hitsIndex               = hitsIndex; // restore
-        it->docFreqs[it->docsIndex] = 0;         // simplifies processing logic
+        // branchless binary search; see skiplist_search()
+        const auto *data = skiplist.data + idx;
+        uint32_t    n    = size - idx;
+
+        while (const auto h = n / 2) {
+                const auto m = data + h;
+
+                data = (m->lastDocID < target) ? m : data;
+                n -= h;
+        }
+
+        idx                  = data - skiplist.data;
+        it->boundSkipListIdx = idx;
+
+        if (idx + 1 == size) {
+                // last skiplist entry; we can't tell where its block ends, so also account for the tail block
+                impact->maxFreq = std::max(data->maxFreq, tailMaxFreq);
+                impact->minNorm = std::min(data->minNorm, tailMinNorm);
+                return DocIDsEND;
+        } else {
+                impact->maxFreq = data->maxFreq;
+                impact->minNorm = data->minNorm;
+                return data[1].lastDocID;
+        }
+}
+
+uint32_t Trinity::Codecs::Lucene::Decoder::max_freq_bound() {
+        if (maxFreqBound == UINT32_MAX) {
+                ensure_skiplist();
+
+                // init_skiplist() may update tailMaxFreq
+                uint32_t res{tailMaxFreq};
+
+                for (uint32_t i{0}; i != skiplist.size; ++i)
+                        res = std::max<uint32_t>(res, skiplist.data[i].maxFreq);
+
+                maxFreqBound = res;
+        }
+
+        return maxFreqBound;
 }
 
 Trinity::Codecs::PostingsListIterator *Trinity::Codecs::Lucene::Decoder::new_iterator() {
+        if (dense.words) {
+                auto it = std::make_unique<Trinity::Codecs::Lucene::DensePostingsListIterator>(this);
+
+                it->bit          = UINT32_MAX;
+                it->docs         = 0;
+                it->hitsDocs     = 0;
+                it->hitsLeft     = totalHits;
+                it->hitsIndex    = 0;
+                it->bufferedHits = 0;
+                it->skippedHits  = 0;
+                it->hdp          = hitsBase;
+
+                return it.release();
+        }
+
         auto it = std::make_unique<Trinity::Codecs::Lucene::PostingsListIterator>(this);
 
         it->lastDocID    = 0;
@@ -868,15 +1169,91 @@ Trinity::Codecs::PostingsListIterator *Trinity::Codecs::Lucene::Decoder::new_ite
         it->docFreqs[0]                     = 0;
         it->docDeltas[0]                    = 0;
         it->skipListIdx                     = 0;
+        it->boundSkipListIdx                = 0;
         it->hdp                             = hitsBase;
         it->p                               = postingListBase + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint16_t);
 
         return it.release();
 }
 
+#pragma mark Dense chunks
+uint32_t Trinity::Codecs::Lucene::Decoder::dense_freq(const uint32_t i) const noexcept {
+        return dense_chunk_freq(denseFreqs, denseMinFreq, denseFreqBits, i);
+}
+
+[[gnu::hot]] void Trinity::Codecs::Lucene::Decoder::dense_seek(DensePostingsListIterator *const __restrict__ it, const uint32_t from) {
+        const auto size = dense.size;
+
+        if (unlikely(from >= size * 64)) {
+                finalize(it);
+                return;
+        }
+
+        // account for all documents in (it->bit, from)
+        const uint32_t start = it->bit + 1;
+        auto           i     = start / 64;
+        auto           w     = dense.word(i) & (~uint64_t(0) << (start & 63));
+        uint32_t       docs{0};
+
+        for (const auto upto = from / 64; i != upto;) {
+                docs += __builtin_popcountll(w);
+                w = dense.word(++i);
+        }
+
+        const auto mask = ~uint64_t(0) << (from & 63);
+
+        docs += __builtin_popcountll(w & ~mask);
+        for (w &= mask; !w;) {
+                if (++i == size) {
+                        it->docs += docs;
+                        decodedPostings += docs;
+                        finalize(it);
+                        return;
+                }
+                w = dense.word(i);
+        }
+
+        ++docs;
+        it->docs += docs;
+        decodedPostings += docs;
+        it->bit            = i * 64 + __builtin_ctzll(w);
+        it->curDocument.id = dense.base + it->bit;
+        it->freq           = dense_freq(it->docs - 1);
+}
+
+void Trinity::Codecs::Lucene::Decoder::next(DensePostingsListIterator *const it) {
+        dense_seek(it, it->bit + 1);
+}
+
+void Trinity::Codecs::Lucene::Decoder::advance(DensePostingsListIterator *const it, const isrc_docid_t target) {
+        if (target > it->curDocument.id || it->bit == UINT32_MAX)
+                dense_seek(it, target > dense.base ? target - dense.base : 0);
+}
+
+void Trinity::Codecs::Lucene::Decoder::materialize_hits(DensePostingsListIterator *it, DocWordsSpace *const __restrict__ dws, term_hit *const __restrict__ out) {
+        const auto idx = it->docs - 1;
+
+        if (unlikely(it->hitsDocs == it->docs)) {
+                // already materialized
+                return;
+        } else if (const auto n = idx - it->hitsDocs) {
+                // skip the hits of the documents we didn't materialize
+                if (denseFreqBits) {
+                        for (auto i = it->hitsDocs; i != idx; ++i)
+                                it->skippedHits += dense_freq(i);
+                } else {
+                        it->skippedHits += n * denseMinFreq;
+                }
+        }
+
+        materialize_hits(static_cast<hits_cursor *>(it), it->freq, dws, out);
+        it->hitsDocs = it->docs;
+}
+
 void Trinity::Codecs::Lucene::Decoder::init_skiplist(const uint16_t size) {
-        static constexpr size_t skiplistEntrySize{sizeof(uint32_t) * 5 + sizeof(uint16_t)};
-        const auto *            sit = chunkEnd;
+        const auto  skiplistEntrySize = skiplist_entry_size(formatVersion);
+        const auto *sit               = chunkEnd;
+        const auto  end               = sit + size * skiplistEntrySize;
 
         skiplist.size = size;
         skiplist.data = (skiplist_entry *)malloc(sizeof(skiplist_entry) * size);
@@ -889,7 +1266,20 @@ void Trinity::Codecs::Lucene::Decoder::init_skiplist(const uint16_t size) {
                 e.lastHitsBlockOffset = it[2];
                 e.totalDocumentsSoFar = it[3];
                 e.totalHitsSoFar      = it[4];
-                e.curHitsBlockHits    = *(uint16_t *)(sit + skiplistEntrySize - sizeof(uint16_t));
+                e.curHitsBlockHits    = *(uint16_t *)(sit + sizeof(uint32_t) * 5);
+
+                if (formatVersion) {
+                        e.maxFreq = *(uint16_t *)(sit + sizeof(uint32_t) * 5 + sizeof(uint16_t));
+                        e.minNorm = sit[sizeof(uint32_t) * 5 + sizeof(uint16_t) + sizeof(uint16_t)];
+                } else {
+                        e.maxFreq = v0_skiplist_entry_max_freq(sit, end, totalHits);
+                        e.minNorm = 0;
+                }
+        }
+
+        if (!formatVersion) {
+                // the last entry's bound also covers the tail block
+                tailMaxFreq = skiplist.data[size - 1].maxFreq;
         }
 }
 
@@ -909,7 +1299,8 @@ void Trinity::Codecs::Lucene::Decoder::init(const term_index_ctx &tctx, Trinity:
         p += sizeof(uint32_t);
         totalHits = *(uint32_t *)p;
         p += sizeof(uint32_t);
-        p += sizeof(uint32_t); // positions chunk size
+        hitsChunkSize = *(uint32_t *)p;
+        p += sizeof(uint32_t);
 #ifdef LUCENE_LAZY_SKIPLIST_INIT
         skiplistSize = *(uint16_t *)p;
 #else
@@ -917,18 +1308,53 @@ void Trinity::Codecs::Lucene::Decoder::init(const term_index_ctx &tctx, Trinity:
 #endif
         p += sizeof(uint16_t);
 
-        if (skiplistSize) {
-                // deserialize the skiplist and maybe use it
-                static constexpr size_t skiplistEntrySize{sizeof(uint32_t) * 5 + sizeof(uint16_t)};
+        formatVersion = ap->formatVersion;
+        encoding      = ap->encoding;
+        hitsBase      = ap->hitsDataPtr + hitsDataOffset;
+        prefetchable  = ap->prefetch;
+        dense.words   = nullptr;
 
-                chunkEnd = (ptr + chunkSize) - (skiplistSize * skiplistEntrySize);
+        if (formatVersion >= 2 && skiplistSize == DENSE_CHUNK) {
+                // see DENSE_CHUNK
+                dense.base = *(uint32_t *)p;
+                p += sizeof(uint32_t);
+                dense.size = *(uint32_t *)p;
+                p += sizeof(uint32_t);
+                denseMinFreq = *(uint32_t *)p;
+                p += sizeof(uint32_t);
+                denseFreqBits = *p++;
+                tailMaxFreq   = *(uint16_t *)p;
+                p += sizeof(uint16_t);
+                tailMinNorm = *p++;
 
-#ifndef LUCENE_LAZY_SKIPLIST_INIT
-                init_skiplist(skiplistSize);
+                dense.words = p;
+                denseFreqs  = p + dense.size * sizeof(uint64_t);
+                chunkEnd    = ptr + chunkSize;
+#ifdef LUCENE_LAZY_SKIPLIST_INIT
+                skiplistSize = 0;
 #endif
+                return;
         }
 
-        hitsBase = ap->hitsDataPtr + hitsDataOffset;
+        chunkEnd = (ptr + chunkSize) - chunk_trailer_size(formatVersion, skiplistSize);
+
+        if (formatVersion) {
+                const auto t = ptr + chunkSize - sizeof(uint16_t) - sizeof(uint8_t);
+
+                tailMaxFreq = *(uint16_t *)t;
+                tailMinNorm = t[sizeof(uint16_t)];
+        } else {
+                // no impacts in older formats; init_skiplist() will derive them
+                tailMaxFreq = std::min<uint32_t>(totalHits, UINT16_MAX);
+                tailMinNorm = 0;
+        }
+
+#ifndef LUCENE_LAZY_SKIPLIST_INIT
+        if (skiplistSize) {
+                // deserialize the skiplist and maybe use it
+                init_skiplist(skiplistSize);
+        }
+#endif
 }
 
 Trinity::Codecs::Lucene::AccessProxy::~AccessProxy() {
@@ -938,8 +1364,16 @@ Trinity::Codecs::Lucene::AccessProxy::~AccessProxy() {
         }
 }
 
-Trinity::Codecs::Lucene::AccessProxy::AccessProxy(const char *bp, const uint8_t *p, const uint8_t *hd)
-    : Trinity::Codecs::AccessProxy{bp, p}, hitsDataPtr{hd} {
+Trinity::Codecs::Lucene::AccessProxy::AccessProxy(const char *bp, const uint8_t *p, const uint8_t *hd, const uint8_t fmt, const Encoding e, const LoadPolicy hitsPolicy)
+    : Trinity::Codecs::AccessProxy{bp, p}, hitsDataPtr{hd}, formatVersion{fmt}, encoding{e}, prefetch{hitsPolicy == LoadPolicy::Random} {
+        if (fmt > FORMAT_VERSION) {
+                throw Switch::data_error("Unsupported Lucene codec format version");
+        }
+
+        if (!encoding_supported(e)) {
+                throw Switch::data_error("Lucene codec encoding not supported by this build");
+        }
+
         if (hd == nullptr) {
                 int fd = open(Buffer{}.append(basePath, "/hits.data").c_str(), O_RDONLY | O_LARGEFILE);
 
@@ -948,7 +1382,7 @@ Trinity::Codecs::Lucene::AccessProxy::AccessProxy(const char *bp, const uint8_t
                                 throw Switch::data_error("Unable to access hits.data");
 			}
                 } else if (const auto fileSize = lseek64(fd, 0, SEEK_END); fileSize > 0) {
-                        hitsDataPtr = reinterpret_cast<const uint8_t *>(mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0));
+                        hitsDataPtr = reinterpret_cast<const uint8_t *>(Utilities::map_file(fd, fileSize, hitsPolicy));
 
                         close(fd);
                         EXPECT(hitsDataPtr != MAP_FAILED);
@@ -971,6 +1405,8 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                 uint32_t                   hitsPayloadLengths[BLOCK_SIZE];
                 uint32_t                   hitsPositionDeltas[BLOCK_SIZE];
                 masked_documents_registry *maskedDocsReg;
+                // of the participant's segment
+                Encoding encoding;
 
                 uint32_t documentsLeft;
                 uint32_t hitsLeft;
@@ -996,13 +1432,36 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                         uint8_t size;
                 } cur_block;
 
+                // The participant's skiplist impacts (FORMAT_VERSION >= 1), so that we can carry document norms over.
+                // We only know the min norm of the block a document belongs to, but that's good enough for a lower bound.
+                struct
+                {
+                        const uint8_t *p;
+                        uint16_t       size;
+                        uint16_t       next;
+                        uint8_t        stride;
+                        uint8_t        tailMinNorm;
+                        uint8_t        minNorm;
+                } impacts;
+
+                // if the participant's chunk is dense(see DENSE_CHUNK)
+                struct
+                {
+                        const uint8_t *words;
+                        const uint8_t *freqs;
+                        isrc_docid_t   base;
+                        uint32_t       i;
+                        // bits of the current word we haven't consumed yet
+                        uint64_t w;
+                        uint32_t minFreq;
+                        // index of the next document
+                        uint32_t idx;
+                        uint8_t  freqBits;
+                } dense;
+
                 const uint8_t *payloadsIt, *payloadsEnd;
 
-#ifdef LUCENE_USE_FASTPFOR
                 void refill_hits(FastPForLib::FastPFor<4> &forUtil)
-#else
-                void refill_hits()
-#endif
                 {
                         uint32_t payloadsChunkLength;
                         auto     hdp = positions_chunk.p;
@@ -1014,13 +1473,8 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                         require(hitsIndex == 0 || hitsIndex == BLOCK_SIZE);
 
                         if (hitsLeft >= BLOCK_SIZE) {
-#ifdef LUCENE_USE_FASTPFOR
-                                hdp = ints_decode(forUtil, hdp, hitsPositionDeltas);
-                                hdp = ints_decode(forUtil, hdp, hitsPayloadLengths);
-#else
-                                hdp = ints_decode(hdp, hitsPositionDeltas);
-                                hdp = ints_decode(hdp, hitsPayloadLengths);
-#endif
+                                hdp = ints_decode(encoding, forUtil, hdp, hitsPositionDeltas);
+                                hdp = ints_decode(encoding, forUtil, hdp, hitsPayloadLengths);
 
                                 varbyte_get32(hdp, payloadsChunkLength);
 
@@ -1059,26 +1513,42 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                         hitsIndex         = 0;
                 }
 
-#ifdef LUCENE_USE_FASTPFOR
                 void refill_documents(FastPForLib::FastPFor<4> &forUtil)
-#else
-                          void refill_documents()
-#endif
                 {
                         if (trace)
                                 SLog("Refilling documents ", documentsLeft, "\n");
 
-                        if (documentsLeft >= BLOCK_SIZE) {
-#ifdef LUCENE_USE_FASTPFOR
-                                index_chunk.p = ints_decode(forUtil, index_chunk.p, docDeltas);
-                                index_chunk.p = ints_decode(forUtil, index_chunk.p, docFreqs);
-#else
-                                index_chunk.p = ints_decode(index_chunk.p, docDeltas);
-                                index_chunk.p = ints_decode(index_chunk.p, docFreqs);
-#endif
+                        if (dense.words) {
+                                const auto n = std::min<uint32_t>(documentsLeft, BLOCK_SIZE);
+                                auto       prev{lastDocID};
+
+                                for (uint32_t k{0}; k != n; ++k) {
+                                        while (!dense.w)
+                                                dense.w = load_u64(dense.words + (++dense.i) * sizeof(uint64_t));
+
+                                        const auto id = dense.base + dense.i * 64 + __builtin_ctzll(dense.w);
+
+                                        dense.w &= dense.w - 1;
+                                        docDeltas[k] = id - prev;
+                                        docFreqs[k]  = dense_chunk_freq(dense.freqs, dense.minFreq, dense.freqBits, dense.idx++);
+                                        prev         = id;
+                                }
+
+                                cur_block.size = n;
+                                documentsLeft -= n;
+                                impacts.minNorm = impacts.tailMinNorm;
+                        } else if (documentsLeft >= BLOCK_SIZE) {
+                                index_chunk.p = ints_decode(encoding, forUtil, index_chunk.p, docDeltas);
+                                index_chunk.p = ints_decode(encoding, forUtil, index_chunk.p, docFreqs);
 
                                 cur_block.size = BLOCK_SIZE;
                                 documentsLeft -= BLOCK_SIZE;
+
+                                // blocks past the last skiplist entry are accounted for in the tail impacts
+                                impacts.minNorm = impacts.next < impacts.size
+                                                      ? impacts.p[impacts.next * impacts.stride + sizeof(uint32_t) * 5 + sizeof(uint16_t) + sizeof(uint16_t)]
+                                                      : impacts.tailMinNorm;
+                                ++impacts.next;
                         } else {
                                 uint32_t v;
                                 auto     p = index_chunk.p;
@@ -1102,8 +1572,9 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                                 }
                                 index_chunk.p = p;
 
-                                cur_block.size = documentsLeft;
-                                documentsLeft  = 0;
+                                cur_block.size  = documentsLeft;
+                                documentsLeft   = 0;
+                                impacts.minNorm = impacts.tailMinNorm;
                         }
                         cur_block.i = 0;
 
@@ -1112,11 +1583,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
 			}
                 }
 
-#ifdef LUCENE_USE_FASTPFOR
                 void skip_ommitted_hits(FastPForLib::FastPFor<4> &forUtil)
-#else
-                void skip_ommitted_hits()
-#endif
                 {
                         if (trace) {
                                 SLog("Skipping omitted hits ", skippedHits, ", bufferedHits = ", bufferedHits, "\n");
@@ -1135,11 +1602,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                         } else {
                                 do {
                                         if (hitsIndex == bufferedHits) {
-#ifdef LUCENE_USE_FASTPFOR
                                                 refill_hits(forUtil);
-#else
-                                                refill_hits();
-#endif
                                         }
 
                                         const auto step = std::min<uint32_t>(skippedHits, bufferedHits - hitsIndex);
@@ -1155,11 +1618,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                         }
                 }
 
-#ifdef LUCENE_USE_FASTPFOR
                 void output_hits(FastPForLib::FastPFor<4> &forUtil, Trinity::Codecs::Lucene::Encoder *__restrict__ enc)
-#else
-                          void output_hits(Trinity::Codecs::Lucene::Encoder *__restrict__ enc)
-#endif
                 {
                         auto       freq = docFreqs[cur_block.i];
                         uint64_t   payload;
@@ -1169,11 +1628,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                                 SLog("Will output hits for ", cur_block.i, " ", freq, ", skippedHits = ", skippedHits, "\n");
 			}
 
-#ifdef LUCENE_USE_FASTPFOR
                         skip_ommitted_hits(forUtil);
-#else
-                        skip_ommitted_hits();
-#endif
 
                         if (const auto upto = hitsIndex + freq; upto <= bufferedHits) {
                                 if (trace)
@@ -1227,11 +1682,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                                                 if (trace)
                                                         SLog("Will refill hits (Freq now = ", freq, ")\n");
 
-#ifdef LUCENE_USE_FASTPFOR
                                                 refill_hits(forUtil);
-#else
-                                                refill_hits();
-#endif
                                         } else
                                                 break;
                                 }
@@ -1240,11 +1691,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                         docFreqs[cur_block.i] = 0; // simplifies processing logic (See next().)
                 }
 
-#ifdef LUCENE_USE_FASTPFOR
                 bool next(FastPForLib::FastPFor<4> &forUtil)
-#else
-                bool next()
-#endif
                 {
                         skippedHits += docFreqs[cur_block.i];
                         lastDocID += docDeltas[cur_block.i++];
@@ -1258,17 +1705,9 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
 
 // this is important, because refill_documents()
 // will update cur_block
-#ifdef LUCENE_USE_FASTPFOR
                                 skip_ommitted_hits(forUtil);
-#else
-                                skip_ommitted_hits();
-#endif
 
-#ifdef LUCENE_USE_FASTPFOR
                                 refill_documents(forUtil);
-#else
-                                refill_documents();
-#endif
                         } else {
                                 if (trace)
                                         SLog("NOW at ", cur_block.i, "\n");
@@ -1298,6 +1737,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
 
                 c->index_chunk.e = p + participants[i].tctx.indexChunk.size();
                 c->maskedDocsReg = participants[i].maskedDocsReg;
+                c->encoding      = ap->encoding;
                 c->documentsLeft = participants[i].tctx.documents;
                 c->lastDocID     = 0;
                 c->skippedHits   = 0;
@@ -1318,23 +1758,46 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                 c->positions_chunk.p = ap->hitsDataPtr + hitsDataOffset;
                 c->positions_chunk.e = c->positions_chunk.p + posChunkSize;
                 c->hitsLeft          = sumHits;
+                c->dense.words       = nullptr;
 
                 if (trace) {
                         SLog("participant ", i, " ", c->documentsLeft, " ", c->hitsLeft, ", skiplistSize = ", skiplistSize, "\n");
 		}
 
-                // Skip past skiplist
-                if (skiplistSize) {
-                        static constexpr size_t skiplistEntrySize{sizeof(uint32_t) * 5 + sizeof(uint16_t)};
+                c->impacts.next = 0;
+                if (ap->formatVersion >= 2 && skiplistSize == DENSE_CHUNK) {
+                        // see DENSE_CHUNK
+                        const auto words = *(uint32_t *)(p + sizeof(uint32_t));
+
+                        c->dense.base     = *(uint32_t *)p;
+                        c->dense.minFreq  = *(uint32_t *)(p + sizeof(uint32_t) * 2);
+                        c->dense.freqBits = p[sizeof(uint32_t) * 3];
+                        c->dense.words    = p + DENSE_CHUNK_HEADER_SIZE;
+                        c->dense.freqs    = c->dense.words + words * sizeof(uint64_t);
+                        c->dense.i        = 0;
+                        c->dense.w        = load_u64(c->dense.words);
+                        c->dense.idx      = 0;
+
+                        c->impacts.p           = nullptr;
+                        c->impacts.size        = 0;
+                        c->impacts.tailMinNorm = p[DENSE_CHUNK_HEADER_SIZE - sizeof(uint8_t)];
+                } else if (ap->formatVersion) {
+                        // Skip past skiplist and impacts
+                        c->index_chunk.e -= chunk_trailer_size(ap->formatVersion, skiplistSize);
+
+                        c->impacts.p           = c->index_chunk.e;
+                        c->impacts.size        = skiplistSize;
+                        c->impacts.stride      = skiplist_entry_size(ap->formatVersion);
+                        c->impacts.tailMinNorm = c->index_chunk.e[skiplistSize * c->impacts.stride + sizeof(uint16_t)];
+                } else {
+                        c->index_chunk.e -= chunk_trailer_size(ap->formatVersion, skiplistSize);
 
-                        c->index_chunk.e -= skiplistSize * skiplistEntrySize;
+                        c->impacts.p           = nullptr;
+                        c->impacts.size        = 0;
+                        c->impacts.tailMinNorm = 0;
                 }
 
-#ifdef LUCENE_USE_FASTPFOR
                 c->refill_documents(*forUtil);
-#else
-                          c->refill_documents();
-#endif
         }
 
         for (isrc_docid_t prev{0};;) {
@@ -1361,11 +1824,8 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                         [[maybe_unused]] const auto freq = c->current_freq();
 
                         encoder->begin_document(did);
-#ifdef LUCENE_USE_FASTPFOR
+                        encoder->document_norm(c->impacts.minNorm);
                         c->output_hits(*forUtil, encoder);
-#else
-                        c->output_hits(encoder);
-#endif
                         encoder->end_document();
                 }
 
@@ -1373,11 +1833,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
                         const auto idx = toAdvance[--toAdvanceCnt];
                         auto       c   = candidates + idx;
 
-#ifdef LUCENE_USE_FASTPFOR
                         if (!c->next(*forUtil))
-#else
-                        if (!c->next())
-#endif
                         {
                                 if (!--rem) {
                                         goto l1;
@@ -1392,7 +1848,7 @@ void Trinity::Codecs::Lucene::IndexSession::merge(merge_participant *const __res
 l1:;
 }
 
-#if defined(LUCENE_USE_FASTPFOR) && defined(LUCENE_USE_FASTPFOR_TL)
+#ifdef LUCENE_USE_FASTPFOR_TL
 static thread_local std::vector<std::unique_ptr<FastPForLib::FastPFor<4>>> _fastpfor_tl_v;
 
 FastPForLib::FastPFor<4> *_acquire_tl_fastpfor() {
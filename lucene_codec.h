@@ -1,34 +1,23 @@
 #pragma once
 #include "codecs.h"
+#include "utils.h"
 
 static_assert(sizeof(Trinity::isrc_docid_t) <= sizeof(uint32_t));
 
-// You should edit Makefile accordingly. That is, Makefile's LUCENE_ENCODING_SCHEME should set in accordance with the LUCENE_USE_X macro set here
-// You should probably use streaming vbyte, by defining LUCENE_USE_STREAMVBYTE and setting LUCENE_ENCODING_SCHEME to streamvbyte
-// It's not the default here because you may have Lucene indices created alread using Lucene codec and PFOR encoding scheme.
-
-#if 0
-// Faster than both PFOR and MaskedVByte
-// https://github.com/lemire/streamvbyte and https://lemire.me/blog/2017/09/27/stream-vbyte-breaking-new-speed-records-for-integer-compression/
+// Blocks of documents and hits are encoded with one of the Encoding schemes below. The encoding is selected when an IndexSession is created
+// and recorded in the segment's codec identifier(see codec_identifier()), so that segments encoded with different schemes can be accessed by the same binary.
+// e.g you can use StreamVByte for small, frequently updated segments, and PFOR for large merged segments.
 //
-// Results in larger indices compared to PFOR though
-#define LUCENE_USE_STREAMVBYTE 1
-#elif 0
-// Slower than both PFOR and StreamingVByte
-// http://maskedvbyte.org
-#define LUCENE_USE_MASKEDVBYTE 1
-#else
-// Smaller indices in terms of size, but slower than StreamVByte
-// https://github.com/lemire/FastPFor
+// PFOR is always supported. Makefile's LUCENE_ENCODING_SCHEMES determines which other schemes are supported, by defining
+// LUCENE_HAVE_STREAMVBYTE and/or LUCENE_HAVE_MASKEDVBYTE, and linking against their implementations.
+
 #include <ext/FastPFor/headers/fastpfor.h>
-#define LUCENE_USE_FASTPFOR 1
 // if enabled, we will use thread-local storage for those so that we can reuse them
 // as opposed to creating and destroying new FastPFor objects very frequently, which is
 // expensive especially during merge where we would otherwise need to do this potentially thousands of times
 #define LUCENE_USE_FASTPFOR_TL 1
-#endif
 
-#if defined(LUCENE_USE_FASTPFOR) && defined(LUCENE_USE_FASTPFOR_TL) 
+#ifdef LUCENE_USE_FASTPFOR_TL
 FastPForLib::FastPFor<4> *_acquire_tl_fastpfor();
 void _release_tl_fastpfor(FastPForLib::FastPFor<4> *);
 #endif
@@ -45,25 +34,99 @@ namespace Trinity {
                         // is (1<<31) + 15, this will fail. However, see IndexSource::translate_docid() for how that would work with docIDs translations
                         // #define LUCENE_ENCODE_FREQ1_DOCDELTA 1
 
-#ifdef LUCENE_USE_MASKEDVBYTE
-                        static constexpr size_t BLOCK_SIZE{64};
-#elif defined(LUCENE_USE_STREAMVBYTE)
-                        // XXX: 256 may make more sense here
+                        // Segments created before the encoding was recorded in the codec identifier(i.e "LUCENE") used 64 documents blocks
+                        // if they were encoded with MaskedVByte; those need to be re-indexed.
                         static constexpr size_t BLOCK_SIZE{128};
+
+                        enum class Encoding : uint8_t {
+                                // Smaller indices in terms of size, but slower than StreamVByte
+                                // https://github.com/lemire/FastPFor
+                                PFOR = 0,
+                                // Faster than both PFOR and MaskedVByte, but results in larger indices compared to PFOR
+                                // https://github.com/lemire/streamvbyte and https://lemire.me/blog/2017/09/27/stream-vbyte-breaking-new-speed-records-for-integer-compression/
+                                StreamVByte,
+                                // Slower than both PFOR and StreamVByte
+                                // http://maskedvbyte.org
+                                MaskedVByte
+                        };
+
+// Segments created before the encoding was recorded in the codec identifier are identified as "LUCENE"
+// If you used a different LUCENE_USE_X scheme then, define this accordingly.
+#ifndef LUCENE_LEGACY_ENCODING
+#define LUCENE_LEGACY_ENCODING PFOR
+#endif
+
+                        // Used for new index sessions unless otherwise specified
+                        static constexpr Encoding DEFAULT_ENCODING{Encoding::PFOR};
+
+                        constexpr bool encoding_supported(const Encoding e) noexcept {
+                                switch (e) {
+                                        case Encoding::PFOR:
+                                                return true;
+
+                                        case Encoding::StreamVByte:
+#ifdef LUCENE_HAVE_STREAMVBYTE
+                                                return true;
 #else
-                        static constexpr size_t BLOCK_SIZE{128};
+                                                return false;
+#endif
+
+                                        case Encoding::MaskedVByte:
+#ifdef LUCENE_HAVE_MASKEDVBYTE
+                                                return true;
+#else
+                                                return false;
 #endif
+                                }
+
+                                return false;
+                        }
+
+                        // The codec identifier of segments encoded with e
+                        // The legacy encoding is identified as "LUCENE", so that those segments and segments created since can still be merged without re-encoding them.
+                        strwlen8_t codec_identifier(const Encoding e) noexcept;
+
+                        // Returns false if id is not a Lucene codec identifier
+                        bool encoding_for_codec_identifier(const strwlen8_t id, Encoding *const e) noexcept;
 
                         static constexpr size_t SKIPLIST_STEP{1}; // every (SKIPLIST_STEP * BLOCK_SIZE) documents
 
+                        // Index chunks format version; persisted in the segment id file (see IndexSession::format_version())
+                        // 0: original format
+                        // 1: skiplist entries also track the block's max freq and min document norm, and
+                        //    chunks are terminated by the tail(varbyte encoded) block's max freq and min norm
+                        // 2: chunks of dense terms may be encoded as bitmaps(see DENSE_CHUNK)
+                        static constexpr uint8_t FORMAT_VERSION{2};
+
+                        // Terms that match at least DENSE_MIN_DOCUMENTS documents, and at least one of every DENSE_MAX_SPAN_RATIO document IDs
+                        // in the range they span, are encoded as a bitmap of their documents instead of blocks of document deltas and frequencies.
+                        // Their hits are encoded as usual.
+                        //
+                        // Dense chunks are identified by a skiplist size of DENSE_CHUNK, so skiplists are limited to (DENSE_CHUNK - 1) entries.
+                        // Chunk layout past the header:
+                        // (u32 base, u32 words, u32 minFreq, u8 freqBits, u16 maxFreq, u8 minNorm), bitmap words, bit-packed (freq - minFreq), padding
+                        static constexpr uint16_t DENSE_CHUNK{UINT16_MAX};
+                        static constexpr uint32_t DENSE_MIN_DOCUMENTS{4096};
+                        static constexpr uint32_t DENSE_MAX_SPAN_RATIO{4};
+                        static constexpr size_t   DENSE_CHUNK_HEADER_SIZE{sizeof(uint32_t) * 3 + sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint8_t)};
+                        // we may read up to that many bytes past the last bit-packed frequency
+                        static constexpr size_t DENSE_CHUNK_PADDING{sizeof(uint64_t)};
+
+                        static constexpr size_t skiplist_entry_size(const uint8_t formatVersion) noexcept {
+                                return sizeof(uint32_t) * 5 + sizeof(uint16_t) + (formatVersion ? sizeof(uint16_t) + sizeof(uint8_t) : 0);
+                        }
+
+                        // size of the skiplist and impacts that follow the blocks in an index chunk
+                        static constexpr size_t chunk_trailer_size(const uint8_t formatVersion, const uint16_t skiplistSize) noexcept {
+                                return skiplistSize * skiplist_entry_size(formatVersion) + (formatVersion ? sizeof(uint16_t) + sizeof(uint8_t) : 0);
+                        }
+
                         struct IndexSession final
                             : public Trinity::Codecs::IndexSession {
-#ifdef LUCENE_USE_FASTPFOR
 				// handy for merge()
                                 FastPForLib::FastPFor<4> *forUtil; 
 #ifndef LUCENE_USE_FASTPFOR_TL
                                 std::unique_ptr<FastPForLib::FastPFor<4>> forUtil_local;
-#endif
 #endif
 
                                 // TODO: support for periodic flushing
@@ -72,24 +135,29 @@ namespace Trinity {
                                 uint32_t positionsOutFlushed;
                                 int      positionsOutFd;
                                 uint32_t flushFreq;
+                                // block encoding scheme; see codec_identifier()
+                                const Encoding encoding;
 
                                 // private
                                 void flush_positions_data();
 
-                                IndexSession(const char *bp)
+                                IndexSession(const char *bp, const Encoding e = DEFAULT_ENCODING)
                                     : Trinity::Codecs::IndexSession{bp,
                                                                     unsigned(Capabilities::AppendIndexChunk) |
                                                                         unsigned(Capabilities::Merge)}
                                     , positionsOutFlushed{0}
                                     , positionsOutFd{-1}
-                                    , flushFreq{0} {
-#ifdef LUCENE_USE_FASTPFOR
+                                    , flushFreq{0}
+                                    , encoding{e} {
+                                        if (!encoding_supported(e)) {
+                                                throw Switch::data_error("Lucene codec encoding not supported by this build");
+                                        }
+
 #ifdef LUCENE_USE_FASTPFOR_TL
 					forUtil = _acquire_tl_fastpfor();
 #else
                                         forUtil_local.reset(new FastPForLib::FastPFor<4>());
                                         forUtil = forUtil_local.get();
-#endif
 #endif
                                 }
 
@@ -98,7 +166,7 @@ namespace Trinity {
                                                 close(positionsOutFd);
                                         }
 
-#if defined(LUCENE_USE_FASTPFOR) && defined(LUCENE_USE_FASTPFOR_TL)
+#ifdef LUCENE_USE_FASTPFOR_TL
 					_release_tl_fastpfor(forUtil);
 #endif
                                 }
@@ -114,7 +182,11 @@ namespace Trinity {
                                 Trinity::Codecs::Encoder *new_encoder() override final;
 
                                 strwlen8_t codec_identifier() override final {
-                                        return "LUCENE"_s8;
+                                        return Lucene::codec_identifier(encoding);
+                                }
+
+                                uint8_t format_version() override final {
+                                        return FORMAT_VERSION;
                                 }
 
                                 range32_t append_index_chunk(const Trinity::Codecs::AccessProxy *, const term_index_ctx srcTCTX) override final;
@@ -136,6 +208,9 @@ namespace Trinity {
                                         uint32_t totalDocumentsSoFar;
                                         uint32_t lastHitsBlockTotalHits;
                                         uint16_t curHitsBlockHits;
+                                        // impacts
+                                        uint16_t maxFreq;
+                                        uint8_t  minNorm;
                                 };
 
                               private:
@@ -146,40 +221,46 @@ namespace Trinity {
                                 uint32_t                    termDocuments;
                                 tokenpos_t                  lastPosition;
                                 uint32_t                    termIndexOffset, termPositionsOffset;
-#ifdef LUCENE_USE_FASTPFOR
 #ifndef LUCENE_USE_FASTPFOR_TL
                                 std::unique_ptr<FastPForLib::FastPFor<4>> forUtil_local;
 #endif
                                 FastPForLib::FastPFor<4> *forUtil;
-#endif
+                                // of the session
+                                const Encoding encoding;
                                 IOBuffer       payloadsBuf;
                                 uint32_t       skiplistCountdown, lastHitsBlockOffset, lastHitsBlockTotalHits;
                                 skiplist_entry cur_block;
+                                uint8_t        curDocumentNorm;
+                                // see output_block()
+                                uint16_t untrackedMaxFreq;
+                                uint8_t  untrackedMinNorm;
+                                // the term's documents and their frequencies, in case it is dense(see DENSE_CHUNK)
+                                std::vector<isrc_docid_t> termDocIDs;
+                                std::vector<uint32_t>     termDocFreqs;
+                                uint8_t                   termMinNorm;
 
                               private:
                                 void output_block();
 
+                                void output_dense_chunk();
+
                               public:
                                 Encoder(Trinity::Codecs::IndexSession *s)
-                                    : Trinity::Codecs::Encoder{s} {
-#ifdef LUCENE_USE_FASTPFOR
+                                    : Trinity::Codecs::Encoder{s}, encoding{static_cast<Lucene::IndexSession *>(s)->encoding} {
 #ifdef LUCENE_USE_FASTPFOR_TL
 					forUtil = _acquire_tl_fastpfor();
 #else
                                         forUtil_local.reset(new FastPForLib::FastPFor<4>());
                                         forUtil = forUtil_local.get();
-#endif
 #endif
                                 }
 
-#ifdef LUCENE_USE_FASTPFOR
                                 Encoder(Trinity::Codecs::IndexSession *const s, FastPForLib::FastPFor<4> *const p)
-                                    : Trinity::Codecs::Encoder{s}, forUtil{p} {
+                                    : Trinity::Codecs::Encoder{s}, forUtil{p}, encoding{static_cast<Lucene::IndexSession *>(s)->encoding} {
                                         //
                                 }
-#endif
 
-#if defined(LUCENE_USE_FASTPFOR) && defined(LUCENE_USE_FASTPFOR_TL)
+#ifdef LUCENE_USE_FASTPFOR_TL
 				~Encoder() {
 					_release_tl_fastpfor(forUtil);
 				}
@@ -196,22 +277,39 @@ namespace Trinity {
                                         new_hit(pos, {});
                                 }
 
+                                void document_norm(const uint8_t norm) override final {
+                                        curDocumentNorm = norm;
+                                }
+
                                 void end_document() override final;
 
                                 void end_term(term_index_ctx *tctx) override final;
                         };
 
+                        // How many bytes of a postings list's documents and hits blocks are read ahead by Decoder::prefetch()
+                        // Enough for the first few blocks; the rest will be faulted in(and read ahead by the kernel) as the iterators advance
+                        static constexpr size_t PREFETCH_WINDOW{64 * 1024};
+
                         struct AccessProxy final
                             : public Trinity::Codecs::AccessProxy {
                                 const uint8_t *hitsDataPtr;
                                 uint64_t       hitsDataSize{0};
-
-                                AccessProxy(const char *bp, const uint8_t *p, const uint8_t *hd = nullptr);
+                                // format version of the index chunks (see FORMAT_VERSION)
+                                const uint8_t formatVersion;
+                                // block encoding scheme of the segment(see encoding_for_codec_identifier())
+                                const Encoding encoding;
+                                // if set, decoders will read ahead the first PREFETCH_WINDOW bytes of the postings lists and hits in prefetch()
+                                // This costs two madvise() syscalls per term, which is only worth it if the segment's files are likely not resident
+                                // and the kernel won't read ahead, so it is only set for LoadPolicy::Random
+                                bool prefetch;
+
+                                // hitsPolicy determines how hits.data is loaded, if hd is nullptr
+                                AccessProxy(const char *bp, const uint8_t *p, const uint8_t *hd = nullptr, const uint8_t fmt = FORMAT_VERSION, const Encoding e = Encoding::LUCENE_LEGACY_ENCODING, const LoadPolicy hitsPolicy = LoadPolicy::Default);
 
                                 ~AccessProxy();
 
                                 strwlen8_t codec_identifier() override final {
-                                        return "LUCENE"_s8;
+                                        return Lucene::codec_identifier(encoding);
                                 }
 
                                 Trinity::Codecs::Decoder *new_decoder(const term_index_ctx &tctx) override final;
@@ -219,23 +317,42 @@ namespace Trinity {
 
                         class Decoder;
 
+                        // Hits are decoded the same way for both iterators kinds
+                        //
+                        // refill_hits() only locates the encoded position deltas and payload lengths of the next hits block; the position deltas are decoded
+                        // when a document's hits are materialized, and the payload lengths only if payloads are needed(see Codecs::Decoder::payloads).
+                        // Skipping hits of documents that are not materialized is just a matter of advancing hitsIndex.
+                        struct hits_cursor {
+                                const uint8_t *hdp;
+                                const uint8_t *payloadsIt, *payloadsEnd;
+                                // encoded blocks of the current hits block, or nullptr if decoded
+                                const uint8_t *positionsBlock, *payloadLengthsBlock;
+                                uint32_t       hitsLeft;
+                                uint16_t       hitsIndex;
+                                uint16_t       bufferedHits;
+                                // payloadsIt points to the payload of this hit of the current hits block
+                                uint16_t payloadsIndex;
+                                uint32_t skippedHits;
+                                uint32_t       hitsPositionDeltas[BLOCK_SIZE], hitsPayloadLengths[BLOCK_SIZE];
+                        };
+
                         struct PostingsListIterator final
-                            : public Trinity::Codecs::PostingsListIterator {
+                            : public Trinity::Codecs::PostingsListIterator
+                            , protected hits_cursor {
                                 friend class Decoder;
 
                               protected:
                                 const uint8_t *p;
-                                const uint8_t *hdp;
-                                const uint8_t *payloadsIt, *payloadsEnd;
                                 isrc_docid_t   lastDocID;
                                 uint32_t       lastPosition{0};
-                                uint32_t       docsLeft, hitsLeft;
-                                uint16_t       docsIndex, hitsIndex;
-                                uint16_t       bufferedDocs, bufferedHits;
-                                uint32_t       skippedHits;
-                                uint32_t       docDeltas[BLOCK_SIZE], docFreqs[BLOCK_SIZE], hitsPositionDeltas[BLOCK_SIZE], hitsPayloadLengths[BLOCK_SIZE];
+                                uint32_t       docsLeft;
+                                uint16_t       docsIndex;
+                                uint16_t       bufferedDocs;
+                                uint32_t       docDeltas[BLOCK_SIZE], docFreqs[BLOCK_SIZE];
                                 uint32_t       skipListIdx;
                                 isrc_docid_t   curSkipListLastDocID{DocIDsEND};
+                                // skiplist index block_bound() last resolved a block for
+                                uint32_t boundSkipListIdx;
 
                               public:
                                 inline isrc_docid_t next() override final;
@@ -244,14 +361,53 @@ namespace Trinity {
 
                                 inline void materialize_hits(DocWordsSpace *dwspace, term_hit *out) override final;
 
+                                inline isrc_docid_t block_bound(const isrc_docid_t, block_impact *const) override final;
+
+                                inline uint32_t max_freq_bound() override final;
+
+                                inline uint32_t buffered_documents(isrc_docid_t *const out, const uint32_t max) override final;
+
                                 PostingsListIterator(Decoder *const d)
                                     : Trinity::Codecs::PostingsListIterator{reinterpret_cast<Trinity::Codecs::Decoder *>(d)} {
                                 }
                         };
 
+                        // Iterator for dense chunks(see DENSE_CHUNK)
+                        struct DensePostingsListIterator final
+                            : public Trinity::Codecs::PostingsListIterator
+                            , protected hits_cursor {
+                                friend class Decoder;
+
+                              protected:
+                                // bit of the current document in the bitmap; UINT32_MAX before the first document
+                                uint32_t bit;
+                                // number of documents up to and including the current document
+                                uint32_t docs;
+                                // number of documents whose hits have been materialized or skipped
+                                uint32_t hitsDocs;
+
+                              public:
+                                inline isrc_docid_t next() override final;
+
+                                inline isrc_docid_t advance(const isrc_docid_t) override final;
+
+                                inline void materialize_hits(DocWordsSpace *dwspace, term_hit *out) override final;
+
+                                inline isrc_docid_t block_bound(const isrc_docid_t, block_impact *const) override final;
+
+                                inline uint32_t max_freq_bound() override final;
+
+                                inline const dense_postings *dense_view() noexcept override final;
+
+                                DensePostingsListIterator(Decoder *const d)
+                                    : Trinity::Codecs::PostingsListIterator{reinterpret_cast<Trinity::Codecs::Decoder *>(d)} {
+                                }
+                        };
+
                         class Decoder final
                             : public Trinity::Codecs::Decoder {
                                 friend struct PostingsListIterator;
+                                friend struct DensePostingsListIterator;
 
                               private:
                                 // Pretty much the only shared state among iterators created by
@@ -263,6 +419,8 @@ namespace Trinity {
                                         uint32_t     totalDocumentsSoFar;
                                         uint32_t     totalHitsSoFar;
                                         uint16_t     curHitsBlockHits;
+                                        uint16_t     maxFreq;
+                                        uint8_t      minNorm;
                                 };
 
                               protected:
@@ -272,13 +430,24 @@ namespace Trinity {
 
                                 void materialize_hits(PostingsListIterator *, DocWordsSpace *, term_hit *);
 
+                                isrc_docid_t block_bound(PostingsListIterator *, const isrc_docid_t, block_impact *const);
+
+                                uint32_t max_freq_bound();
+
+                                void next(DensePostingsListIterator *);
+
+                                void advance(DensePostingsListIterator *, const isrc_docid_t);
+
+                                void materialize_hits(DensePostingsListIterator *, DocWordsSpace *, term_hit *);
+
                               private:
                                 const uint8_t *chunkEnd;
+                                uint8_t        formatVersion;
+                                Encoding       encoding;
 #ifdef LUCENE_LAZY_SKIPLIST_INIT
                                 uint16_t skiplistSize;
 #endif
 
-#ifdef LUCENE_USE_FASTPFOR
                                 // when we are decoding during merge, this is apparently expensive now because
                                 // we wind up creating and destroying vectors
                                 // so we are going to allow for reuse - a thread local seems like a good choice here
@@ -287,8 +456,6 @@ namespace Trinity {
 #endif
                                 FastPForLib::FastPFor<4> *forUtil;
 
-#endif
-
                                 struct skiplist_struct final {
                                         skiplist_entry *data;
                                         uint16_t        size{0};
@@ -302,13 +469,37 @@ namespace Trinity {
                                 } skiplist;
                                 const uint8_t *postingListBase, *hitsBase;
                                 uint32_t       totalDocuments, totalHits;
+                                // size of the term's hits in hits.data
+                                uint32_t hitsChunkSize;
+                                // see AccessProxy::prefetch
+                                bool prefetchable;
+                                // impacts of the tail block, which is not tracked in the skiplist
+                                uint16_t tailMaxFreq;
+                                uint8_t  tailMinNorm;
+                                // lazily computed by max_freq_bound()
+                                uint32_t maxFreqBound{UINT32_MAX};
+
+                                // if this is a dense chunk(see DENSE_CHUNK); dense.words is nullptr otherwise
+                                dense_postings dense;
+                                const uint8_t *denseFreqs;
+                                uint32_t       denseMinFreq;
+                                uint8_t        denseFreqBits;
 
                               private:
                                 void init_skiplist(const uint16_t);
 
+                                inline void ensure_skiplist() {
+#ifdef LUCENE_LAZY_SKIPLIST_INIT
+                                        if (unlikely(skiplistSize)) {
+                                                init_skiplist(skiplistSize);
+                                                skiplistSize = 0;
+                                        }
+#endif
+                                }
+
                                 uint32_t skiplist_search(PostingsListIterator *, const isrc_docid_t) const noexcept;
 
-                                void refill_hits(PostingsListIterator *);
+                                void refill_hits(hits_cursor *);
 
                                 void refill_documents(PostingsListIterator *);
 
@@ -326,14 +517,32 @@ namespace Trinity {
 
                                 void decode_next_block(PostingsListIterator *);
 
-                                void skip_hits(PostingsListIterator *, const uint32_t);
+                                void skip_hits(hits_cursor *, const uint32_t);
+
+                                // decodes whatever is needed for materializing the hits of the current hits block, past it->hitsIndex
+                                void decode_hits(hits_cursor *);
+
+                                // materializes freq hits, past the it->skippedHits hits
+                                void materialize_hits(hits_cursor *, uint32_t freq, DocWordsSpace *, term_hit *);
+
+                                // moves to the first document at or after bit `from` of the bitmap
+                                void dense_seek(DensePostingsListIterator *, const uint32_t from);
+
+                                inline uint32_t dense_freq(const uint32_t i) const noexcept;
+
+                                inline void finalize(DensePostingsListIterator *const it) noexcept {
+                                        it->bit            = dense.size * 64;
+                                        it->curDocument.id = DocIDsEND;
+                                        it->freq           = 0;
+                                }
 
                               public:
                                 void init(const term_index_ctx &tctx, Trinity::Codecs::AccessProxy *access) override final;
 
                                 Trinity::Codecs::PostingsListIterator *new_iterator() override final;
 
-#ifdef LUCENE_USE_FASTPFOR
+                                void prefetch() override final;
+
                                 Decoder() {
 #ifdef LUCENE_USE_FASTPFOR_TL
                                         forUtil = _acquire_tl_fastpfor();
@@ -347,9 +556,8 @@ namespace Trinity {
                                     : forUtil{p} {
                                         //
                                 }
-#endif
 
-#if defined(LUCENE_USE_FASTPFOR) && defined(LUCENE_USE_FASTPFOR_TL)
+#ifdef LUCENE_USE_FASTPFOR_TL
                                 ~Decoder() {
                                         _release_tl_fastpfor(forUtil);
                                 }
@@ -370,6 +578,60 @@ namespace Trinity {
                         void PostingsListIterator::materialize_hits(DocWordsSpace *dwspace, term_hit *out) {
                                 static_cast<Codecs::Lucene::Decoder *>(dec)->materialize_hits(this, dwspace, out);
                         }
+
+                        isrc_docid_t PostingsListIterator::block_bound(const isrc_docid_t target, block_impact *const impact) {
+                                return static_cast<Codecs::Lucene::Decoder *>(dec)->block_bound(this, target, impact);
+                        }
+
+                        uint32_t PostingsListIterator::max_freq_bound() {
+                                return static_cast<Codecs::Lucene::Decoder *>(dec)->max_freq_bound();
+                        }
+
+                        uint32_t PostingsListIterator::buffered_documents(isrc_docid_t *const out, const uint32_t max) {
+                                if (curDocument.id == DocIDsEND || docsIndex >= bufferedDocs) {
+                                        // drained, or next() was not invoked yet
+                                        return 0;
+                                }
+
+                                const uint32_t n = std::min<uint32_t>(bufferedDocs - docsIndex, max);
+                                auto           id{curDocument.id};
+
+                                out[0] = id;
+                                for (uint32_t i{1}; i < n; ++i)
+                                        out[i] = (id += docDeltas[docsIndex + i]);
+                                return n;
+                        }
+
+                        isrc_docid_t DensePostingsListIterator::next() {
+                                static_cast<Codecs::Lucene::Decoder *>(dec)->next(this);
+                                return curDocument.id;
+                        }
+
+                        isrc_docid_t DensePostingsListIterator::advance(const isrc_docid_t target) {
+                                static_cast<Codecs::Lucene::Decoder *>(dec)->advance(this, target);
+                                return curDocument.id;
+                        }
+
+                        void DensePostingsListIterator::materialize_hits(DocWordsSpace *dwspace, term_hit *out) {
+                                static_cast<Codecs::Lucene::Decoder *>(dec)->materialize_hits(this, dwspace, out);
+                        }
+
+                        isrc_docid_t DensePostingsListIterator::block_bound(const isrc_docid_t, block_impact *const impact) {
+                                const auto d = static_cast<Codecs::Lucene::Decoder *>(dec);
+
+                                // a single block
+                                impact->maxFreq = d->tailMaxFreq;
+                                impact->minNorm = d->tailMinNorm;
+                                return DocIDsEND;
+                        }
+
+                        uint32_t DensePostingsListIterator::max_freq_bound() {
+                                return static_cast<Codecs::Lucene::Decoder *>(dec)->tailMaxFreq;
+                        }
+
+                        const dense_postings *DensePostingsListIterator::dense_view() noexcept {
+                                return &static_cast<Codecs::Lucene::Decoder *>(dec)->dense;
+                        }
                 } // namespace Lucene
         }         // namespace Codecs
 } // namespace Trinity
@@ -170,6 +170,16 @@ namespace Trinity {
 			// 
                 }
 
+                // If ExecFlags::AccumulatedScoreTopK is set, the exec.engine will periodically ask for
+                // the lowest score a document needs to exceed in order to be worth considering, and it
+                // will skip documents (and whole postings blocks) that can't possibly score higher than that.
+                //
+                // If you are only going to keep the top-K documents, you should return the score of the K-th document once you have
+                // collected K documents; until then, the lowest possible value, which is what the default impl. returns.
+                virtual double min_competitive_score() {
+                        return std::numeric_limits<double>::lowest();
+                }
+
                 // Invoked before the query execution begins by the exec.engine
                 // You may want to override this if you want to be notified and get a chance to do anything before
                 // the engine executes the query in the index source
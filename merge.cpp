@@ -94,6 +94,9 @@ void Trinity::MergeCandidatesCollection::merge(Trinity::Codecs::IndexSession *
         // Only if it's implemented by the codec's IndexSession
         const bool haveAppendIndexChunk = (false == disableOptimizations) && (is->caps & unsigned(Codecs::IndexSession::Capabilities::AppendIndexChunk));
         const bool haveMerge            = (false == disableOptimizations) && (is->caps & unsigned(Codecs::IndexSession::Capabilities::Merge));
+        // documents of terms handled by append_index_chunk() or IndexSession::merge() are not visible to us, so
+        // if any of them are, we can't know the documents IDs bounds of the merged index
+        bool docIDsBoundsTracked{true};
 
         DEFER(
             {
@@ -172,6 +175,8 @@ void Trinity::MergeCandidatesCollection::merge(Trinity::Codecs::IndexSession *
                                         // See comments below for why this is possible
                                         const auto chunk = is->append_index_chunk(c.ap, selected.second);
 
+                                        docIDsBoundsTracked = false;
+
                                         terms->push_back({outTerm, {selected.second.documents, chunk}});
 
                                         ++(defaultFieldStats->totalTerms);
@@ -223,6 +228,7 @@ void Trinity::MergeCandidatesCollection::merge(Trinity::Codecs::IndexSession *
 
                                                         ++(defaultFieldStats->sumTermsDocs);
                                                         defaultFieldStats->sumTermHits += freq;
+                                                        defaultFieldStats->track_document_id(docID);
 
                                                         for (uint32_t i{0}; i < freq; ++i) {
                                                                 const auto &th    = termHitsStorage[i];
@@ -274,6 +280,7 @@ void Trinity::MergeCandidatesCollection::merge(Trinity::Codecs::IndexSession *
                                 if (mergeParticipants.size()) {
                                         enc->begin_term();
                                         is->merge(mergeParticipants.data(), mergeParticipants.size(), enc.get());
+                                        docIDsBoundsTracked = false;
                                         enc->end_term(&tctx);
 
                                         if (tctx.documents) {
@@ -362,6 +369,7 @@ void Trinity::MergeCandidatesCollection::merge(Trinity::Codecs::IndexSession *
 
                                                         ++(defaultFieldStats->sumTermsDocs);
                                                         defaultFieldStats->sumTermHits += freq;
+                                                        defaultFieldStats->track_document_id(lowestDID);
                                                 }
 
                                                 do {
@@ -412,7 +420,11 @@ void Trinity::MergeCandidatesCollection::merge(Trinity::Codecs::IndexSession *
                         }
                 } while (toAdvanceCnt);
         }
-l1:;
+l1:
+        if (!docIDsBoundsTracked) {
+                defaultFieldStats->lowestDocID  = 0;
+                defaultFieldStats->highestDocID = 0;
+        }
 }
 
 std::vector<std::pair<uint64_t, Trinity::MergeCandidatesCollection::IndexSourceRetention>>
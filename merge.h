@@ -70,6 +70,7 @@ namespace Trinity {
                 // If you are going to use ExecFlags::AccumulatedScoreScheme, and your scorer depends on IndexSource::field_statistics, those are
                 // only computed, during merge, for terms that are not handled by append_index_chunk(), so you may want to disable it, so that
                 // statistics for those terms as well will be collected.
+                // For the same reason, field_statistics::lowestDocID and highestDocID are reset to 0(unknown) if any such optimization is used.
                 void merge(Codecs::IndexSession *outIndexSess,
                            simple_allocator *,
                            std::vector<std::pair<str8_t, term_index_ctx>> *const outTerms,
@@ -2,6 +2,10 @@
 
 using namespace Trinity;
 
+static inline bool match_phrase(percolator_document_proxy &src, const compilation_ctx::phrase *const p) {
+        return p->slop ? src.match_sloppy_phrase(p->termIDs, p->size, p->slop) : src.match_phrase(p->termIDs, p->size);
+}
+
 bool percolator_query::match(percolator_document_proxy &src) const {
         return exec(root, src);
 }
@@ -51,7 +55,7 @@ bool percolator_query::exec(const exec_node n, percolator_document_proxy &src) c
                         for (decltype(run->size) i{0}; i != run->size; ++i) {
                                 const auto p = run->phrases[i];
 
-                                if (src.match_phrase(p->termIDs, p->size))
+                                if (match_phrase(src, p))
                                         return true;
                         }
 
@@ -64,7 +68,7 @@ bool percolator_query::exec(const exec_node n, percolator_document_proxy &src) c
                         for (decltype(run->size) i{0}; i != run->size; ++i) {
                                 const auto p = run->phrases[i];
 
-                                if (!src.match_phrase(p->termIDs, p->size))
+                                if (!match_phrase(src, p))
                                         return false;
                         }
 
@@ -74,7 +78,7 @@ bool percolator_query::exec(const exec_node n, percolator_document_proxy &src) c
                 case ENT::matchphrase: {
                         const auto p = static_cast<const compilation_ctx::phrase *>(n.ptr);
 
-                        return src.match_phrase(p->termIDs, p->size);
+                        return match_phrase(src, p);
                 }
 
                 case ENT::logicaland: {
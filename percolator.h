@@ -14,6 +14,12 @@ namespace Trinity {
                 virtual bool match_term(const uint16_t term) = 0;
 
                 virtual bool match_phrase(const uint16_t *, const uint16_t cnt) = 0;
+
+                // For sloppy phrases(see phrase::slop); the terms must appear in order, within a window of at most (cnt + slop) positions
+                // The default impl. throws; override it if your queries may contain sloppy phrases.
+                virtual bool match_sloppy_phrase(const uint16_t *terms, const uint16_t cnt, const uint8_t slop) {
+                        throw Switch::data_error("Sloppy phrases are not supported by this percolator_document_proxy");
+                }
         };
 
         class percolator_query final {
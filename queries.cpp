@@ -103,12 +103,30 @@ static ast_node *parse_phrase_or_token(ast_parser &ctx) {
                 if (!n)
                         return nullptr;
                 else {
-                        auto node = ctx.alloc_node(ast_node::Type::Phrase);
-                        auto p    = static_cast<phrase *>(ctx.allocator.Alloc(sizeof(phrase) + sizeof(term) * n));
+                        auto    node = ctx.alloc_node(ast_node::Type::Phrase);
+                        auto    p    = static_cast<phrase *>(ctx.allocator.Alloc(sizeof(phrase) + sizeof(term) * n));
+                        uint8_t slop{0};
+
+                        if (ctx.content && ctx.content.front() == '~') {
+                                // proximity: ["apple iphone"~3]
+                                const auto *it = ctx.content.data() + 1, *const e = ctx.content.end();
+                                uint32_t    v{0};
+
+                                for (; it != e && isdigit(*it); ++it)
+                                        v = std::min<uint32_t>(v * 10 + (*it - '0'), Limits::MaxPhraseSlop);
+
+                                if (it != ctx.content.data() + 1) {
+                                        ctx.content.strip_prefix(it - ctx.content.data());
+                                        range.len = ctx.content.data() - b;
+                                        slop      = v;
+                                }
+                        }
 
                         p->size = n;
                         std::copy(terms, terms + n, p->terms);
                         p->rep           = 1;
+                        p->slop          = n > 1 ? slop : 0;
+                        p->expansion     = TermExpansion::None;
                         p->app_phrase_id = 0;
                         p->toNextSpan    = DefaultToNextSpan;
                         p->rewrite_ctx.range.reset();
@@ -123,10 +141,63 @@ static ast_node *parse_phrase_or_token(ast_parser &ctx) {
                 if (unlikely(token.size() > Limits::MaxTermLength))
                         return ctx.alloc_node(ast_node::Type::ConstFalse);
 
-                term t;
+                term          t;
+                TermExpansion expansion{TermExpansion::None};
+                auto          inputRange = pair.second;
+                char_t        pattern[Limits::MaxTermLength];
 
                 t.token.Set(token.data(), uint8_t(token.size()));
 
+                if ((ctx.parserFlags & unsigned(ast_parser::Flags::ParseTermPatterns)) && ctx.content && (ctx.content.front() == '*' || ctx.content.front() == '?')) {
+                        // e.g [iphon*] or [colo?r] or [ip*ne*]
+                        // tokens that follow wildcards are parsed with the token parser, so that they are normalized the same way
+                        uint32_t len = token.size();
+
+                        memcpy(pattern, token.data(), len * sizeof(char_t));
+                        for (;;) {
+                                while (ctx.content && (ctx.content.front() == '*' || ctx.content.front() == '?')) {
+                                        if (len == sizeof_array(pattern)) {
+                                                return ctx.alloc_node(ast_node::Type::ConstFalse);
+                                        } else if (ctx.content.front() == '?' || pattern[len - 1] != '*') {
+                                                pattern[len++] = ctx.content.front();
+                                        }
+                                        ctx.content.strip_prefix(1);
+                                }
+
+                                if (!ctx.content || !(isalnum(ctx.content.front()) || uint8_t(ctx.content.front()) >= 128)) {
+                                        break;
+                                }
+
+                                const auto next = ctx.token_parser(ctx.content, ctx.lastParsedToken, false);
+
+                                if (!next.second || next.second + len > sizeof_array(pattern)) {
+                                        return ctx.alloc_node(ast_node::Type::ConstFalse);
+                                }
+
+                                memcpy(pattern + len, ctx.lastParsedToken, next.second * sizeof(char_t));
+                                len += next.second;
+                                ctx.content.strip_prefix(next.first);
+                        }
+
+                        t.token.Set(pattern, uint8_t(len));
+                        expansion      = TermExpansion::Wildcard;
+                        inputRange.len = (ctx.content.data() - ctx.contentBase) - inputRange.offset;
+                } else if ((ctx.parserFlags & unsigned(ast_parser::Flags::ParseTermPatterns)) && ctx.content && ctx.content.front() == '~') {
+                        // e.g [iphnoe~] or [iphnoe~1]
+                        // up to Limits::MaxFuzzyEdits edits, unless specified
+                        const auto *it = ctx.content.data() + 1, *const e = ctx.content.end();
+                        uint32_t    v{Limits::MaxFuzzyEdits};
+
+                        if (it != e && isdigit(*it)) {
+                                for (v = 0; it != e && isdigit(*it); ++it)
+                                        v = std::min<uint32_t>(v * 10 + (*it - '0'), Limits::MaxFuzzyEdits);
+                        }
+
+                        ctx.content.strip_prefix(it - ctx.content.data());
+                        expansion      = v == 0 ? TermExpansion::None : v == 1 ? TermExpansion::FuzzyOneEdit : TermExpansion::FuzzyTwoEdits;
+                        inputRange.len = (ctx.content.data() - ctx.contentBase) - inputRange.offset;
+                }
+
                 auto node = ctx.alloc_node(ast_node::Type::Token);
                 auto p    = static_cast<phrase *>(ctx.allocator.Alloc(sizeof(phrase) + sizeof(term)));
 
@@ -135,13 +206,15 @@ static ast_node *parse_phrase_or_token(ast_parser &ctx) {
                 p->size          = 1;
                 p->terms[0]      = t;
                 p->rep           = 1;
+                p->slop          = 0;
+                p->expansion     = expansion;
                 p->app_phrase_id = 0;
                 p->toNextSpan    = DefaultToNextSpan;
                 p->rewrite_ctx.range.reset();
                 p->rewrite_ctx.srcSeqSize             = 0;
                 p->rewrite_ctx.translationCoefficient = 1.0;
                 p->flags                              = 0;
-                p->inputRange                         = pair.second;
+                p->inputRange                         = inputRange;
                 node->p                               = p;
 
                 return node;
@@ -266,6 +339,8 @@ void PrintImpl(Buffer &b, const Trinity::phrase &p) {
         if (p.size)
                 b.shrink_by(1);
         b.append('"');
+        if (p.slop)
+                b.append('~', uint32_t(p.slop));
 	if (p.app_phrase_id)
 		b.append("<APP:", p.app_phrase_id, '>');
 #if defined(_VERBOSE_DESCR)
@@ -292,6 +367,10 @@ static void print_token(Buffer &b, const phrase *const p) {
         EXPECT(p);
 
         b.append(p->terms[0].token);
+        if (p->expansion == TermExpansion::FuzzyOneEdit)
+                b.append("~1"_s8);
+        else if (p->expansion == TermExpansion::FuzzyTwoEdits)
+                b.append("~2"_s8);
 	if (p->app_phrase_id)
 		b.append("<APP:", p->app_phrase_id, '>');
 #if defined(_VERBOSE_DESCR)
@@ -1361,6 +1440,8 @@ ast_node *ast_node::copy(simple_allocator *const a, std::vector<void *> *const l
 
                         np->size                               = n->p->size;
                         np->rep                                = n->p->rep;
+                        np->slop                               = n->p->slop;
+                        np->expansion                          = n->p->expansion;
                         np->index                              = n->p->index;
                         np->app_phrase_id                      = n->p->app_phrase_id;
                         np->toNextSpan                         = n->p->toNextSpan;
@@ -237,6 +237,10 @@ namespace Trinity {
                         ANDAsToken         = 1u << 2,
                         ParseConstTrueExpr = 1u << 3,
                         ParseMatchSomeExpr = 1u << 4,
+                        // Tokens followed by '*' or '?' are parsed as wildcard patterns, e.g [iphon*] or [colo?r]
+                        // and tokens followed by '~' as fuzzy terms, e.g [iphnoe~] or [iphnoe~1]
+                        // See TermExpansion
+                        ParseTermPatterns = 1u << 5,
                 };
 
                 str32_t           content;
@@ -309,6 +313,18 @@ namespace Trinity {
                 void track_term(term &t);
         };
 
+        // See phrase::expansion
+        enum class TermExpansion : uint8_t {
+                None = 0,
+                // The token is a pattern, where '*' matches 0 or more characters and '?' exactly one character, e.g [iphon*]
+                // It must begin with at least one literal character.
+                Wildcard,
+                // The token matches terms within 1(or 2) edits(insertions, deletions or substitutions) of it, e.g [iphnoe~1] or [iphnoe~]
+                // See levenshtein_automaton
+                FuzzyOneEdit,
+                FuzzyTwoEdits,
+        };
+
         struct phrase final {
                 // total terms (1 for a single token)
                 uint8_t size;
@@ -321,6 +337,17 @@ namespace Trinity {
                 // See Trinity::rewrite_query() where we consider this when rewriting sequences
                 uint8_t rep;
 
+                // For phrases, how many other tokens are allowed among the phrase tokens in a document, i.e the phrase terms
+                // must appear in order, within a window of at most (size + slop) positions. 0 for exact phrases.
+                // This is set for e.g ["apple iphone"~3] and can't exceed Limits::MaxPhraseSlop
+                uint8_t slop;
+
+                // For tokens, if not TermExpansion::None, the token is expanded to the terms of each index source that match it, before
+                // the query is compiled for that source(see exec_query()). Expansions are capped to Limits::MaxTermExpansions terms; the
+                // terms with the highest documents frequency are selected.
+                // Compiled query plans(see compiled_query_plan) are not specific to an index source, so they throw for queries with expansions.
+                TermExpansion expansion;
+
                 // index in the query
                 uint16_t index;
                 // See assign_query_indices() for how this is assigned
@@ -459,7 +486,7 @@ namespace Trinity {
                 bool operator==(const phrase &o) const noexcept {
                         //WAS: if (size == o.size)
                         // XXX: should we also check if (this->app_phrase_id == o.app_phrase_id) ?
-                        if (size == o.size && flags == o.flags) {
+                        if (size == o.size && flags == o.flags && slop == o.slop && expansion == o.expansion) {
                                 size_t i;
 
                                 for (i = 0; i != size && terms[i].token == o.terms[i].token; ++i)
@@ -476,6 +503,8 @@ namespace Trinity {
 
                         p->flags         = 0;
                         p->rep           = 1;
+                        p->slop          = 0;
+                        p->expansion     = TermExpansion::None;
                         p->inputRange.reset();
                         p->app_phrase_id = 0;
                         p->toNextSpan = DefaultToNextSpan;
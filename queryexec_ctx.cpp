@@ -271,6 +271,8 @@ void queryexec_ctx::prepare_decoder(exec_term_id_t termID) {
                 auto       dec = decode_ctx.decoders[termID] = idxsrc->new_postings_decoder(p.second, p.first);
 
                 dec->set_exec(termID, this);
+                dec->payloads = payloads;
+                dec->prefetch();
         }
 
         require(decode_ctx.decoders[termID]);
@@ -281,7 +283,8 @@ exec_term_id_t queryexec_ctx::resolve_term(const str8_t term) {
 
         if (res.second) {
                 auto       ptr  = &res.first->second;
-                const auto tctx = idxsrc->term_ctx(term);
+                const auto it   = resolvedTerms.find(term);
+                const auto tctx = it != resolvedTerms.end() ? it->second : idxsrc->term_ctx(term);
 
                 if (tctx.documents == 0) {
                         // matches no documents, unknown
@@ -295,6 +298,29 @@ exec_term_id_t queryexec_ctx::resolve_term(const str8_t term) {
         return res.first->second;
 }
 
+void queryexec_ctx::resolve_terms(std::vector<str8_t> &terms) {
+        std::sort(terms.begin(), terms.end(), [](const auto &a, const auto &b) noexcept {
+                return terms_cmp(a.data(), a.size(), b.data(), b.size()) < 0;
+        });
+        terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+        terms.erase(std::remove_if(terms.begin(), terms.end(), [this](const auto &t) {
+                            return termsDict.count(t) || resolvedTerms.count(t);
+                    }),
+                    terms.end());
+
+        if (terms.empty()) {
+                return;
+        }
+
+        std::vector<term_index_ctx> tctxs(terms.size());
+
+        idxsrc->terms_ctx(terms.data(), terms.size(), tctxs.data());
+        // IDs are only assigned by resolve_term(), so that they follow the order the terms are resolved in, not the sort order
+        for (std::size_t i{0}; i != terms.size(); ++i) {
+                resolvedTerms.insert({terms[i], tctxs[i]});
+        }
+}
+
 void queryexec_ctx::decode_ctx_struct::check(const uint16_t idx) {
         if (idx >= capacity) {
                 const auto newCapacity{idx + 8};
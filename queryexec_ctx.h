@@ -122,6 +122,15 @@ namespace Trinity {
                 IndexSource *const                  idxsrc;
                 iterators_collector                 collectedIts;
                 Similarity::IndexSourceTermsScorer *scorer{nullptr};
+                // see ExecFlags::AccumulatedScoreTopK
+                bool dynamicPruning{false};
+                // see ExecFlags::DisregardPayloads
+                bool payloads{true};
+                // the documents range and budget of the execution; see union_terms()
+                isrc_docids_range docIDsRange;
+                exec_budget *     budget{nullptr};
+                // indexed by exec term ID; set for the terms tokens were expanded to(see phrase::expansion)
+                std::vector<bool> expansionTerms;
 
                 queryexec_ctx(IndexSource *src, const bool documentsOnly_, const bool accumScoreMode_)
                     : documentsOnly{documentsOnly_}, accumScoreMode{accumScoreMode_}, idxsrc{src} {
@@ -148,6 +157,11 @@ namespace Trinity {
                 // See Termspaces in CONCEPTS.md
                 exec_term_id_t resolve_term(const str8_t term);
 
+                // Resolves all terms up front, with a single IndexSource::terms_ctx() call, so that
+                // resolve_term() won't need to resolve them one at a time. terms are sorted in place.
+                // This doesn't assign terms IDs; resolve_term() still does, in the order it's invoked.
+                void resolve_terms(std::vector<str8_t> &terms);
+
                 DocsSetIterators::Iterator *build_iterator(const exec_node n, const uint32_t execFlags);
 
                 // Instead of having a virtual DocsSetIterators::Iterator::~Iterator()
@@ -247,6 +261,8 @@ namespace Trinity {
                 // we can instead assign lastBank to (&docstracker_bank::dummy_bank)
                 // and because its base is set to an 'impossible' value, it will work great
                 std::unordered_map<str8_t, exec_term_id_t> termsDict;
+                // See resolve_terms()
+                std::unordered_map<str8_t, term_index_ctx> resolvedTerms;
 
 
                 // TODO: determine suitable allocator bank size based on some meaningful metric
@@ -71,6 +71,14 @@ namespace Trinity {
                 }
 
                 virtual double iterator_score() = 0;
+
+                // Upper bound of iterator_score() for any document the wrapped iterator matches with upto maxFreq matches
+                // and an encoded length norm no lower than minNorm (see Codecs::block_impact).
+                // This is only meaningful for PostingsListIterator wrappers, and is used for dynamic pruning
+                // (see DocsSetSpanForDisjunctionsWithBlockMax). The default impl. returns +inf, i.e no pruning.
+                virtual double iterator_max_score(const uint32_t maxFreq, const uint8_t minNorm) {
+                        return std::numeric_limits<double>::infinity();
+                }
         };
 
         double relevant_document_provider::score() {
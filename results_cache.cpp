@@ -0,0 +1,74 @@
+#include "results_cache.h"
+#include <switch_hash.h>
+
+void Trinity::QueryResultsCache::erase(std::list<entry>::iterator it) {
+        size -= it->footprint;
+        map.erase(it->hash);
+        lru.erase(it);
+}
+
+std::shared_ptr<const Trinity::QueryResultsCache::results> Trinity::QueryResultsCache::lookup(const str32_t key, const uint64_t validity) {
+        const auto                  hash = FNVHash64(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+        std::lock_guard<std::mutex> g(lock);
+        const auto                  it = map.find(hash);
+
+        if (it == map.end() || it->second->key.size() != key.size() || memcmp(it->second->key.data(), key.data(), key.size())) {
+                ++stats.misses;
+                return nullptr;
+        }
+
+        if (it->second->validity != validity) {
+                // the documents masked for the source have changed
+                erase(it->second);
+                ++stats.stale;
+                return nullptr;
+        }
+
+        lru.splice(lru.begin(), lru, it->second);
+        ++stats.hits;
+        return it->second->res;
+}
+
+void Trinity::QueryResultsCache::insert(const str32_t key, const uint64_t generation, const uint64_t validity, std::shared_ptr<const results> res) {
+        const auto hash      = FNVHash64(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+        const auto footprint = res->footprint() + key.size() + sizeof(entry);
+
+        if (footprint > max_results_footprint()) {
+                return;
+        }
+
+        std::lock_guard<std::mutex> g(lock);
+
+        if (auto it = map.find(hash); it != map.end()) {
+                // stale, a hash collision, or another thread got here first
+                erase(it->second);
+        }
+
+        lru.push_front({hash, std::string(key.data(), key.size()), generation, validity, footprint, std::move(res)});
+        map.emplace(hash, lru.begin());
+        size += footprint;
+
+        while (size > capacity) {
+                erase(std::prev(lru.end()));
+        }
+}
+
+void Trinity::QueryResultsCache::evict_source(const uint64_t generation) {
+        std::lock_guard<std::mutex> g(lock);
+
+        for (auto it = lru.begin(); it != lru.end();) {
+                if (it->generation == generation) {
+                        erase(it++);
+                } else {
+                        ++it;
+                }
+        }
+}
+
+void Trinity::QueryResultsCache::clear() {
+        std::lock_guard<std::mutex> g(lock);
+
+        map.clear();
+        lru.clear();
+        size = 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "common.h"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace Trinity {
+        // A bounded(LRU) cache of query execution results, for each index source.
+        //
+        // Index sources(e.g segments) are immutable, and are identified by their generation, so the documents a query matches
+        // in a source only change if the documents masked by more recent sources change(see IndexSourcesCollection::masking_signature()).
+        // exec_query_cached() uses this cache to store the matched documents, and scores if the accumulated score scheme is used, for
+        // each (normalized query, exec flags, source) and to skip the execution for sources that haven't changed since.
+        //
+        // It is thread-safe. Results are reference counted so that they can be evicted while they are still being used.
+        class QueryResultsCache final {
+              public:
+                struct results final {
+                        std::vector<docid_t> documents;
+                        // Empty unless ExecFlags::AccumulatedScoreScheme was set; scores[i] is the score of documents[i]
+                        std::vector<double> scores;
+
+                        std::size_t footprint() const noexcept {
+                                return sizeof(results) + documents.capacity() * sizeof(docid_t) + scores.capacity() * sizeof(double);
+                        }
+                };
+
+              private:
+                struct entry final {
+                        uint64_t                       hash;
+                        std::string                    key;
+                        uint64_t                       generation; // of the source
+                        // the results are only valid if the source's masking signature(or the collection signature, for scores) hasn't changed
+                        uint64_t                       validity;
+                        std::size_t                    footprint;
+                        std::shared_ptr<const results> res;
+                };
+
+                const std::size_t                                        capacity;
+                std::size_t                                              size{0};
+                std::mutex                                               lock;
+                std::list<entry>                                         lru; // most recently used first
+                std::unordered_map<uint64_t, std::list<entry>::iterator> map;
+
+              private:
+                void erase(std::list<entry>::iterator it);
+
+              public:
+                struct {
+                        uint64_t hits{0};
+                        uint64_t misses{0};
+                        // found, but invalidated because the masked documents changed
+                        uint64_t stale{0};
+                } stats;
+
+              public:
+                // capacity is in bytes
+                QueryResultsCache(const std::size_t c = 256 * 1024 * 1024)
+                    : capacity{c} {
+                }
+
+                // Results larger than this are not worth caching; they would evict too many other entries
+                std::size_t max_results_footprint() const noexcept {
+                        return capacity / 16;
+                }
+
+                // Returns nullptr if there are no results for key, or they are no longer valid
+                std::shared_ptr<const results> lookup(const str32_t key, const uint64_t validity);
+
+                void insert(const str32_t key, const uint64_t generation, const uint64_t validity, std::shared_ptr<const results> res);
+
+                // Drops all results for a source
+                // You may want to do this when a source is no longer used(e.g segments have been merged), otherwise
+                // its results will be evicted eventually.
+                void evict_source(const uint64_t generation);
+
+                void clear();
+        };
+} // namespace Trinity
@@ -1,8 +1,9 @@
 #include "segment_index_source.h"
+#include "eliasfano_codec.h"
 #include "google_codec.h"
 #include "lucene_codec.h"
 
-Trinity::SegmentIndexSource::SegmentIndexSource(const char *basePath)
+Trinity::SegmentIndexSource::SegmentIndexSource(const char *basePath, const LoadPolicy policy)
 {
         int fd;
         char path[PATH_MAX];
@@ -44,7 +45,7 @@ Trinity::SegmentIndexSource::SegmentIndexSource(const char *basePath)
                 else
                         close(fd);
 
-                terms.reset(new SegmentTerms(basePath));
+                terms.reset(new SegmentTerms(basePath, policy));
 
                 snprintf(path, sizeof(path), "%s/index", basePath);
                 fd = open(path, O_RDONLY | O_LARGEFILE);
@@ -81,11 +82,11 @@ Trinity::SegmentIndexSource::SegmentIndexSource(const char *basePath)
                         close(fd);
                         index.Set(p, fileSize);
 #else
-                        auto fileData = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+                        auto fileData = Utilities::map_file(fd, fileSize, policy);
 
                         close(fd);
                         if (unlikely(fileData == MAP_FAILED))
-                                throw Switch::data_error("Failed to acess ", path);
+                                throw Switch::data_error("Failed to acess ", path, ":", strerror(errno));
 
                         madvise(fileData, fileSize, MADV_DONTDUMP);
                         index.Set(static_cast<const uint8_t *>(fileData), uint32_t(fileSize));
@@ -94,6 +95,7 @@ Trinity::SegmentIndexSource::SegmentIndexSource(const char *basePath)
 
                 char codecStorage[128];
                 strwlen8_t codec;
+                uint8_t codecFormatVersion{0};
 
                 snprintf(path, sizeof(path), "%s/id", basePath);
                 fd = open(path, O_RDONLY | O_LARGEFILE);
@@ -144,7 +146,12 @@ Trinity::SegmentIndexSource::SegmentIndexSource(const char *basePath)
                                 throw Switch::system_error("Failed to read ID");
                         }
 
-                        if (*p++ != 1)
+                        // release 1: no codec format version (implied 0)
+                        // release 2: codec format version follows the field statistics
+                        // release 3: documents IDs bounds follow the codec format version
+                        const auto release = *p++;
+
+                        if (release < 1 || release > 3)
                         {
                                 close(fd);
                                 throw Switch::system_error("Failed to read ID: unsupported release");
@@ -166,14 +173,37 @@ Trinity::SegmentIndexSource::SegmentIndexSource(const char *basePath)
                         defaultFieldStats.docsCnt = *(uint32_t *)p;
                         p += sizeof(uint32_t);
 
+                        if (release >= 2)
+                        {
+                                if (unlikely(p + sizeof(uint8_t) > b + fileSize))
+                                        throw Switch::system_error("Unexpected ID contents");
+
+                                codecFormatVersion = *p++;
+                        }
+
+                        if (release >= 3)
+                        {
+                                if (unlikely(p + sizeof(isrc_docid_t) * 2 > b + fileSize))
+                                        throw Switch::system_error("Unexpected ID contents");
+
+                                defaultFieldStats.lowestDocID = *(isrc_docid_t *)p;
+                                p += sizeof(isrc_docid_t);
+                                defaultFieldStats.highestDocID = *(isrc_docid_t *)p;
+                                p += sizeof(isrc_docid_t);
+                        }
+
                         // SLog("Restored codec '", codec, "' sumTermHits = ", dotnotation_repr(defaultFieldStats.sumTermHits), ", totalTerms = ", dotnotation_repr(defaultFieldStats.totalTerms), ", sumTermsDocs = ", dotnotation_repr(defaultFieldStats.sumTermsDocs), ", docsCnt = ", dotnotation_repr(defaultFieldStats.docsCnt), "\n");
                 }
 
-                if (codec.Eq(_S("LUCENE")))
-                        accessProxy.reset(new Trinity::Codecs::Lucene::AccessProxy(basePath, index.start()));
+                if (Trinity::Codecs::Lucene::Encoding encoding; Trinity::Codecs::Lucene::encoding_for_codec_identifier(codec, &encoding))
+                        accessProxy.reset(new Trinity::Codecs::Lucene::AccessProxy(basePath, index.start(), nullptr, codecFormatVersion, encoding, policy));
 #ifdef TRINITY_CODECS_GOOGLE_AVAILABLE
                 else if (codec.Eq(_S("GOOGLE")))
                         accessProxy.reset(new Trinity::Codecs::Google::AccessProxy(basePath, index.start()));
+#endif
+#ifdef TRINITY_CODECS_ELIASFANO_AVAILABLE
+                else if (codec.Eq(_S("ELIASFANO")))
+                        accessProxy.reset(new Trinity::Codecs::EliasFano::AccessProxy(basePath, index.start()));
 #endif
                 else
                         throw Switch::data_error("Unknown codec");
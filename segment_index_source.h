@@ -2,6 +2,7 @@
 #include "index_source.h"
 #include "terms.h"
 #include "docidupdates.h"
+#include "utils.h"
 
 namespace Trinity {
         // You can use SegmentIndexSession to create a new segment
@@ -29,7 +30,9 @@ namespace Trinity {
                 } maskedDocuments;
 
               public:
-                SegmentIndexSource(const char *basePath);
+                // policy determines how the index, terms.data and hits.data(for the Lucene codec) files are loaded, so that
+                // e.g hot segments can be pinned in memory, while large and rarely accessed segments are left to the page cache
+                SegmentIndexSource(const char *basePath, const LoadPolicy policy = LoadPolicy::Default);
 
                 bool index_empty() const noexcept override final {
                         return accessProxy.get() == nullptr;
@@ -48,6 +51,11 @@ namespace Trinity {
                 }
 
                 term_index_ctx resolve_term_ctx(const str8_t term) override final {
+                        if (!terms->may_contain(term)) {
+                                // fast path for terms not in this segment
+                                return {};
+                        }
+
 #if 1
                         return terms->lookup(term);
 #else
@@ -61,10 +69,38 @@ namespace Trinity {
 #endif
                 }
 
+                void resolve_terms_ctx(const str8_t *const list, const std::size_t n, term_index_ctx *const out) override final {
+                        // only look up the terms that may be in this segment, in one pass(see SegmentTerms::lookup())
+                        std::vector<str8_t>   candidates;
+                        std::vector<uint32_t> indices;
+
+                        for (std::size_t i{0}; i != n; ++i) {
+                                if (terms->may_contain(list[i])) {
+                                        candidates.push_back(list[i]);
+                                        indices.push_back(i);
+                                } else {
+                                        out[i] = {};
+                                }
+                        }
+
+                        if (const auto cnt = candidates.size()) {
+                                std::vector<term_index_ctx> resolved(cnt);
+
+                                terms->lookup(candidates.data(), cnt, resolved.data());
+                                for (std::size_t i{0}; i != cnt; ++i) {
+                                        out[indices[i]] = resolved[i];
+                                }
+                        }
+                }
+
                 auto segment_terms() const {
                         return terms.get();
                 }
 
+                IndexSourceTermsView *new_terms_view(const str8_t prefix) override final {
+                        return terms->new_terms_view(prefix);
+                }
+
                 Trinity::Codecs::Decoder *new_postings_decoder(strwlen8_t, const term_index_ctx ctx) override final {
                         return accessProxy->new_decoder(ctx);
                 }
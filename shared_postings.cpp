@@ -0,0 +1,100 @@
+#include "shared_postings.h"
+
+bool Trinity::Codecs::Materialized::materialize(IndexSource *const src, const str8_t term, const term_index_ctx tctx, const Content content, const std::size_t maxFootprint, postings *const out) {
+        std::unique_ptr<Trinity::Codecs::Decoder>              dec(src->new_postings_decoder(term, tctx));
+        std::unique_ptr<Trinity::Codecs::PostingsListIterator> it(dec->new_iterator());
+        std::unique_ptr<DocWordsSpace>                         dws;
+        const bool                                             withFreqs = content != Content::DocIDs;
+        const bool                                             withHits  = content == Content::Hits;
+
+        // the decoder may dws->set() with the exec term ID; we are not going to use dws anyway
+        dec->set_exec(1, nullptr);
+
+        out->tctx = tctx;
+        out->documents.reserve(tctx.documents);
+        if (withFreqs)
+                out->freqs.reserve(tctx.documents);
+        if (withHits) {
+                out->hitsOffsets.reserve(tctx.documents);
+                dws.reset(new DocWordsSpace(src->max_indexed_position()));
+        }
+
+        for (auto id = it->next(); id != DocIDsEND; id = it->next()) {
+                out->documents.push_back(id);
+
+                if (withFreqs) {
+                        const auto freq = it->freq;
+
+                        out->freqs.push_back(freq);
+                        out->maxFreq = std::max<uint32_t>(out->maxFreq, freq);
+
+                        if (withHits) {
+                                const auto offset = out->hits.size();
+
+                                out->hitsOffsets.push_back(offset);
+                                out->hits.resize(offset + freq);
+                                it->materialize_hits(dws.get(), out->hits.data() + offset);
+                        }
+                }
+
+                if (unlikely(out->footprint() > maxFootprint)) {
+                        *out = postings{};
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+Trinity::isrc_docid_t Trinity::Codecs::Materialized::PostingsListIterator::next() {
+        if (unlikely(idx == p->documents.size())) {
+                curDocument.id = DocIDsEND;
+                return DocIDsEND;
+        }
+
+        if (!p->freqs.empty())
+                freq = p->freqs[idx];
+
+        // the postings were decoded once, but we account for them as they are consumed, as codecs do(see exec_budget)
+        ++dec->decodedPostings;
+        curDocument.id = p->documents[idx++];
+        return curDocument.id;
+}
+
+Trinity::isrc_docid_t Trinity::Codecs::Materialized::PostingsListIterator::advance(const isrc_docid_t target) {
+        const auto *const base = p->documents.data();
+        const auto *const end  = base + p->documents.size();
+        const auto *const it   = std::lower_bound(base + idx, end, target);
+
+        if (it == end) {
+                idx            = p->documents.size();
+                curDocument.id = DocIDsEND;
+                return DocIDsEND;
+        }
+
+        idx = it - base;
+        return next();
+}
+
+void Trinity::Codecs::Materialized::PostingsListIterator::materialize_hits(DocWordsSpace *const dwspace, term_hit *const out) {
+        // idx has been advanced past the current document
+        const auto i = idx - 1;
+
+        if (p->hitsOffsets.empty()) {
+                // hits were not materialized; this should never happen(see exec_queries_batch())
+                std::abort();
+        }
+
+        const auto termID = dec->exec_ctx_termid();
+        const auto hits   = p->hits.data() + p->hitsOffsets[i];
+        const auto n      = p->freqs[i];
+
+        for (uint32_t k{0}; k != n; ++k) {
+                const auto pos = hits[k].pos;
+
+                if (pos)
+                        dwspace->set(termID, pos);
+
+                out[k] = hits[k];
+        }
+}
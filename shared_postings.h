@@ -0,0 +1,139 @@
+// Postings lists decoded in memory once, and accessed by many executions.
+// See exec_queries_batch()
+#pragma once
+#include "index_source.h"
+
+namespace Trinity {
+        namespace Codecs {
+                namespace Materialized {
+                        // A term's postings list, fully decoded
+                        struct postings final {
+                                term_index_ctx            tctx;
+                                std::vector<isrc_docid_t> documents;
+                                // Empty unless frequencies were materialized
+                                std::vector<uint32_t> freqs;
+                                // Empty unless hits were materialized; hits of documents[i] are hits[hitsOffsets[i], hitsOffsets[i] + freqs[i])
+                                std::vector<uint32_t> hitsOffsets;
+                                std::vector<term_hit> hits;
+                                uint32_t              maxFreq{0};
+
+                                std::size_t footprint() const noexcept {
+                                        return documents.capacity() * sizeof(isrc_docid_t) + freqs.capacity() * sizeof(uint32_t) + hitsOffsets.capacity() * sizeof(uint32_t) + hits.capacity() * sizeof(term_hit);
+                                }
+                        };
+
+                        enum class Content : uint8_t {
+                                DocIDs = 0,
+                                Freqs,
+                                Hits
+                        };
+
+                        // Decodes the postings list of term using the decoder provided by src. Returns false
+                        // if the decoded postings exceed maxFootprint bytes, in which case out is left cleared.
+                        bool materialize(IndexSource *src, const str8_t term, const term_index_ctx tctx, const Content content, const std::size_t maxFootprint, postings *out);
+
+                        class Decoder;
+
+                        struct PostingsListIterator final
+                            : public Trinity::Codecs::PostingsListIterator {
+                                friend class Decoder;
+
+                              private:
+                                const postings *const p;
+                                uint32_t              idx{0};
+
+                              public:
+                                PostingsListIterator(Trinity::Codecs::Decoder *const d, const postings *const p_)
+                                    : Trinity::Codecs::PostingsListIterator{d}, p{p_} {
+                                }
+
+                                isrc_docid_t next() override final;
+
+                                isrc_docid_t advance(const isrc_docid_t target) override final;
+
+                                void materialize_hits(DocWordsSpace *dwspace, term_hit *out) override final;
+
+                                uint32_t max_freq_bound() override final {
+                                        return p->freqs.empty() ? std::numeric_limits<tokenpos_t>::max() : p->maxFreq;
+                                }
+                        };
+
+                        class Decoder final
+                            : public Trinity::Codecs::Decoder {
+                              private:
+                                const postings *const p;
+
+                              public:
+                                Decoder(const postings *const p_)
+                                    : p{p_} {
+                                        indexTermCtx = p->tctx;
+                                }
+
+                                // The postings list is already decoded
+                                void init(const term_index_ctx &, AccessProxy *) override final {
+                                }
+
+                                Trinity::Codecs::PostingsListIterator *new_iterator() override final {
+                                        return new PostingsListIterator(this, p);
+                                }
+                        };
+                } // namespace Materialized
+        }         // namespace Codecs
+
+        // Wraps an index source; postings lists of terms registered with share() are accessed from memory, and
+        // everything else is delegated to the wrapped source.
+        //
+        // The wrapped source must outlive this source, and so must the registered postings.
+        class SharedPostingsIndexSource final
+            : public IndexSource {
+              private:
+                IndexSource *const                                                    src;
+                std::unordered_map<str8_t, const Codecs::Materialized::postings *> shared;
+
+              public:
+                SharedPostingsIndexSource(IndexSource *const s)
+                    : src{s} {
+                        gen = src->generation();
+                }
+
+                // term must remain valid for as long as this source is used
+                void share(const str8_t term, const Codecs::Materialized::postings *const p) {
+                        shared[term] = p;
+                }
+
+                term_index_ctx resolve_term_ctx(const str8_t term) override final {
+                        return src->term_ctx(term);
+                }
+
+                bool require_docid_translation() const override final {
+                        return src->require_docid_translation();
+                }
+
+                docid_t translate_docid(const isrc_docid_t localId) override final {
+                        return src->translate_docid(localId);
+                }
+
+                Trinity::Codecs::Decoder *new_postings_decoder(const str8_t term, const term_index_ctx ctx) override final {
+                        if (const auto it = shared.find(term); it != shared.end())
+                                return new Codecs::Materialized::Decoder(it->second);
+                        else
+                                return src->new_postings_decoder(term, ctx);
+                }
+
+                updated_documents masked_documents() override final {
+                        return src->masked_documents();
+                }
+
+                tokenpos_t max_indexed_position() const override final {
+                        return src->max_indexed_position();
+                }
+
+                field_statistics default_field_stats() override final {
+                        return src->default_field_stats();
+                }
+
+                bool index_empty() const override final {
+                        return src->index_empty();
+                }
+        };
+} // namespace Trinity
@@ -38,6 +38,25 @@ namespace Trinity {
                         // Scores a single document; freq is the number of matches in the current document of
                         // either a single term or a phrase
                         virtual float score(const isrc_docid_t id, const uint16_t freq, const ScorerWeight *) = 0;
+
+                        // Returns an upper bound of score() for any document with upto maxFreq matches, and an encoded
+                        // length norm(see Codecs::encode_norm()) no lower than minNorm.
+                        // This is used for dynamic pruning (see ExecFlags::AccumulatedScoreTopK), where we skip documents
+                        // and whole postings blocks that can't possibly score high enough to be considered.
+                        //
+                        // The default impl. can't tell, so it returns +inf, which effectively disables pruning. If your score() depends on
+                        // e.g document normalization factors, you should return the score for the most favorable normalization that's
+                        // possible given minNorm.
+                        virtual float max_score(const uint32_t maxFreq, const uint8_t minNorm, const ScorerWeight *) {
+                                return std::numeric_limits<float>::infinity();
+                        }
+
+                        // Identifies the scoring function(and its parameters), so that scores computed by different scorers are never
+                        // mixed up in a QueryResultsCache(see exec_query_cached()). Scorers that compute the same scores must return the same key.
+                        // The default impl. returns 0, which means it can't tell, and the scores computed by this scorer won't be cached.
+                        virtual uint64_t cache_key() const {
+                                return 0;
+                        }
                 };
 
                 struct IndexSourcesCollectionTermsScorer {
@@ -64,6 +83,14 @@ namespace Trinity {
                                 float score(const isrc_docid_t, const uint16_t freq, const ScorerWeight *) override final {
                                         return freq;
                                 }
+
+                                float max_score(const uint32_t maxFreq, const uint8_t, const ScorerWeight *) override final {
+                                        return maxFreq;
+                                }
+
+                                uint64_t cache_key() const override final {
+                                        return 1;
+                                }
                         };
 
                         IndexSourceTermsScorer *new_source_scorer(IndexSource *s) override final {
@@ -139,6 +166,15 @@ namespace Trinity {
                                         // TODO: if we had normalizations, we 'd instead return v * decodeNormValue(id) or something
                                         return v;
                                 }
+
+                                // tf() is monotonic, so this is the score of a document with maxFreq matches
+                                float max_score(const uint32_t maxFreq, const uint8_t, const Similarity::ScorerWeight *sw) override final {
+                                        return tf(maxFreq) * static_cast<const ScorerWeight *>(sw)->v;
+                                }
+
+                                uint64_t cache_key() const override final {
+                                        return 2;
+                                }
                         };
 
                         // currently, no support for multiple fields
@@ -233,6 +269,19 @@ namespace Trinity {
 
                                         return idf * float(freq) / double(freq + norm);
                                 }
+
+                                // freq / (freq + norm) is monotonic in freq, and we don't use normalizations yet (see score())
+                                float max_score(const uint32_t maxFreq, const uint8_t, const Similarity::ScorerWeight *weight) override final {
+                                        const auto norm{k1};
+                                        const auto w = static_cast<const ScorerWeight *>(weight);
+
+                                        return w->idf * float(maxFreq) / double(maxFreq + norm);
+                                }
+
+                                // k1 and b are constants
+                                uint64_t cache_key() const override final {
+                                        return 3;
+                                }
                         };
 
                         void reset(const IndexSourcesCollection *const c) override final {
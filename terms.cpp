@@ -3,6 +3,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <switch_hash.h>
 #include <text.h>
 
 Trinity::term_index_ctx Trinity::lookup_term(range_base<const uint8_t *, uint32_t>             termsData,
@@ -102,6 +103,99 @@ l100:
         return {};
 }
 
+void Trinity::lookup_terms(range_base<const uint8_t *, uint32_t>             termsData,
+                           const str8_t *const                               terms,
+                           const std::size_t                                 n,
+                           const std::vector<Trinity::terms_skiplist_entry> &skipList,
+                           term_index_ctx *const                             out) {
+        const auto *const skipListData = skipList.data();
+        const auto        skipListSize = skipList.size();
+        const auto *const e            = termsData.offset + termsData.size();
+        const auto        lt           = [](const str8_t a, const terms_skiplist_entry &b) noexcept {
+                return terms_cmp(a.data(), a.size(), b.term.data(), b.term.size()) < 0;
+        };
+        // we are in the block of skipListData[block - 1], or in no block if 0
+        std::size_t    block{0};
+        const uint8_t *p{nullptr};
+        // the last term decoded from the block, which is >= all terms resolved so far
+        char_t         termStorage[Limits::MaxTermLength];
+        uint8_t        curTermLen{0};
+        bool           haveCur{false};
+        term_index_ctx curTCTX;
+
+        for (std::size_t i{0}; i != n; ++i) {
+                const auto q = terms[i];
+
+                DEXPECT(q.size() <= Limits::MaxTermLength);
+                DEXPECT(!i || terms_cmp(terms[i - 1].data(), terms[i - 1].size(), q.data(), q.size()) <= 0);
+
+                if (block != skipListSize && !lt(q, skipListData[block])) {
+                        // the last skiplist entry <= q is past the current block
+                        // it's likely close to it, so we gallop forward instead of searching all remaining entries
+                        std::size_t lo{block}, step{1};
+
+                        while (lo + step < skipListSize && !lt(q, skipListData[lo + step])) {
+                                lo += step;
+                                step <<= 1;
+                        }
+
+                        block = std::upper_bound(skipListData + lo + 1, skipListData + std::min(lo + step, skipListSize), q, lt) - skipListData;
+
+                        const auto &it = skipListData[block - 1];
+
+                        DEXPECT(it.term.size() <= sizeof_array(termStorage));
+                        memcpy(termStorage, it.term.data(), it.term.size() * sizeof(char_t));
+                        p       = termsData.offset + it.blockOffset;
+                        haveCur = false;
+
+#ifdef TRINITY_TERMS_FAT_INDEX
+                        if (it.term == q) {
+                                // found in the index/skiplist
+                                out[i] = it.tctx;
+                                continue;
+                        }
+#endif
+                }
+
+                out[i] = {};
+                if (!block) {
+                        // q < all terms
+                        continue;
+                }
+
+                for (;;) {
+                        if (haveCur) {
+                                if (const auto r = terms_cmp(q.data(), q.size(), termStorage, curTermLen); r == 0) {
+                                        out[i] = curTCTX;
+                                        break;
+                                } else if (r < 0) {
+                                        // definitely not here
+                                        break;
+                                }
+                        }
+
+                        if (p == e) {
+                                break;
+                        }
+
+                        const auto commonPrefixLen = *p++;
+                        const auto suffixLen       = *p++;
+
+                        DEXPECT(commonPrefixLen + suffixLen <= sizeof_array(termStorage));
+
+                        memcpy(termStorage + commonPrefixLen * sizeof(char_t), p, suffixLen * sizeof(char_t));
+                        p += suffixLen * sizeof(char_t);
+
+                        curTermLen                = commonPrefixLen + suffixLen;
+                        curTCTX.documents         = Compression::decode_varuint32(p);
+                        curTCTX.indexChunk.len    = Compression::decode_varuint32(p);
+                        curTCTX.indexChunk.offset = *(uint32_t *)p;
+                        p += sizeof(uint32_t);
+                        haveCur = true;
+                }
+        }
+}
+
 void Trinity::unpack_terms_skiplist(const range_base<const uint8_t *, const uint32_t> termsIndex, std::vector<Trinity::terms_skiplist_entry> *skipList, simple_allocator &allocator) {
         for (const auto *p = reinterpret_cast<const uint8_t *>(termsIndex.start()), *const e = p + termsIndex.size(); p != e;) {
                 skipList->resize(skipList->size() + 1);
@@ -171,11 +265,445 @@ void Trinity::pack_terms(std::vector<std::pair<str8_t, term_index_ctx>> &terms,
         }
 }
 
-Trinity::SegmentTerms::SegmentTerms(const char *segmentBasePath) {
+static uint32_t pack_trie_node(const std::pair<Trinity::str8_t, Trinity::term_index_ctx> *b,
+                               const std::pair<Trinity::str8_t, Trinity::term_index_ctx> *const e,
+                               const uint32_t depth, IOBuffer *const out) {
+        using namespace Trinity;
+        // terms are sorted, so the common prefix of the first and the last term is common to all of them
+        const auto        first     = b->first;
+        const auto        last      = (e - 1)->first;
+        const auto        prefixLen = str8_t(first.data() + depth, first.size() - depth).CommonPrefixLen(str8_t(last.data() + depth, last.size() - depth));
+        const auto        end       = depth + prefixLen;
+        const auto *const final     = first.size() == end ? b : nullptr;
+        char_t            labels[256];
+        uint32_t          offsets[256];
+        uint32_t          children{0};
+
+        if (final) {
+                // a term that is a prefix of all others comes first
+                ++b;
+        }
+
+        while (b != e) {
+                const auto label = b->first.data()[end];
+                auto       it    = b + 1;
+
+                while (it != e && it->first.data()[end] == label) {
+                        ++it;
+                }
+
+                labels[children]    = label;
+                offsets[children++] = pack_trie_node(b, it, end + 1, out);
+                b                   = it;
+        }
+
+        const uint32_t o = out->size();
+
+        out->pack(uint8_t((final ? TrieNodeFinal : 0) | (children ? TrieNodeBranch : 0)), uint8_t(prefixLen));
+        out->serialize(first.data() + depth, prefixLen * sizeof(char_t));
+
+        if (final) {
+                out->encode_varuint32(final->second.documents);
+                out->encode_varuint32(final->second.indexChunk.len);
+                out->pack(final->second.indexChunk.offset);
+        }
+
+        if (children) {
+                out->pack(uint8_t(children - 1));
+                out->serialize(labels, children * sizeof(char_t));
+                out->serialize(offsets, children * sizeof(uint32_t));
+        }
+
+        return o;
+}
+
+void Trinity::pack_terms_trie(const std::vector<std::pair<str8_t, term_index_ctx>> &terms, IOBuffer *const trie) {
+        if (terms.empty()) {
+                return;
+        }
+
+        const auto root = pack_trie_node(terms.data(), terms.data() + terms.size(), 0, trie);
+
+        trie->pack(root);
+}
+
+Trinity::term_index_ctx Trinity::lookup_term_trie(const range_base<const uint8_t *, uint32_t> trie, const str8_t q) {
+        const auto *const base = trie.start();
+        const auto *      p    = base + *(uint32_t *)(trie.stop() - sizeof(uint32_t));
+        const auto *      it   = q.data();
+        const auto *const end  = it + q.size();
+
+        for (;;) {
+                const auto flags     = *p++;
+                const auto prefixLen = *p++;
+
+                if (prefixLen > end - it || memcmp(p, it, prefixLen * sizeof(char_t))) {
+                        return {};
+                }
+
+                p += prefixLen * sizeof(char_t);
+                it += prefixLen;
+
+                if (it == end) {
+                        if (flags & TrieNodeFinal) {
+                                term_index_ctx tctx;
+
+                                tctx.documents         = Compression::decode_varuint32(p);
+                                tctx.indexChunk.len    = Compression::decode_varuint32(p);
+                                tctx.indexChunk.offset = *(uint32_t *)p;
+                                return tctx;
+                        }
+                        return {};
+                } else if (!(flags & TrieNodeBranch)) {
+                        return {};
+                }
+
+                if (flags & TrieNodeFinal) {
+                        Compression::decode_varuint32(p);
+                        Compression::decode_varuint32(p);
+                        p += sizeof(uint32_t);
+                }
+
+                const uint32_t children = uint32_t(*p++) + 1;
+                const auto *   label    = static_cast<const char_t *>(memchr(p, *it, children * sizeof(char_t)));
+
+                if (!label) {
+                        return {};
+                }
+
+                const auto i = label - reinterpret_cast<const char_t *>(p);
+
+                p = base + *(uint32_t *)(p + children * sizeof(char_t) + i * sizeof(uint32_t));
+                ++it;
+        }
+}
+
+// The FNV hash of a term is mixed(see MurmurHash3 fmix64) so that its bits are usable for selecting the block and the bits in the block
+static inline uint64_t terms_bloom_filter_hash(const Trinity::str8_t term) noexcept {
+        auto h = FNVHash64(reinterpret_cast<const uint8_t *>(term.data()), term.size() * sizeof(Trinity::char_t));
+
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+}
+
+void Trinity::pack_terms_bloom_filter(const std::vector<std::pair<str8_t, term_index_ctx>> &terms, IOBuffer *const filter) {
+        static constexpr size_t blockBits{512};
+        const uint32_t          blocksCnt = std::max<size_t>(1, (terms.size() * TermsBloomFilterBitsPerTerm + blockBits - 1) / blockBits);
+        auto                    blocks    = static_cast<uint64_t *>(calloc(blocksCnt * 8, sizeof(uint64_t)));
+
+        DEFER({
+                std::free(blocks);
+        });
+
+        for (const auto &it : terms) {
+                const auto h     = terms_bloom_filter_hash(it.first);
+                auto       block = blocks + ((h >> 32) * blocksCnt >> 32) * 8;
+                uint32_t   h1 = h, h2 = (h >> 41) | 1;
+
+                for (uint32_t i{0}; i != TermsBloomFilterHashes; ++i, h1 += h2) {
+                        block[(h1 >> 6) & 7] |= uint64_t(1) << (h1 & 63);
+                }
+        }
+
+        filter->serialize(blocks, blocksCnt * 8 * sizeof(uint64_t));
+        filter->pack(blocksCnt);
+}
+
+bool Trinity::terms_bloom_filter_test(const range_base<const uint8_t *, uint32_t> filter, const str8_t term) noexcept {
+        const auto blocksCnt = *(uint32_t *)(filter.stop() - sizeof(uint32_t));
+        const auto h         = terms_bloom_filter_hash(term);
+        const auto block     = reinterpret_cast<const uint64_t *>(filter.start()) + ((h >> 32) * blocksCnt >> 32) * 8;
+        uint32_t   h1 = h, h2 = (h >> 41) | 1;
+
+        for (uint32_t i{0}; i != TermsBloomFilterHashes; ++i, h1 += h2) {
+                if (!(block[(h1 >> 6) & 7] & (uint64_t(1) << (h1 & 63)))) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+bool Trinity::wildcard_match(const str8_t pattern, const str8_t term) noexcept {
+        // greedy matching, backtracking to the last '*'
+        const auto *p = pattern.begin(), *const pe = pattern.end();
+        const auto *t = term.begin(), *const te = term.end();
+        const char_t *starP{nullptr}, *starT{nullptr};
+
+        while (t != te) {
+                if (p != pe && (*p == '?' || *p == *t)) {
+                        ++p;
+                        ++t;
+                } else if (p != pe && *p == '*') {
+                        starP = ++p;
+                        starT = t;
+                } else if (starP) {
+                        p = starP;
+                        t = ++starT;
+                } else {
+                        return false;
+                }
+        }
+
+        while (p != pe && *p == '*') {
+                ++p;
+        }
+        return p == pe;
+}
+
+Trinity::levenshtein_automaton::levenshtein_automaton(const str8_t t, const uint8_t k)
+    : termLen{uint8_t(std::min<size_t>(t.size(), Limits::MaxTermLength))}, maxEdits{k} {
+        memcpy(term, t.data(), termLen * sizeof(char_t));
+
+        // the empty prefix is j deletions away from term's first j characters
+        for (uint32_t j{0}; j <= termLen; ++j) {
+                states[0][j] = std::min<uint32_t>(j, maxEdits + 1);
+        }
+}
+
+bool Trinity::levenshtein_automaton::step(const uint8_t depth, const char_t c) noexcept {
+        const auto *const __restrict__ cur  = states[depth];
+        auto *const __restrict__ next       = states[depth + 1];
+        const uint8_t                  ceil = maxEdits + 1;
+        uint8_t                        min;
+
+        next[0] = min = std::min<uint8_t>(cur[0] + 1, ceil);
+        for (uint32_t j{1}; j <= termLen; ++j) {
+                const uint8_t v = std::min<uint8_t>({uint8_t(cur[j - 1] + (term[j - 1] != c)), uint8_t(cur[j] + 1), uint8_t(next[j - 1] + 1), ceil});
+
+                next[j] = v;
+                min     = std::min(min, v);
+        }
+
+        return min != ceil;
+}
+
+Trinity::terms_data_view::iterator Trinity::IndexSourcePrefixCompressedPrefixTermsView::block_for(const range_base<const uint8_t *, uint32_t> termsData, const std::vector<terms_skiplist_entry> &skiplist, const str8_t prefix) {
+        // the last skiplist entry <= prefix; see lookup_term()
+        const auto e = std::upper_bound(skiplist.begin(), skiplist.end(), prefix, [](const str8_t &a, const terms_skiplist_entry &b) noexcept {
+                return terms_cmp(a.data(), a.size(), b.term.data(), b.term.size()) < 0;
+        });
+
+        if (e == skiplist.begin()) {
+                return {termsData.start()};
+        }
+        return {termsData.start() + std::prev(e)->blockOffset, std::prev(e)->term};
+}
+
+Trinity::IndexSourcePrefixCompressedPrefixTermsView::IndexSourcePrefixCompressedPrefixTermsView(const range_base<const uint8_t *, uint32_t> termsData, const std::vector<terms_skiplist_entry> &skiplist, const str8_t p)
+    : it{block_for(termsData, skiplist, p)}, end{termsData.stop()}, prefix{prefixStorage, std::min<uint8_t>(p.size(), Limits::MaxTermLength)}, termsBase{termsData.start()}, skiplist{skiplist} {
+        memcpy(prefixStorage, p.data(), prefix.size() * sizeof(char_t));
+        seek();
+}
+
+void Trinity::IndexSourcePrefixCompressedPrefixTermsView::seek() {
+        // skip past terms < prefix, and stop at the first term that doesn't begin with it
+        while (it != end) {
+                const auto t = it.term();
+
+                if (term_has_prefix(t, prefix)) {
+                        exhausted = false;
+                        return;
+                } else if (terms_cmp(t.data(), t.size(), prefix.data(), prefix.size()) > 0) {
+                        break;
+                }
+
+                ++it;
+        }
+
+        exhausted = true;
+}
+
+void Trinity::IndexSourcePrefixCompressedPrefixTermsView::skip_prefix(const str8_t p) {
+        // the first skiplist entry past the terms that begin with p
+        const auto e = std::upper_bound(skiplist.begin(), skiplist.end(), p, [](const str8_t &a, const terms_skiplist_entry &b) noexcept {
+                return !term_has_prefix(b.term, a) && terms_cmp(a.data(), a.size(), b.term.data(), b.term.size()) < 0;
+        });
+
+        if (e != skiplist.begin()) {
+                const auto &b = *std::prev(e);
+
+                // only if the block is ahead; otherwise it begins with a term < p, which can't be past the current term
+                if (termsBase + b.blockOffset > it.position()) {
+                        it.reset(termsBase + b.blockOffset, b.term);
+                }
+        }
+
+        // skip the terms of that block that begin with p
+        do {
+                ++it;
+        } while (it != end && term_has_prefix(it.term(), p));
+
+        seek();
+}
+
+Trinity::IndexSourceTrieTermsView::IndexSourceTrieTermsView(const range_base<const uint8_t *, uint32_t> trie, const str8_t prefix)
+    : base{trie.start()} {
+        const auto *it = prefix.begin(), *const end = prefix.end();
+        uint8_t     len{0};
+
+        if (!trie.size()) {
+                exhausted = true;
+                return;
+        }
+
+        // find the node the prefix ends in; see lookup_term_trie()
+        for (const auto *p = base + *(uint32_t *)(trie.stop() - sizeof(uint32_t));;) {
+                const auto *const node      = p;
+                const auto        flags     = *p++;
+                const auto        prefixLen = *p++;
+                const auto        n         = std::min<size_t>(prefixLen, end - it);
+
+                if (memcmp(p, it, n * sizeof(char_t))) {
+                        exhausted = true;
+                        return;
+                } else if (it + n == end) {
+                        // all terms in this node's sub-trie
+                        if (!enter(node, len)) {
+                                next();
+                        }
+                        return;
+                }
+
+                memcpy(termStorage + len, p, prefixLen * sizeof(char_t));
+                len += prefixLen;
+                it += prefixLen;
+                p += prefixLen * sizeof(char_t);
+
+                if (!(flags & TrieNodeBranch)) {
+                        exhausted = true;
+                        return;
+                }
+
+                if (flags & TrieNodeFinal) {
+                        Compression::decode_varuint32(p);
+                        Compression::decode_varuint32(p);
+                        p += sizeof(uint32_t);
+                }
+
+                const uint32_t children = uint32_t(*p++) + 1;
+                const auto *   label    = static_cast<const char_t *>(memchr(p, *it, children * sizeof(char_t)));
+
+                if (!label) {
+                        exhausted = true;
+                        return;
+                }
+
+                const auto i = label - reinterpret_cast<const char_t *>(p);
+
+                termStorage[len++] = *it++;
+                p                  = base + *(uint32_t *)(p + children * sizeof(char_t) + i * sizeof(uint32_t));
+        }
+}
+
+// Appends the node's prefix to the term, and pushes its children
+// Returns true if the node is final, i.e the term is in the trie
+bool Trinity::IndexSourceTrieTermsView::enter(const uint8_t *p, const uint8_t len) {
+        const auto flags     = *p++;
+        const auto prefixLen = *p++;
+
+        memcpy(termStorage + len, p, prefixLen * sizeof(char_t));
+        p += prefixLen * sizeof(char_t);
+        termLen = len + prefixLen;
+
+        if (flags & TrieNodeFinal) {
+                tctx.documents         = Compression::decode_varuint32(p);
+                tctx.indexChunk.len    = Compression::decode_varuint32(p);
+                tctx.indexChunk.offset = *(uint32_t *)p;
+                p += sizeof(uint32_t);
+        }
+
+        if (flags & TrieNodeBranch) {
+                auto &f = stack[depth++];
+
+                f.size     = uint16_t(*p++) + 1;
+                f.children = p;
+                f.next     = 0;
+                f.termLen  = termLen;
+        }
+
+        return flags & TrieNodeFinal;
+}
+
+void Trinity::IndexSourceTrieTermsView::next() {
+        while (depth) {
+                auto &f = stack[depth - 1];
+
+                if (f.next == f.size) {
+                        --depth;
+                        continue;
+                }
+
+                const auto i     = f.next++;
+                const auto child = base + *(uint32_t *)(f.children + f.size * sizeof(char_t) + i * sizeof(uint32_t));
+
+                termStorage[f.termLen] = reinterpret_cast<const char_t *>(f.children)[i];
+                if (enter(child, f.termLen + 1)) {
+                        return;
+                }
+        }
+
+        exhausted = true;
+}
+
+void Trinity::IndexSourceTrieTermsView::skip_prefix(const str8_t prefix) {
+        // The stack frames of nodes at depth >= prefix.size() are those of the nodes of the current term's path that begin with prefix
+        // so we can drop them, along with their remaining children
+        while (depth && stack[depth - 1].termLen >= prefix.size()) {
+                --depth;
+        }
+
+        next();
+}
+
+Trinity::SegmentTerms::SegmentTerms(const char *segmentBasePath, const LoadPolicy policy) {
         int fd;
 
-        fd = open(Buffer{}.append(segmentBasePath, "/terms.idx").c_str(), O_RDONLY | O_LARGEFILE);
+        fd = open(Buffer{}.append(segmentBasePath, "/terms.trie").c_str(), O_RDONLY | O_LARGEFILE);
         if (fd == -1) {
+                if (errno != ENOENT) {
+                        throw Switch::system_error("Failed to access terms.trie: ", strerror(errno));
+                }
+        } else if (const auto fileSize = lseek64(fd, 0, SEEK_END); fileSize > 0) {
+                auto fileData = Utilities::map_file(fd, fileSize, policy);
+
+                close(fd);
+                if (unlikely(fileData == MAP_FAILED)) {
+                        throw Switch::data_error("Failed to access terms.trie: ", strerror(errno));
+                }
+
+                madvise(fileData, fileSize, MADV_DONTDUMP);
+                termsTrie.Set(reinterpret_cast<const uint8_t *>(fileData), fileSize);
+        } else {
+                close(fd);
+        }
+
+        fd = open(Buffer{}.append(segmentBasePath, "/terms.bf").c_str(), O_RDONLY | O_LARGEFILE);
+        if (fd == -1) {
+                if (errno != ENOENT) {
+                        throw Switch::system_error("Failed to access terms.bf: ", strerror(errno));
+                }
+        } else if (const auto fileSize = lseek64(fd, 0, SEEK_END); fileSize > sizeof(uint32_t)) {
+                auto fileData = Utilities::map_file(fd, fileSize, policy);
+
+                close(fd);
+                if (unlikely(fileData == MAP_FAILED)) {
+                        throw Switch::data_error("Failed to access terms.bf: ", strerror(errno));
+                }
+
+                madvise(fileData, fileSize, MADV_DONTDUMP);
+                termsFilter.Set(reinterpret_cast<const uint8_t *>(fileData), fileSize);
+        } else {
+                close(fd);
+        }
+
+        if (termsTrie.size()) {
+                // no need for the skiplist
+        } else if (fd = open(Buffer{}.append(segmentBasePath, "/terms.idx").c_str(), O_RDONLY | O_LARGEFILE); fd == -1) {
                 if (errno == ENOENT) {
                         // That's OK
                         return;
@@ -202,12 +730,12 @@ Trinity::SegmentTerms::SegmentTerms(const char *segmentBasePath) {
 
         fd = open(Buffer{}.append(segmentBasePath, "/terms.data").c_str(), O_RDONLY | O_LARGEFILE);
         if (fd == -1) {
-                // we have terms.idx, we must have terms.data
+                // we have terms.idx or terms.trie, we must have terms.data
                 throw Switch::system_error("Failed to access terms.data");
         }
 
         if (const auto fileSize = lseek64(fd, 0, SEEK_END); fileSize > 0) {
-                auto fileData = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+                auto fileData = Utilities::map_file(fd, fileSize, policy);
 
                 close(fd);
                 if (unlikely(fileData == MAP_FAILED)) {
@@ -1,5 +1,6 @@
 #pragma once
 #include "codecs.h"
+#include "utils.h"
 #include <compress.h>
 #include <switch_mallocators.h>
 
@@ -28,6 +29,15 @@ namespace Trinity {
                                    const str8_t                             term,
                                    const std::vector<terms_skiplist_entry> &skipList);
 
+        // Resolves terms[i] to out[i], for each of the n terms, which must be sorted(see terms_cmp())
+        // Instead of searching the skiplist and scanning a block for each term, as lookup_term() does, it walks the skiplist and
+        // the terms data forward, once, so that terms in the same block are resolved with a single scan of that block.
+        void lookup_terms(range_base<const uint8_t *, uint32_t>    termsData,
+                          const str8_t *const                      terms,
+                          const std::size_t                        n,
+                          const std::vector<terms_skiplist_entry> &skipList,
+                          term_index_ctx *const                    out);
+
         void unpack_terms_skiplist(const range_base<const uint8_t *, const uint32_t> termsIndex,
                                    std::vector<terms_skiplist_entry> *               skipList,
                                    simple_allocator &                                allocator);
@@ -36,6 +46,56 @@ namespace Trinity {
                         IOBuffer *const                                 data,
                         IOBuffer *const                                 index);
 
+        // Terms can also be indexed by a compacted trie(terms.trie), instead of the terms.idx skiplist
+        // The trie is serialized as is and accessed in place, so nothing is loaded in memory, and lookups don't need to
+        // decode any prefix-compressed terms; they just follow at most term.size() nodes.
+        // terms.data is still persisted, for iterating over all terms(see terms_data_view).
+        //
+        // Node layout:
+        // flags:u8, prefix length:u8, prefix, [documents:varint, indexChunk.len:varint, indexChunk.offset:u32](if TrieNodeFinal), [children - 1:u8, labels:u8[children], offsets:u32[children]](if TrieNodeBranch)
+        //
+        // A node first matches its prefix; if the term ends there, it matches the term if it's final, otherwise the next character
+        // selects a child node. Children are serialized before their parent, and the root node's offset is stored in the last 4 bytes.
+        //
+        // Define TRINITY_TERMS_TRIE to persist terms.trie instead of terms.idx. SegmentTerms supports both formats.
+        //#define TRINITY_TERMS_TRIE
+        static constexpr uint8_t TrieNodeFinal{1}, TrieNodeBranch{2};
+
+        // terms must be sorted(see pack_terms())
+        void pack_terms_trie(const std::vector<std::pair<str8_t, term_index_ctx>> &terms, IOBuffer *const trie);
+
+        term_index_ctx lookup_term_trie(const range_base<const uint8_t *, uint32_t> trie, const str8_t term);
+
+        // A blocked bloom filter of all terms of a segment(terms.bf)
+        //
+        // Most query terms do not exist in most segments, and without it, each such lookup would need to search the skiplist
+        // and scan a terms block. All bits of a term are set in a single 64 bytes block, so testing for a term accesses a single cache line.
+        // Layout: blocks(uint64_t[8] each), blocks count:u32
+        static constexpr size_t TermsBloomFilterBitsPerTerm{10}, TermsBloomFilterHashes{7};
+
+        void pack_terms_bloom_filter(const std::vector<std::pair<str8_t, term_index_ctx>> &terms, IOBuffer *const filter);
+
+        // false if term is definitely not in the filter
+        bool terms_bloom_filter_test(const range_base<const uint8_t *, uint32_t> filter, const str8_t term) noexcept;
+
+        // Matches term against a wildcard pattern, where '*' matches 0 or more characters and '?' exactly one character
+        bool wildcard_match(const str8_t pattern, const str8_t term) noexcept;
+
+        // The leading characters of a wildcard pattern before the first wildcard; all matching terms begin with it
+        inline str8_t wildcard_literal_prefix(const str8_t pattern) noexcept {
+                uint8_t i{0};
+
+                while (i != pattern.size() && pattern.data()[i] != '*' && pattern.data()[i] != '?') {
+                        ++i;
+                }
+                return {pattern.data(), i};
+        }
+
+        // true if term begins with prefix
+        inline bool term_has_prefix(const str8_t term, const str8_t prefix) noexcept {
+                return term.size() >= prefix.size() && !memcmp(term.data(), prefix.data(), prefix.size() * sizeof(char_t));
+        }
+
         // An abstract index source terms access wrapper
         //
         // For segments, you will likely use the prefix-compressed terms infra. but you may have
@@ -51,10 +111,92 @@ namespace Trinity {
 
                 virtual bool done() = 0;
 
+                // Advances past the current term, which must begin with prefix, and all terms that follow it that also begin with prefix
+                // Views that can seek(e.g via a skiplist or a trie) should override this; see fuzzy_match_terms()
+                virtual void skip_prefix(const str8_t prefix) {
+                        do {
+                                next();
+                        } while (!done() && term_has_prefix(cur().first, prefix));
+                }
+
                 virtual ~IndexSourceTermsView() {
                 }
         };
 
+        // A Levenshtein automaton; accepts the terms within maxEdits edits(insertions, deletions or substitutions) of a term
+        //
+        // The state after consuming a term prefix is the respective row of the edit distances matrix(capped to maxEdits + 1), so
+        // that we can intersect it with a sorted terms stream cheaply(see fuzzy_match_terms()): each term resumes from the state of
+        // the prefix it shares with the previous term, and if a prefix's state is a dead state(no term that begins with it can be accepted)
+        // the view seeks past all terms that begin with it.
+        struct levenshtein_automaton final {
+                // a term longer than that is definitely rejected
+                static constexpr size_t MaxDepth{Limits::MaxTermLength + Limits::MaxFuzzyEdits + 1};
+
+              private:
+                char_t  term[Limits::MaxTermLength];
+                uint8_t termLen, maxEdits;
+                // states[i] is the state after consuming i characters
+                uint8_t states[MaxDepth + 1][Limits::MaxTermLength + 1];
+
+              public:
+                levenshtein_automaton(const str8_t term, const uint8_t maxEdits);
+
+                // Computes the state after depth + 1 characters, from the state after depth characters and c
+                // Returns false if it's a dead state
+                bool step(const uint8_t depth, const char_t c) noexcept;
+
+                // The edit distance of the term from the consumed characters, if accepted(<= maxEdits)
+                inline uint8_t distance(const uint8_t depth) const noexcept {
+                        return states[depth][termLen];
+                }
+
+                inline bool accepts(const uint8_t depth) const noexcept {
+                        return distance(depth) <= maxEdits;
+                }
+        };
+
+        // Invokes l(term, tctx, distance) for each term of view accepted by a
+        // view must be in order(see IndexSource::new_terms_view())
+        template <typename L>
+        void fuzzy_match_terms(levenshtein_automaton &a, IndexSourceTermsView *const view, L &&l) {
+                char_t  prev[levenshtein_automaton::MaxDepth];
+                uint8_t prevLen{0};
+
+                while (!view->done()) {
+                        const auto    cur = view->cur();
+                        const auto    t   = cur.first;
+                        const uint8_t n   = std::min<size_t>(t.size(), levenshtein_automaton::MaxDepth);
+                        uint8_t       d{0};
+                        bool          dead{false};
+
+                        // states up to the shared prefix are those of prev
+                        while (d != prevLen && d != n && prev[d] == t.data()[d]) {
+                                ++d;
+                        }
+
+                        for (; d != n; ++d) {
+                                prev[d] = t.data()[d];
+                                if (!a.step(d, prev[d])) {
+                                        dead = true;
+                                        ++d;
+                                        break;
+                                }
+                        }
+
+                        prevLen = d;
+                        if (dead) {
+                                // no term that begins with prev[0, d) can be accepted
+                                view->skip_prefix({prev, d});
+                        } else {
+                                if (a.accepts(n)) {
+                                        l(t, cur.second, a.distance(n));
+                                }
+                                view->next();
+                        }
+                }
+        }
+
         // iterator access to the terms data
         // this is very useful for merging terms dictionaries (see IndexSourcePrefixCompressedTermsView)
         struct terms_data_view final {
@@ -85,6 +227,13 @@ namespace Trinity {
                                 cur.term.len = 0;
                         }
 
+                        // For accessing the terms data past a skiplist entry; the first term there is prefix-compressed against
+                        // the term that precedes it, which is the same as prev as far as the common prefix is concerned.
+                        iterator(const uint8_t *ptr, const str8_t prev)
+                            : iterator(ptr) {
+                                memcpy(termStorage, prev.data(), prev.size() * sizeof(str8_t::value_type));
+                        }
+
 			iterator(const iterator &o) = delete;
 
 			iterator &operator=(const iterator &) = delete;
@@ -112,6 +261,18 @@ namespace Trinity {
                                 return *this;
                         }
 
+                        // Repositions the iterator to ptr, past a skiplist entry; see iterator(const uint8_t *, const str8_t)
+                        void reset(const uint8_t *ptr, const str8_t prev) noexcept {
+                                p            = ptr;
+                                cur.term.len = 0;
+                                memcpy(termStorage, prev.data(), prev.size() * sizeof(str8_t::value_type));
+                        }
+
+                        // Past the current term if it has been decoded, otherwise at the current term
+                        const uint8_t *position() const noexcept {
+                                return p;
+                        }
+
                         inline std::pair<str8_t, term_index_ctx> operator*() noexcept {
                                 decode_cur();
                                 return {cur.term, cur.tctx};
@@ -163,26 +324,134 @@ namespace Trinity {
                 }
         };
 
+        // An IndexSourceTermsView for the terms of a prefix-compressed terms dictionary that begin with a prefix
+        // The skiplist is used to seek to the first terms block that may contain such terms.
+        struct IndexSourcePrefixCompressedPrefixTermsView final
+            : public IndexSourceTermsView {
+              private:
+                terms_data_view::iterator                      it;
+                const terms_data_view::iterator                end;
+                char_t                                         prefixStorage[Limits::MaxTermLength];
+                const str8_t                                   prefix;
+                bool                                           exhausted;
+                const uint8_t *const                           termsBase;
+                const std::vector<terms_skiplist_entry> &      skiplist;
+
+              private:
+                static terms_data_view::iterator block_for(const range_base<const uint8_t *, uint32_t>, const std::vector<terms_skiplist_entry> &, const str8_t);
+
+                void seek();
+
+              public:
+                IndexSourcePrefixCompressedPrefixTermsView(const range_base<const uint8_t *, uint32_t> termsData, const std::vector<terms_skiplist_entry> &skiplist, const str8_t prefix);
+
+                std::pair<str8_t, term_index_ctx> cur() override final {
+                        return *it;
+                }
+
+                void next() override final {
+                        ++it;
+                        seek();
+                }
+
+                // Seeks via the skiplist to the last block that begins with a term <= prefix or with prefix
+                void skip_prefix(const str8_t prefix) override final;
+
+                bool done() override final {
+                        return exhausted;
+                }
+        };
+
+        // An IndexSourceTermsView for the terms in a terms trie(see pack_terms_trie()) that begin with a prefix
+        // The trie is traversed depth-first from the node of the prefix, so terms are accessed in order.
+        struct IndexSourceTrieTermsView final
+            : public IndexSourceTermsView {
+              private:
+                struct frame final {
+                        const uint8_t *children;
+                        uint16_t       size;
+                        uint16_t       next;
+                        uint8_t        termLen;
+                };
+
+                const uint8_t *const base;
+                frame                stack[Limits::MaxTermLength + 2];
+                uint8_t              depth{0};
+                bool                 exhausted{false};
+                term_index_ctx       tctx;
+                char_t               termStorage[256];
+                uint8_t              termLen;
+
+              private:
+                bool enter(const uint8_t *node, const uint8_t len);
+
+              public:
+                IndexSourceTrieTermsView(const range_base<const uint8_t *, uint32_t> trie, const str8_t prefix);
+
+                std::pair<str8_t, term_index_ctx> cur() override final {
+                        return {{termStorage, termLen}, tctx};
+                }
+
+                void next() override final;
+
+                // Prunes the sub-tries of the terms that begin with prefix
+                void skip_prefix(const str8_t prefix) override final;
+
+                bool done() override final {
+                        return exhausted;
+                }
+        };
+
         //A handy wrapper for memory mapped terms data and a skiplist from the terms index
         class SegmentTerms final {
               private:
                 std::vector<terms_skiplist_entry>     skiplist;
                 simple_allocator                      allocator;
                 range_base<const uint8_t *, uint32_t> termsData;
+                // if the segment has a terms.trie, the skiplist is not used
+                range_base<const uint8_t *, uint32_t> termsTrie;
+                // empty for segments persisted before terms.bf was introduced
+                range_base<const uint8_t *, uint32_t> termsFilter;
 
               public:
-                SegmentTerms(const char *segmentBasePath);
+                SegmentTerms(const char *segmentBasePath, const LoadPolicy policy = LoadPolicy::Default);
 
                 ~SegmentTerms() noexcept {
                         if (auto ptr = (void *)(termsData.offset)) {
                                 munmap(ptr, termsData.size());
 			}
+                        if (auto ptr = (void *)(termsTrie.offset)) {
+                                munmap(ptr, termsTrie.size());
+                        }
+                        if (auto ptr = (void *)(termsFilter.offset)) {
+                                munmap(ptr, termsFilter.size());
+                        }
+                }
+
+                // See SegmentIndexSource::resolve_term_ctx()
+                inline bool may_contain(const str8_t term) const noexcept {
+                        return !termsFilter.size() || terms_bloom_filter_test(termsFilter, term);
                 }
 
                 term_index_ctx lookup(const str8_t term) {
+                        if (termsTrie.size()) {
+                                return lookup_term_trie(termsTrie, term);
+                        }
                         return lookup_term(termsData, term, skiplist);
                 }
 
+                // terms must be sorted; see lookup_terms()
+                void lookup(const str8_t *const terms, const std::size_t n, term_index_ctx *const out) {
+                        if (termsTrie.size()) {
+                                // trie lookups don't search anything
+                                for (std::size_t i{0}; i != n; ++i) {
+                                        out[i] = lookup_term_trie(termsTrie, terms[i]);
+                                }
+                        } else {
+                                lookup_terms(termsData, terms, n, skiplist, out);
+                        }
+                }
+
                 auto terms_data_access() const {
                         return terms_data_view(termsData);
                 }
@@ -190,5 +459,13 @@ namespace Trinity {
                 auto new_terms_view() const {
                         return new IndexSourcePrefixCompressedTermsView(termsData);
                 }
+
+                // Terms that begin with prefix; see IndexSource::new_terms_view()
+                IndexSourceTermsView *new_terms_view(const str8_t prefix) const {
+                        if (termsTrie.size()) {
+                                return new IndexSourceTrieTermsView(termsTrie, prefix);
+                        }
+                        return new IndexSourcePrefixCompressedPrefixTermsView(termsData, skiplist, prefix);
+                }
         };
 } // namespace Trinity
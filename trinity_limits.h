@@ -13,10 +13,19 @@ namespace Trinity {
                 static constexpr size_t MaxQueryTokens{8192};
                 static constexpr size_t MaxTermLength{64};
                 static constexpr size_t MaxPosition{1 << 14};
+                // see phrase::slop
+                static constexpr size_t MaxPhraseSlop{64};
+                // see phrase::expansion
+                static constexpr size_t MaxTermExpansions{256};
+                // See TermExpansion::FuzzyOneEdit
+                static constexpr size_t MaxFuzzyEdits{2};
 
                 // Sanity check
                 static_assert(MaxTermLength < 250 && MaxTermLength > 8);
                 static_assert(MaxPhraseSize <= 128);
+                static_assert(MaxPhraseSlop <= 255);
+                static_assert(MaxTermExpansions && MaxTermExpansions <= MaxQueryTokens);
+                static_assert(MaxFuzzyEdits == 2); // TermExpansion::FuzzyOneEdit, TermExpansion::FuzzyTwoEdits
                 static_assert(MaxQueryTokens <= 8192);
                 static_assert(MaxPosition <= std::numeric_limits<tokenpos_t>::max());
         } // namespace Limits
@@ -1,6 +1,7 @@
 #include "utils.h"
 #include "common.h"
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -44,3 +45,94 @@ int8_t Trinity::Utilities::to_file(const char *p, uint64_t len, const char *path
         else
                 return 0;
 }
+
+void *Trinity::Utilities::map_file(int fd, const size_t fileSize, const LoadPolicy policy) {
+        switch (policy) {
+                case LoadPolicy::Populate:
+                        return mmap(nullptr, fileSize, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+
+                case LoadPolicy::WillNeed:
+                case LoadPolicy::Random: {
+                        auto fileData = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+
+                        if (fileData != MAP_FAILED) {
+                                madvise(fileData, fileSize, policy == LoadPolicy::WillNeed ? MADV_WILLNEED : MADV_RANDOM);
+                        }
+                        return fileData;
+                }
+
+                case LoadPolicy::HugePages: {
+                        // Over-allocate so that we can align the mapping to a huge page boundary; the kernel
+                        // can only back 2MB aligned ranges with huge pages
+                        static constexpr size_t hugePageSize{2 * 1024 * 1024};
+                        const size_t            pageSize = sysconf(_SC_PAGESIZE);
+                        const auto              span     = (fileSize + pageSize - 1) & ~(pageSize - 1);
+                        const auto              reserved = span + hugePageSize;
+                        auto                    base     = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+                        if (base == MAP_FAILED) {
+                                return MAP_FAILED;
+                        }
+
+                        auto *const b   = static_cast<uint8_t *>(base);
+                        auto *const p   = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(b) + hugePageSize - 1) & ~(hugePageSize - 1));
+                        auto *const end  = p + span;
+
+                        if (p != b) {
+                                munmap(b, p - b);
+                        }
+                        if (end != b + reserved) {
+                                munmap(end, (b + reserved) - end);
+                        }
+
+#ifdef MADV_HUGEPAGE
+                        madvise(p, span, MADV_HUGEPAGE);
+#endif
+
+                        for (size_t o{0}; o < fileSize;) {
+                                const auto r = pread64(fd, p + o, fileSize - o, o);
+
+                                if (r > 0) {
+                                        o += r;
+                                } else if (r == -1 && errno == EINTR) {
+                                        continue;
+                                } else {
+                                        const auto saved = r == 0 ? EIO : errno;
+
+                                        munmap(p, span);
+                                        errno = saved;
+                                        return MAP_FAILED;
+                                }
+                        }
+
+                        mprotect(p, span, PROT_READ);
+                        return p;
+                }
+
+                case LoadPolicy::Locked: {
+                        auto fileData = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+
+                        if (fileData != MAP_FAILED && mlock(fileData, fileSize) == -1) {
+                                const auto saved = errno;
+
+                                munmap(fileData, fileSize);
+                                errno = saved;
+                                return MAP_FAILED;
+                        }
+                        return fileData;
+                }
+
+                default:
+                        return mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        }
+}
+
+void Trinity::Utilities::prefetch_mapped(const void *p, const size_t len) {
+        static const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+        const auto             start    = reinterpret_cast<uintptr_t>(p) & ~(pageSize - 1);
+        const auto             end      = reinterpret_cast<uintptr_t>(p) + len;
+
+        if (len) {
+                madvise(reinterpret_cast<void *>(start), end - start, MADV_WILLNEED);
+        }
+}
@@ -3,9 +3,43 @@
 #include <switch.h>
 
 namespace Trinity {
+        // How a segment's files(index, terms.data, hits.data) are loaded in memory
+        // See SegmentIndexSource::SegmentIndexSource()
+        //
+        // The default is fine for most segments; the kernel will fault the pages in on access and evict them under memory pressure.
+        // For the hot segments of a latency-sensitive service, you may want to avoid page faults on the query path altogether.
+        enum class LoadPolicy : uint8_t {
+                // Plain MAP_SHARED mapping, no access hints
+                Default = 0,
+                // MAP_POPULATE: the file is read in when it's mapped, so that the first queries won't stall on page faults
+                Populate,
+                // madvise(MADV_WILLNEED): the kernel will read the file ahead asynchronously
+                WillNeed,
+                // madvise(MADV_RANDOM): disables read-ahead, which is a waste of I/O and page cache
+                // for segments much larger than the available memory, where accesses are sparse
+                // Codecs that support it will also read ahead the first blocks of the postings lists of the query terms(see Codecs::Decoder::prefetch())
+                Random,
+                // The file is copied into an anonymous mapping backed by transparent huge pages(MADV_HUGEPAGE), which
+                // greatly reduces TLB misses for large segments. Pages are no longer shared with the page cache, and are never evicted
+                // unless swapped out.
+                HugePages,
+                // MAP_POPULATE and mlock(); the pages will never be evicted
+                // RLIMIT_MEMLOCK must be high enough, otherwise loading the segment will fail
+                Locked
+        };
+
         namespace Utilities {
                 int8_t to_file(const char *p, uint64_t len, const char *path);
 
                 int8_t to_file(const char *p, uint64_t len, int fd);
+
+                // Maps fileSize bytes of the file fd refers to, according to policy
+                // Returns MAP_FAILED and sets errno on failure, just like mmap()
+                // The mapping is read-only, and should be released with munmap(), regardless of the policy
+                void *map_file(int fd, const size_t fileSize, const LoadPolicy policy);
+
+                // Initiates asynchronous read-ahead of [p, p + len) of a file mapping(MADV_WILLNEED)
+                // p needn't be page aligned
+                void prefetch_mapped(const void *p, const size_t len);
         } // namespace Utilities
 } // namespace Trinity